@@ -0,0 +1,493 @@
+#include "Benchmark.h"
+#include "MemoryTracker.h"
+#include "MeshGenerators.h"
+#include "PerfCounters.h"
+#include "Timer.h"
+#include "Trace.h"
+#include "UserInteractionManager.h"
+
+#include <vtkMath.h>
+#include <vtkPlane.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const int benchmarkSeedCnt = 64;
+// faces lifted for the update_faces stage, with all faces sharing their points
+static const int benchmarkUpdateFaces = 256;
+static const int benchmarkSizes[] = { 10000, 100000, 1000000, 5000000, 20000000 };
+static const char *meshNames[] = { "icosphere", "torus", "noisy_part", "assembly" };
+
+struct StageTiming {
+    string name;
+    vector<double> samples;
+    long long counters[PERF_COUNTER_COUNT];
+    bool counterValid[PERF_COUNTER_COUNT];
+    long long peakTrackedBytes;
+};
+
+struct BenchmarkResult {
+    string mesh;
+    int faces;
+    int unlabeledFaces;     // faces left without a cluster by the assignment, the most of any repeat
+    vector<StageTiming> stages;
+};
+
+// counters and the tracked memory peak since the last ResetPeaks are kept from the
+// last repetition, sub-stages without counters report no peak either
+static void addSample(vector<StageTiming>& stages, const string& name, double seconds, PerfCounters *perf = NULL) {
+    size_t i = 0;
+    while (i < stages.size() && stages[i].name != name) {
+        ++i;
+    }
+    if (i == stages.size()) {
+        StageTiming stage;
+        stage.name = name;
+        stages.push_back(stage);
+    }
+
+    StageTiming& stage = stages[i];
+    stage.samples.push_back(seconds);
+    for (int j = 0; j < PERF_COUNTER_COUNT; ++j) {
+        stage.counterValid[j] = perf && perf->IsValid((PerfCounter) j);
+        stage.counters[j] = stage.counterValid[j] ? perf->Get((PerfCounter) j) : 0;
+    }
+    stage.peakTrackedBytes = perf ? MemoryTracker::PeakTotal() : -1;
+}
+
+static double minSample(const vector<double>& samples) {
+    double res = samples[0];
+    for (size_t i = 1; i < samples.size(); ++i) {
+        res = samples[i] < res ? samples[i] : res;
+    }
+    return res;
+}
+
+static double meanSample(const vector<double>& samples) {
+    double sum = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        sum += samples[i];
+    }
+    return sum / samples.size();
+}
+
+static vtkSmartPointer<vtkPolyData> generateMesh(int meshId, int targetFaces, int seed) {
+    switch (meshId) {
+    case 0:
+        return GenerateIcosphere(targetFaces);
+    case 1:
+        return GenerateTorus(targetFaces);
+    case 2:
+        return GenerateNoisyPart(targetFaces, seed);
+    default:
+        return GenerateAssembly(targetFaces);
+    }
+}
+
+// one full pass of the pipeline on a fresh manager, the mesh itself is reused
+// what a progressive run has delivered so far
+struct ProgressiveRun {
+    double begin;
+    double firstSeconds;
+    int snapshotCnt;
+    SegmentationSnapshot *last;
+};
+
+static void collectSnapshot(void *data, SegmentationSnapshot *snapshot) {
+    ProgressiveRun *run = (ProgressiveRun *) data;
+    if (!run->snapshotCnt++) {
+        run->firstSeconds = WallTimer::Now() - run->begin;
+    }
+    delete run->last;
+    run->last = snapshot;
+}
+
+// faces whose sharded label differs from the single process one on the same mesh,
+// seeds and weights; the reference runs untimed on a manager of its own. mesh is the
+// generated one, reordered the same way on a copy, so the seeds are drawn alike.
+static int compareSharded(vtkSmartPointer<vtkPolyData> mesh, FaceOrder order, int seed, long long memoryBudget, const WeightParameters& weights,
+    SeedMode seedMode, const int *labels) {
+    vtkSmartPointer<vtkRenderWindowInteractor> noInteractor;
+    if (order != FACE_ORDER_NONE) {
+        vtkSmartPointer<vtkPolyData> copy = vtkSmartPointer<vtkPolyData>::New();
+        copy->DeepCopy(mesh);
+        mesh = copy;
+    }
+    UserInteractionManager *reference = new UserInteractionManager(mesh);
+    if (order != FACE_ORDER_NONE) {
+        reference->ReorderFaces(order);
+    }
+    reference->SetCacheEnabled(false);
+    reference->SetRandomSeed(seed);
+    reference->SetMemoryBudget(memoryBudget);
+    reference->SetWeights(weights);
+    reference->SetSeedMode(seedMode);
+    reference->ConvertPolydataToDualGraph();
+    reference->AutomaticSelectSeeds(benchmarkSeedCnt, noInteractor);
+    delete[] reference->StartSegmentation(noInteractor);
+
+    const int *expected = reference->GetFaceLabels();
+    int numberOfFaces = (int) mesh->GetNumberOfCells();
+    int mismatches = 0;
+    for (int i = 0; i < numberOfFaces; ++i) {
+        if (labels[i] != expected[i] && mismatches++ < 10) {
+            printf("  face %d : sharded %d, in process %d\n", i, labels[i], expected[i]);
+        }
+    }
+    delete reference;
+    return mismatches;
+}
+
+// false when the assignment left faces without a cluster, unlabeledFaces receives how
+// many, or the sharded labels differ from the single process ones
+static bool runPipeline(vtkSmartPointer<vtkPolyData> mesh, int seed, long long memoryBudget, FaceOrder order, int multilevelFaces, int outOfCoreFaces, int shardCnt,
+    int progressiveFaces, const WeightParameters& weights, double regionThreshold, SeedMode seedMode, bool vertexGraph, vector<StageTiming>& stages,
+    int& unlabeledFaces) {
+    vtkSmartPointer<vtkRenderWindowInteractor> noInteractor;
+    vtkSmartPointer<vtkPolyData> generated = mesh;
+    if (order != FACE_ORDER_NONE) {
+        // reordering permutes the mesh in place, a copy keeps the generated order for
+        // the repeats and runs after this one
+        vtkSmartPointer<vtkPolyData> copy = vtkSmartPointer<vtkPolyData>::New();
+        copy->DeepCopy(mesh);
+        mesh = copy;
+    }
+    UserInteractionManager *manager = new UserInteractionManager(mesh);
+    manager->SetCacheEnabled(false);
+    manager->SetRandomSeed(seed);
+    manager->SetMemoryBudget(memoryBudget);
+    manager->SetMultilevel(multilevelFaces);
+    manager->SetOutOfCore(outOfCoreFaces);
+    manager->SetShards(shardCnt);
+    manager->SetProgressive(progressiveFaces);
+    manager->SetWeights(weights);
+    manager->SetRegionGrowing(regionThreshold);
+    manager->SetSeedMode(seedMode);
+    manager->SetVertexGraph(vertexGraph);
+
+    PerfCounters perf;
+    WallTimer timer;
+    bool consistent = true;
+    if (order != FACE_ORDER_NONE) {
+        MemoryTracker::ResetPeaks();
+        perf.Start();
+        manager->ReorderFaces(order);
+        perf.Stop();
+        addSample(stages, "reorder", timer.Elapsed(), &perf);
+    }
+
+    timer.Start();
+    MemoryTracker::ResetPeaks();
+    perf.Start();
+    manager->ConvertPolydataToDualGraph();
+    perf.Stop();
+    addSample(stages, "dual_graph", timer.Elapsed(), &perf);
+
+    timer.Start();
+    MemoryTracker::ResetPeaks();
+    perf.Start();
+    manager->AutomaticSelectSeeds(benchmarkSeedCnt, noInteractor);
+    perf.Stop();
+    addSample(stages, "seeding", timer.Elapsed(), &perf);
+
+    if (progressiveFaces > 0 && regionThreshold <= 0) {
+        // steps 3 and 4 as one stage, the time to the first snapshot as its sub-stage
+        timer.Start();
+        MemoryTracker::ResetPeaks();
+        perf.Start();
+        ProgressiveRun run = { WallTimer::Now(), 0.0, 0, NULL };
+        manager->SegmentProgressively(collectSnapshot, &run);
+        perf.Stop();
+        addSample(stages, "progressive", timer.Elapsed(), &perf);
+        addSample(stages, "progressive.first", run.firstSeconds);
+        manager->ApplySnapshot(run.last, noInteractor);
+    } else {
+        timer.Start();
+        MemoryTracker::ResetPeaks();
+        perf.Start();
+        double *dur = manager->StartSegmentation(noInteractor);
+        perf.Stop();
+        addSample(stages, "assignment", timer.Elapsed(), &perf);
+        addSample(stages, "assignment.centers", dur[0]);
+        addSample(stages, "assignment.distances", dur[1], &manager->GetDijkstraCounters());
+        addSample(stages, "assignment.nearest", dur[2]);
+        addSample(stages, "assignment.collect", dur[3]);
+        addSample(stages, "assignment.colors", dur[4]);
+        delete[] dur;
+
+        // the sharded path has to give the labels of the single process one
+        int numberOfFaces = (int) mesh->GetNumberOfCells();
+        if (shardCnt > 1 && regionThreshold <= 0 && !(outOfCoreFaces > 0 && numberOfFaces > outOfCoreFaces)) {
+            int mismatches = compareSharded(generated, order, seed, memoryBudget, weights, seedMode, manager->GetFaceLabels());
+            if (mismatches) {
+                printf("sharded : %d of %d faces differ from the single process labels\n", mismatches, numberOfFaces);
+            } else {
+                printf("sharded : labels match the single process ones\n");
+            }
+            consistent = !mismatches;
+        }
+
+        timer.Start();
+        MemoryTracker::ResetPeaks();
+        perf.Start();
+        manager->MergeClusters(benchmarkSeedCnt, noInteractor);
+        perf.Stop();
+        addSample(stages, "merge", timer.Elapsed(), &perf);
+    }
+
+    // every face has to end up in a cluster, weights that propagate nothing leave them out
+    const int *labels = manager->GetFaceLabels();
+    unlabeledFaces = 0;
+    for (vtkIdType i = 0; i < mesh->GetNumberOfCells(); ++i) {
+        unlabeledFaces += labels[i] < 0;
+    }
+    if (unlabeledFaces) {
+        printf("%d of %d faces left without a cluster\n", unlabeledFaces, (int) mesh->GetNumberOfCells());
+        consistent = false;
+    }
+
+    timer.Start();
+    MemoryTracker::ResetPeaks();
+    perf.Start();
+    for (int k = benchmarkSeedCnt; k >= 2; --k) {
+        manager->SetClusterStep(benchmarkSeedCnt, k, noInteractor);
+    }
+    perf.Stop();
+    addSample(stages, "level_extraction", timer.Elapsed(), &perf);
+
+    // lift the faces nearest face 0 by a quarter of one of its edges and update them
+    vtkPoints *points = mesh->GetPoints();
+    vtkIdType npts, *pts;
+    double p[3], q[3], first[3];
+    mesh->GetCellPoints(0, npts, pts);
+    points->GetPoint(pts[0], first);
+    points->GetPoint(pts[1], q);
+    double lift = 0.25 * sqrt(vtkMath::Distance2BetweenPoints(first, q));
+    vector< pair<double, vtkIdType> > nearest(mesh->GetNumberOfCells());
+    for (vtkIdType i = 0; i < (vtkIdType) nearest.size(); ++i) {
+        mesh->GetCellPoints(i, npts, pts);
+        points->GetPoint(pts[0], p);
+        nearest[i] = make_pair(vtkMath::Distance2BetweenPoints(first, p), i);
+    }
+    size_t liftedCnt = min((size_t) benchmarkUpdateFaces, nearest.size());
+    partial_sort(nearest.begin(), nearest.begin() + liftedCnt, nearest.end());
+    vector<char> moved(points->GetNumberOfPoints(), 0);
+    vector<vtkIdType> movedIds;
+    vector<double> movedFrom;
+    for (size_t i = 0; i < liftedCnt; ++i) {
+        mesh->GetCellPoints(nearest[i].second, npts, pts);
+        for (vtkIdType j = 0; j < npts; ++j) {
+            if (!moved[pts[j]]) {
+                moved[pts[j]] = 1;
+                points->GetPoint(pts[j], p);
+                movedIds.push_back(pts[j]);
+                movedFrom.insert(movedFrom.end(), p, p + 3);
+                p[2] += lift;
+                points->SetPoint(pts[j], p);
+            }
+        }
+    }
+    points->Modified();
+    vector<int> editedFaces;
+    for (vtkIdType i = 0; i < (vtkIdType) nearest.size(); ++i) {
+        mesh->GetCellPoints(i, npts, pts);
+        for (vtkIdType j = 0; j < npts; ++j) {
+            if (moved[pts[j]]) {
+                editedFaces.push_back((int) i);
+                break;
+            }
+        }
+    }
+
+    timer.Start();
+    MemoryTracker::ResetPeaks();
+    perf.Start();
+    manager->UpdateFaces(&editedFaces[0], (int) editedFaces.size(), noInteractor);
+    perf.Stop();
+    addSample(stages, "update_faces", timer.Elapsed(), &perf);
+
+    // cut the cluster containing face 0 with a plane through that face
+    double origin[3] = { 0, 0, 0 }, normal[3] = { 1, 0, 0 };
+    mesh->GetCellPoints(0, npts, pts);
+    for (vtkIdType i = 0; i < npts; ++i) {
+        mesh->GetPoints()->GetPoint(pts[i], p);
+        origin[0] += p[0] / npts;
+        origin[1] += p[1] / npts;
+        origin[2] += p[2] / npts;
+    }
+    vtkSmartPointer<vtkPlane> cutPlane = vtkSmartPointer<vtkPlane>::New();
+    cutPlane->SetOrigin(origin);
+    cutPlane->SetNormal(normal);
+
+    timer.Start();
+    MemoryTracker::ResetPeaks();
+    perf.Start();
+    manager->ConfirmClusterSegmentation(benchmarkSeedCnt, benchmarkSeedCnt / 4);
+    DisjointSet *S = NULL;
+    unordered_map< int, List<int>* > *divMap = manager->clusterDivision(noInteractor, cutPlane, 0, S);
+    perf.Stop();
+    addSample(stages, "division", timer.Elapsed(), &perf);
+
+    manager->ReleaseDivision(divMap, S);
+    delete manager;
+
+    // the repeats and later runs start from the generated mesh again
+    for (size_t i = 0; i < movedIds.size(); ++i) {
+        points->SetPoint(movedIds[i], &movedFrom[3 * i]);
+    }
+    points->Modified();
+    return consistent;
+}
+
+static bool writeResults(const string& fileName, const vector<BenchmarkResult>& results, int seed, int repeat, long long memoryBudget, FaceOrder order, int multilevelFaces, int outOfCoreFaces, int shardCnt,
+    int progressiveFaces, const WeightParameters& weights, double regionThreshold, SeedMode seedMode, bool vertexGraph) {
+    FILE *fp = fopen(fileName.c_str(), "w");
+    if (!fp) {
+        return false;
+    }
+
+    fprintf(fp, "{\n  \"seedCnt\": %d,\n  \"randomSeed\": %d,\n  \"repeat\": %d,\n  \"threads\": %u,\n  \"memoryBudget\": %lld,\n  \"faceOrder\": \"%s\",\n  \"multilevelFaces\": %d,\n  \"outOfCoreFaces\": %d,\n  \"shards\": %d,\n  \"progressiveFaces\": %d,\n  \"weights\": \"%s\",\n  \"regionGrowing\": %g,\n  \"seeds\": \"%s\",\n  \"vertexGraph\": %s,\n",
+        benchmarkSeedCnt, seed, repeat, thread::hardware_concurrency(), memoryBudget, FaceOrdering::Name(order), multilevelFaces, outOfCoreFaces, shardCnt, progressiveFaces,
+        WeightPolicyName(weights.policy), regionThreshold, SeedSampler::Name(seedMode), vertexGraph ? "true" : "false");
+    fprintf(fp, "  \"peakResidentBytes\": %lld,\n  \"results\": [\n", MemoryTracker::PeakResidentBytes());
+    bool first = true;
+    for (size_t i = 0; i < results.size(); ++i) {
+        for (size_t j = 0; j < results[i].stages.size(); ++j) {
+            const StageTiming& stage = results[i].stages[j];
+            double best = minSample(stage.samples);
+            fprintf(fp, "%s    { \"mesh\": \"%s\", \"faces\": %d, \"unlabeled_faces\": %d, \"stage\": \"%s\", \"min_seconds\": %.6f, \"mean_seconds\": %.6f, \"faces_per_second\": %.1f",
+                first ? "" : ",\n", results[i].mesh.c_str(), results[i].faces, results[i].unlabeledFaces, stage.name.c_str(), best, meanSample(stage.samples),
+                best > 0 ? results[i].faces / best : 0.0);
+            for (int c = 0; c < PERF_COUNTER_COUNT; ++c) {
+                if (stage.counterValid[c]) {
+                    fprintf(fp, ", \"%s\": %lld", PerfCounters::Name((PerfCounter) c), stage.counters[c]);
+                }
+            }
+            if (stage.peakTrackedBytes >= 0) {
+                fprintf(fp, ", \"peak_tracked_bytes\": %lld", stage.peakTrackedBytes);
+            }
+            fprintf(fp, " }");
+            first = false;
+        }
+    }
+    fprintf(fp, "\n  ]\n}\n");
+
+    return fclose(fp) == 0;
+}
+
+int RunBenchmarks(int argc, char *argv[]) {
+    string outputFile = "benchmark.json", traceFile;
+    int maxFaces = 1000000, repeat = 1, seed = 1;
+    long long memoryBudget = 0;
+    FaceOrder order = FACE_ORDER_NONE;
+    int multilevelFaces = 0, outOfCoreFaces = 0, shardCnt = 0, progressiveFaces = 0;
+    WeightParameters weights;
+    double regionThreshold = 0.0;
+    SeedMode seedMode = SEED_RANDOM;
+    bool vertexGraph = false;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--max-faces") == 0 && i + 1 < argc) {
+            maxFaces = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            memoryBudget = atoll(argv[++i]) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--face-order") == 0 && i + 1 < argc) {
+            if (!FaceOrdering::Parse(argv[++i], order)) {
+                printf("unknown face order %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--multilevel") == 0 && i + 1 < argc) {
+            multilevelFaces = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out-of-core") == 0 && i + 1 < argc) {
+            outOfCoreFaces = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shardCnt = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--progressive") == 0 && i + 1 < argc) {
+            progressiveFaces = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            if (!ParseWeightParameters(argv[++i], weights)) {
+                printf("unknown weight policy %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--region-growing") == 0 && i + 1 < argc) {
+            regionThreshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc) {
+            if (!SeedSampler::Parse(argv[++i], seedMode)) {
+                printf("unknown seed mode %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--vertex-graph") == 0) {
+            vertexGraph = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (argv[i][0] != '-') {
+            outputFile = argv[i];
+        } else {
+            printf("unknown benchmark option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    repeat = repeat > 0 ? repeat : 1;
+
+    if (!traceFile.empty()) {
+        Trace::SetThreadName("main");
+        Trace::Enable(true);
+    }
+
+    vector<BenchmarkResult> results;
+    bool consistent = true;
+    for (size_t s = 0; s < sizeof(benchmarkSizes) / sizeof(benchmarkSizes[0]); ++s) {
+        if (benchmarkSizes[s] > maxFaces) {
+            break;
+        }
+        for (int m = 0; m < 4; ++m) {
+            vtkSmartPointer<vtkPolyData> mesh = generateMesh(m, benchmarkSizes[s], seed);
+
+            BenchmarkResult result;
+            result.mesh = meshNames[m];
+            result.faces = (int) mesh->GetNumberOfCells();
+            result.unlabeledFaces = 0;
+            int unlabeledFaces;
+            for (int r = 0; r < repeat; ++r) {
+                TraceScope trace(meshNames[m], "benchmark", result.faces);
+                consistent = runPipeline(mesh, seed, memoryBudget, order, multilevelFaces, outOfCoreFaces, shardCnt, progressiveFaces, weights, regionThreshold, seedMode, vertexGraph, result.stages, unlabeledFaces) && consistent;
+                result.unlabeledFaces = max(result.unlabeledFaces, unlabeledFaces);
+            }
+            results.push_back(result);
+
+            printf("\n%s, %d faces, %d unlabeled\n", result.mesh.c_str(), result.faces, result.unlabeledFaces);
+            for (size_t j = 0; j < result.stages.size(); ++j) {
+                double best = minSample(result.stages[j].samples);
+                printf("  %-22s %10.4lf s %14.0lf faces/s\n", result.stages[j].name.c_str(), best, best > 0 ? result.faces / best : 0.0);
+            }
+        }
+    }
+
+    if (!writeResults(outputFile, results, seed, repeat, memoryBudget, order, multilevelFaces, outOfCoreFaces, shardCnt, progressiveFaces, weights, regionThreshold, seedMode, vertexGraph)) {
+        printf("could not write %s\n", outputFile.c_str());
+        return 1;
+    }
+    printf("\nresults written to %s\n", outputFile.c_str());
+
+    if (!traceFile.empty() && !Trace::Write(traceFile)) {
+        printf("could not write %s\n", traceFile.c_str());
+        return 1;
+    }
+    if (!consistent) {
+        printf("faces were left without a cluster or sharded labels differ from the single process ones\n");
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
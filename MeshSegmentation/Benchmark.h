@@ -0,0 +1,26 @@
+#pragma once
+
+// Headless stage-level benchmark, run as
+//   MeshSegmentation --benchmark [results.json] [--max-faces N] [--repeat R] [--seed S] [--memory-budget MB]
+//       [--face-order none|morton|hilbert|rcm] [--multilevel FACES] [--out-of-core FACES]
+//       [--shards N] [--progressive FACES] [--weights mixed|dihedral|curvature[:VALUE]]
+//       [--region-growing THRESHOLD] [--seeds random|poisson|farthest] [--vertex-graph]
+//       [--trace trace.json]
+// Every synthetic mesh up to N faces goes through dual graph construction, seeding,
+// assignment, merging, level extraction, an UpdateFaces after lifting a patch of faces
+// and division with the cache disabled and a fixed seed. Wall time and faces/s per stage are printed and written as JSON,
+// with the faces the assignment left without a cluster, which fail the benchmark;
+// --trace additionally records every span as a Chrome trace.
+// --memory-budget caps the tracked buffers, see UserInteractionManager::SetMemoryBudget,
+// --face-order renumbers the faces first and times that as its own stage,
+// --multilevel assigns clusters on a coarsened graph, see UserInteractionManager::SetMultilevel,
+// --out-of-core assigns them chunk by chunk, see UserInteractionManager::SetOutOfCore,
+// --shards assigns them in N worker processes, see UserInteractionManager::SetShards,
+//     and checks every sharded assignment against the single process labels of the same
+//     seeds, the benchmark fails when they differ,
+// --progressive times steps 3 and 4 as snapshots, see UserInteractionManager::SetProgressive,
+// --weights builds the edge weights with another policy, see ParseWeightParameters,
+// --region-growing assigns clusters by growing regions, see UserInteractionManager::SetRegionGrowing,
+// --seeds spreads the seeds by another mode, see UserInteractionManager::SetSeedMode,
+// --vertex-graph assigns them on the mesh vertices, see UserInteractionManager::SetVertexGraph.
+int RunBenchmarks(int argc, char *argv[]);
\ No newline at end of file
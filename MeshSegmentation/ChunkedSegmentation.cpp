@@ -0,0 +1,263 @@
+#include "ChunkedSegmentation.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+
+#include "FaceOrdering.h"
+#include "MemoryTracker.h"
+#include "PerfCounters.h"
+#include "Utils.h"
+
+using namespace std;
+
+// keys sampled per chunk to place the cuts
+static const int chunkSamples = 256;
+
+GraphChunks::GraphChunks(const DualGraph *graph, int chunkFaces) : key(graph->centers, graph->numberOfFaces) {
+    int numberOfFaces = graph->numberOfFaces;
+    chunkCnt = chunkFaces > 0 ? (numberOfFaces + chunkFaces - 1) / chunkFaces : 1;
+    if (chunkCnt < 1) {
+        chunkCnt = 1;
+    }
+
+    // the cuts are quantiles of a regular sample of the keys
+    int step = numberOfFaces / (chunkCnt * chunkSamples);
+    step = step > 1 ? step : 1;
+    vector<unsigned long long> sample;
+    sample.reserve(numberOfFaces / step + 1);
+    for (int i = 0; i < numberOfFaces; i += step) {
+        sample.push_back(key(graph->Center(i)));
+    }
+    sort(sample.begin(), sample.end());
+    for (int c = 1; c < chunkCnt; ++c) {
+        cuts.push_back(sample[sample.size() * c / chunkCnt]);
+    }
+}
+
+int GraphChunks::ChunkOf(const DualGraph *graph, int faceId) const {
+    return (int) (upper_bound(cuts.begin(), cuts.end(), key(graph->Center(faceId))) - cuts.begin());
+}
+
+void GraphChunks::MarkFaces(const DualGraph *graph, int *marks, vector<int>& sizes) const {
+    sizes.assign(chunkCnt, 0);
+    for (int i = 0; i < graph->numberOfFaces; ++i) {
+        int chunk = ChunkOf(graph, i);
+        marks[i] = Mark(chunk);
+        ++sizes[chunk];
+    }
+}
+
+void GraphChunks::Faces(const DualGraph *graph, int chunk, const int *marks, vector<int>& faces) const {
+    vector< pair<unsigned long long, int> > keys;
+    for (int i = 0; i < graph->numberOfFaces; ++i) {
+        if (marks ? marks[i] == Mark(chunk) : ChunkOf(graph, i) == chunk) {
+            keys.push_back(make_pair(key(graph->Center(i)), i));
+        }
+    }
+    sort(keys.begin(), keys.end());
+    faces.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        faces[i] = keys[i].second;
+    }
+}
+
+DualGraph* GraphChunks::Extract(const DualGraph *graph, const vector<int>& core, int haloRings, vector<int>& globalIds,
+    unordered_map<int, int>& localIds) {
+    globalIds.assign(core.begin(), core.end());
+    localIds.clear();
+    for (size_t i = 0; i < globalIds.size(); ++i) {
+        localIds[globalIds[i]] = (int) i;
+    }
+
+    // breadth first, one ring per round
+    size_t ringBegin = 0;
+    for (int ring = 0; ring < haloRings && ringBegin < globalIds.size(); ++ring) {
+        size_t ringEnd = globalIds.size();
+        for (size_t i = ringBegin; i < ringEnd; ++i) {
+            int u = globalIds[i];
+            for (int k = graph->offsets[u]; k < graph->offsets[u + 1]; ++k) {
+                int v = graph->neighbors[k];
+                if (localIds.insert(make_pair(v, (int) globalIds.size())).second) {
+                    globalIds.push_back(v);
+                }
+            }
+        }
+        ringBegin = ringEnd;
+    }
+
+    return DualGraph::Subgraph(graph, globalIds.empty() ? NULL : &globalIds[0], (int) globalIds.size(), localIds);
+}
+
+// shared border of two clusters and where it stands in the merge order
+struct chunkBorder {
+    double D, L;
+    bool cross;
+    int pass;
+    double cost;
+};
+
+typedef pair< pair<int, double>, pair<int, int> > borderKey;
+
+static int findRoot(int *parents, int x) {
+    while (parents[x] != x) {
+        parents[x] = parents[parents[x]];
+        x = parents[x];
+    }
+    return x;
+}
+
+int ReconcileChunkClusters(const DualGraph *graph, int *labels, int labelCnt, int fixedCnt, const GraphChunks *chunks, int targetCnt) {
+    // one pass over the edges collects D1 and L1 of every pair of clusters and the
+    // border sums of every cluster, the inputs of the merge cost
+    vector< map<int, chunkBorder> > borders(labelCnt);
+    vector<double> sumD(labelCnt, 0.0), sumL(labelCnt, 0.0);
+    PerfCounters::Add(PERF_EDGES_SCANNED, graph->numberOfEdges);
+    for (int edgeId = 0; edgeId < graph->numberOfEdges; ++edgeId) {
+        int u = graph->edges[2 * edgeId], v = graph->edges[2 * edgeId + 1];
+        int a = labels[u], b = labels[v];
+        if (a == b || a < 0 || b < 0) {
+            continue;
+        }
+
+        double len = graph->edgeLens[edgeId];
+        double dis = len * graph->weights[edgeId];
+        bool cross = chunks && chunks->ChunkOf(graph, u) != chunks->ChunkOf(graph, v);
+        for (int side = 0; side < 2; ++side) {
+            chunkBorder& border = borders[a][b];
+            border.D += dis;
+            border.L += len;
+            border.cross = border.cross || cross;
+            sumD[a] += dis;
+            sumL[a] += len;
+            swap(a, b);
+        }
+    }
+
+    set<borderKey> queue;
+    for (int a = 0; a < labelCnt; ++a) {
+        for (map<int, chunkBorder>::iterator it = borders[a].begin(); it != borders[a].end(); ++it) {
+            int b = it->first;
+            chunkBorder& border = it->second;
+            border.pass = a < fixedCnt && b < fixedCnt ? 2 : (border.cross ? 0 : 1);
+            border.cost = MergeCost(border.D, border.L, sumD[a] + sumD[b] - 2 * border.D, sumL[a] + sumL[b] - 2 * border.L);
+            if (a < b) {
+                queue.insert(make_pair(make_pair(border.pass, border.cost), make_pair(a, b)));
+            }
+        }
+    }
+
+    vector<int> parents(labelCnt);
+    int remainCnt = 0;
+    vector<bool> used(labelCnt, false);
+    for (int i = 0; i < (int) graph->numberOfFaces; ++i) {
+        if (labels[i] >= 0) {
+            used[labels[i]] = true;
+        }
+    }
+    for (int i = 0; i < labelCnt; ++i) {
+        parents[i] = i;
+        remainCnt += used[i];
+    }
+
+    while (remainCnt > targetCnt && !queue.empty()) {
+        int a = queue.begin()->second.first, b = queue.begin()->second.second;
+        queue.erase(queue.begin());
+
+        // b goes into a; seeded clusters have the low ids and so survive the others
+        parents[b] = a;
+        --remainCnt;
+        sumD[a] = sumD[a] + sumD[b] - 2 * borders[a][b].D;
+        sumL[a] = sumL[a] + sumL[b] - 2 * borders[a][b].L;
+        borders[a].erase(b);
+        for (map<int, chunkBorder>::iterator it = borders[b].begin(); it != borders[b].end(); ++it) {
+            int c = it->first;
+            if (c == a) {
+                continue;
+            }
+            const chunkBorder& old = it->second;
+            queue.erase(make_pair(make_pair(old.pass, old.cost), make_pair(min(b, c), max(b, c))));
+            borders[c].erase(b);
+
+            chunkBorder& border = borders[a][c];
+            border.D += old.D;
+            border.L += old.L;
+            border.cross = border.cross || old.cross;
+        }
+        borders[b].clear();
+
+        // every border of a changes cost with the new sums
+        for (map<int, chunkBorder>::iterator it = borders[a].begin(); it != borders[a].end(); ++it) {
+            int c = it->first;
+            chunkBorder& border = it->second;
+            queue.erase(make_pair(make_pair(border.pass, border.cost), make_pair(min(a, c), max(a, c))));
+            border.pass = a < fixedCnt && c < fixedCnt ? 2 : (border.cross ? 0 : 1);
+            border.cost = MergeCost(border.D, border.L, sumD[a] + sumD[c] - 2 * border.D, sumL[a] + sumL[c] - 2 * border.L);
+            borders[c][a] = border;
+            queue.insert(make_pair(make_pair(border.pass, border.cost), make_pair(min(a, c), max(a, c))));
+        }
+    }
+
+    // clusters left over once no borders remain lie on separate bodies; the seeded
+    // ones and then the largest keep a label, every other one joins the kept cluster
+    // whose centroid is nearest to its own
+    vector<double> area(labelCnt, 0.0), centroid(3 * labelCnt, 0.0);
+    for (int i = 0; i < (int) graph->numberOfFaces; ++i) {
+        if (labels[i] >= 0) {
+            int root = findRoot(&parents[0], labels[i]);
+            const double *center = graph->Center(i);
+            area[root] += graph->areas[i];
+            for (int j = 0; j < 3; ++j) {
+                centroid[3 * root + j] += graph->areas[i] * center[j];
+            }
+        }
+    }
+    vector< pair< pair<int, double>, int > > roots;
+    for (int i = 0; i < labelCnt; ++i) {
+        if (used[i] && findRoot(&parents[0], i) == i) {
+            for (int j = 0; j < 3 && area[i] > 0; ++j) {
+                centroid[3 * i + j] /= area[i];
+            }
+            roots.push_back(make_pair(make_pair(i < fixedCnt ? 0 : 1, -area[i]), i));
+        }
+    }
+    if ((int) roots.size() > targetCnt && targetCnt > 0) {
+        sort(roots.begin(), roots.end());
+        for (size_t r = targetCnt; r < roots.size(); ++r) {
+            int a = roots[r].second, nearest = roots[0].second;
+            double nearestDis2 = -1;
+            for (int k = 0; k < targetCnt; ++k) {
+                int b = roots[k].second;
+                double dis2 = 0;
+                for (int j = 0; j < 3; ++j) {
+                    double d = centroid[3 * a + j] - centroid[3 * b + j];
+                    dis2 += d * d;
+                }
+                if (nearestDis2 < 0 || dis2 < nearestDis2) {
+                    nearest = b;
+                    nearestDis2 = dis2;
+                }
+            }
+            parents[a] = nearest;
+        }
+        printf("%d clusters without a border joined the nearest cluster\n", (int) roots.size() - targetCnt);
+    }
+
+    // surviving clusters in order
+    vector<int> newIds(labelCnt, -1);
+    int nextId = 0;
+    for (int i = 0; i < labelCnt; ++i) {
+        if (used[i] && findRoot(&parents[0], i) == i) {
+            newIds[i] = nextId++;
+        }
+    }
+    for (int i = 0; i < (int) graph->numberOfFaces; ++i) {
+        if (labels[i] >= 0) {
+            labels[i] = newIds[findRoot(&parents[0], labels[i])];
+        }
+    }
+    return nextId;
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "DualGraph.h"
+#include "FaceOrdering.h"
+
+// Spatial partition of a dual graph for out-of-core segmentation. The Hilbert curve
+// over the face centers is cut at keys sampled from the faces into runs of about
+// chunkFaces, so every chunk is a compact patch of the surface. Only the cuts are kept,
+// the chunk of a face is found from its key, so nothing here grows with the mesh.
+class GraphChunks {
+private:
+    int chunkCnt;
+    HilbertKey key;
+    std::vector<unsigned long long> cuts;   // first key of chunks 1 .. chunkCnt - 1
+
+public:
+    GraphChunks(const DualGraph *graph, int chunkFaces);
+
+    int Count() const { return chunkCnt; }
+    int ChunkOf(const DualGraph *graph, int faceId) const;
+
+    // Marks every face with Mark of its chunk, marks below -1 so they never clash with
+    // labels; sizes receives the faces per chunk. Chunks are listed back from the marks
+    // by Faces, which keeps the caller's label array as the only per-face state.
+    static int Mark(int chunk) { return -2 - chunk; }
+    void MarkFaces(const DualGraph *graph, int *marks, std::vector<int>& sizes) const;
+
+    // faces still marked as chunk, along the curve; without marks the faces of chunk
+    // are found from their keys, in the same order
+    void Faces(const DualGraph *graph, int chunk, const int *marks, std::vector<int>& faces) const;
+
+    // The faces of core plus up to haloRings rings of faces around it as a graph of its
+    // own. globalIds receives the face of graph behind every local face, core coming
+    // first, and localIds the way back.
+    static DualGraph* Extract(const DualGraph *graph, const std::vector<int>& core, int haloRings, std::vector<int>& globalIds,
+        std::unordered_map<int, int>& localIds);
+
+private:
+    GraphChunks(const GraphChunks&);
+    void operator = (const GraphChunks&);
+};
+
+// Merges the clusters of a chunk by chunk segmentation down to targetCnt. labels holds
+// a cluster in [0, labelCnt) or -1 per face; the first fixedCnt clusters are the ones
+// the user seeded, the rest were added by single chunks. Pairs are merged cheapest
+// first by the cost of MergeClusters, clusters of one chunk meeting a neighbor across
+// a chunk border before the rest, and seeded pairs last. chunks may be NULL to merge
+// clusters that did not come from chunks by cost alone. Clusters that share no border
+// with anything, on separate bodies, stay apart while there are at most targetCnt of
+// them, beyond that the smallest join the cluster with the nearest centroid. Labels are
+// renumbered in place to [0, count); returns count, fewer than targetCnt only when
+// there were fewer clusters to begin with.
+int ReconcileChunkClusters(const DualGraph *graph, int *labels, int labelCnt, int fixedCnt, const GraphChunks *chunks, int targetCnt);
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include "ClusterMeshExporter.h"
+
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPoints.h>
+#include <vtkType.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const int writeBufferSize = 1 << 20;
+
+ClusterMeshExporter::ClusterMeshExporter(vtkPolyData *mesh) : convertedPoints(NULL), clusterCnt(0), clusterOffsets(NULL), clusterFaces(NULL) {
+    numberOfFaces = mesh->GetNumberOfCells();
+    numberOfPoints = mesh->GetNumberOfPoints();
+
+    vtkCellArray *polys = mesh->GetPolys();
+    connectivity = polys->GetNumberOfConnectivityEntries() == 4 * (vtkIdType) numberOfFaces ? polys->GetData()->GetPointer(0) : NULL;
+
+    // STL readers produce float points which are used in place, anything else is converted once
+    vtkDataArray *pointData = mesh->GetPoints()->GetData();
+    if (pointData->GetDataType() == VTK_FLOAT) {
+        points = (const float *) pointData->GetVoidPointer(0);
+    } else {
+        convertedPoints = new float[3 * numberOfPoints];
+        for (int i = 0; i < numberOfPoints; ++i) {
+            double p[3];
+            pointData->GetTuple(i, p);
+            convertedPoints[3 * i] = (float) p[0];
+            convertedPoints[3 * i + 1] = (float) p[1];
+            convertedPoints[3 * i + 2] = (float) p[2];
+        }
+        points = convertedPoints;
+    }
+}
+
+ClusterMeshExporter::~ClusterMeshExporter() {
+    delete[] convertedPoints;
+    delete[] clusterOffsets;
+    delete[] clusterFaces;
+}
+
+int ClusterMeshExporter::Export(const int *labels, int clusterCnt, const string& prefix, ExportFormat format) {
+    if (!connectivity) {
+        cout << "Cluster export needs a triangle mesh" << endl;
+        return -1;
+    }
+
+    int threadCnt = thread::hardware_concurrency();
+    threadCnt = threadCnt > 0 ? threadCnt : 4;
+
+    this->clusterCnt = clusterCnt;
+    bucketFaces(labels, threadCnt);
+
+    if (format == EXPORT_MULTI_STL) {
+        string fileName = prefix + ".stl";
+        FILE *fp = fopen(fileName.c_str(), "w");
+        if (!fp) {
+            return -1;
+        }
+        setvbuf(fp, NULL, _IOFBF, writeBufferSize);
+
+        int written = 0;
+        bool ok = true;
+        for (int i = 0; ok && i < clusterCnt; ++i) {
+            if (clusterOffsets[i + 1] > clusterOffsets[i]) {
+                ok = writeASCIISTL(i, fp);
+                ++written;
+            }
+        }
+        ok = (fclose(fp) == 0) && ok;
+        return ok ? written : -1;
+    }
+
+    // clusters are handed out to the workers one at a time
+    atomic<int> nextCluster(0), written(0);
+    atomic<bool> failed(false);
+    vector< future<void> > workers;
+    for (int t = 0; t < threadCnt; ++t) {
+        workers.push_back(async(launch::async, [&]() {
+            int *localIds = NULL, *localStamps = NULL, *vertexList = NULL;
+            if (format == EXPORT_PLY) {
+                localIds = new int[numberOfPoints];
+                localStamps = new int[numberOfPoints];
+                vertexList = new int[numberOfPoints];
+                memset(localStamps, -1, numberOfPoints * sizeof(int));
+            }
+
+            int clusterId;
+            while ((clusterId = nextCluster++) < clusterCnt) {
+                if (clusterOffsets[clusterId + 1] == clusterOffsets[clusterId]) {
+                    continue;
+                }
+
+                char suffix[32];
+                sprintf(suffix, "_%d.%s", clusterId, format == EXPORT_PLY ? "ply" : "stl");
+                bool ok = format == EXPORT_PLY
+                    ? writePLY(clusterId, prefix + suffix, localIds, localStamps, vertexList)
+                    : writeBinarySTL(clusterId, prefix + suffix);
+                if (ok) {
+                    ++written;
+                } else {
+                    failed = true;
+                }
+            }
+
+            delete[] localIds;
+            delete[] localStamps;
+            delete[] vertexList;
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].get();
+    }
+
+    return failed ? -1 : (int) written;
+}
+
+void ClusterMeshExporter::bucketFaces(const int *labels, int threadCnt) {
+    delete[] clusterOffsets;
+    delete[] clusterFaces;
+
+    // per thread histograms over face ranges, then a cluster major prefix sum keeps
+    // the faces of a cluster in their original order
+    vector<int> counts(threadCnt * clusterCnt, 0);
+    int chunk = (numberOfFaces + threadCnt - 1) / threadCnt;
+    vector< future<void> > tasks;
+    for (int t = 0; t < threadCnt; ++t) {
+        tasks.push_back(async(launch::async, [&, t]() {
+            int *localCounts = &counts[t * clusterCnt];
+            int end = (t + 1) * chunk < numberOfFaces ? (t + 1) * chunk : numberOfFaces;
+            for (int i = t * chunk; i < end; ++i) {
+                if (labels[i] >= 0 && labels[i] < clusterCnt) {
+                    ++localCounts[labels[i]];
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < threadCnt; ++t) {
+        tasks[t].get();
+    }
+
+    clusterOffsets = new int[clusterCnt + 1];
+    int sum = 0;
+    for (int c = 0; c < clusterCnt; ++c) {
+        clusterOffsets[c] = sum;
+        for (int t = 0; t < threadCnt; ++t) {
+            int cnt = counts[t * clusterCnt + c];
+            counts[t * clusterCnt + c] = sum;
+            sum += cnt;
+        }
+    }
+    clusterOffsets[clusterCnt] = sum;
+
+    clusterFaces = new int[sum > 0 ? sum : 1];
+    tasks.clear();
+    for (int t = 0; t < threadCnt; ++t) {
+        tasks.push_back(async(launch::async, [&, t]() {
+            int *fill = &counts[t * clusterCnt];
+            int end = (t + 1) * chunk < numberOfFaces ? (t + 1) * chunk : numberOfFaces;
+            for (int i = t * chunk; i < end; ++i) {
+                if (labels[i] >= 0 && labels[i] < clusterCnt) {
+                    clusterFaces[fill[labels[i]]++] = i;
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < threadCnt; ++t) {
+        tasks[t].get();
+    }
+}
+
+static void computeNormal(const float *p0, const float *p1, const float *p2, float *n) {
+    float a[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float b[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    n[0] = a[1] * b[2] - a[2] * b[1];
+    n[1] = a[2] * b[0] - a[0] * b[2];
+    n[2] = a[0] * b[1] - a[1] * b[0];
+    float len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len > 0) {
+        n[0] /= len;
+        n[1] /= len;
+        n[2] /= len;
+    }
+}
+
+bool ClusterMeshExporter::writeBinarySTL(int clusterId, const string& fileName) {
+    FILE *fp = fopen(fileName.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+
+    char header[80];
+    memset(header, 0, sizeof(header));
+    sprintf(header, "cluster %d", clusterId);
+    unsigned int triangleCnt = clusterOffsets[clusterId + 1] - clusterOffsets[clusterId];
+    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 && fwrite(&triangleCnt, 4, 1, fp) == 1;
+
+    // 50 bytes per triangle, batched into one buffer
+    vector<char> buffer(50 * 4096);
+    int used = 0;
+    for (int i = clusterOffsets[clusterId]; ok && i < clusterOffsets[clusterId + 1]; ++i) {
+        const vtkIdType *tri = triangle(clusterFaces[i]);
+        float record[12];
+        computeNormal(point(tri[0]), point(tri[1]), point(tri[2]), record);
+        memcpy(record + 3, point(tri[0]), 3 * sizeof(float));
+        memcpy(record + 6, point(tri[1]), 3 * sizeof(float));
+        memcpy(record + 9, point(tri[2]), 3 * sizeof(float));
+
+        char *dst = &buffer[used];
+        memcpy(dst, record, sizeof(record));
+        dst[48] = dst[49] = 0;
+        used += 50;
+
+        if (used == (int) buffer.size()) {
+            ok = fwrite(&buffer[0], 1, used, fp) == (size_t) used;
+            used = 0;
+        }
+    }
+    ok = ok && (used == 0 || fwrite(&buffer[0], 1, used, fp) == (size_t) used);
+
+    ok = (fclose(fp) == 0) && ok;
+    return ok;
+}
+
+bool ClusterMeshExporter::writePLY(int clusterId, const string& fileName, int *localIds, int *localStamps, int *vertexList) {
+    // stamps avoid clearing the vertex map between clusters
+    int vertexCnt = 0;
+    for (int i = clusterOffsets[clusterId]; i < clusterOffsets[clusterId + 1]; ++i) {
+        const vtkIdType *tri = triangle(clusterFaces[i]);
+        for (int j = 0; j < 3; ++j) {
+            if (localStamps[tri[j]] != clusterId) {
+                localStamps[tri[j]] = clusterId;
+                localIds[tri[j]] = vertexCnt;
+                vertexList[vertexCnt++] = (int) tri[j];
+            }
+        }
+    }
+
+    FILE *fp = fopen(fileName.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    setvbuf(fp, NULL, _IOFBF, writeBufferSize);
+
+    int faceCnt = clusterOffsets[clusterId + 1] - clusterOffsets[clusterId];
+    bool ok = fprintf(fp, "ply\nformat binary_little_endian 1.0\ncomment cluster %d\n"
+        "element vertex %d\nproperty float x\nproperty float y\nproperty float z\n"
+        "element face %d\nproperty list uchar int vertex_indices\nend_header\n", clusterId, vertexCnt, faceCnt) > 0;
+
+    for (int i = 0; ok && i < vertexCnt; ++i) {
+        ok = fwrite(point(vertexList[i]), sizeof(float), 3, fp) == 3;
+    }
+    for (int i = clusterOffsets[clusterId]; ok && i < clusterOffsets[clusterId + 1]; ++i) {
+        const vtkIdType *tri = triangle(clusterFaces[i]);
+        char record[13];
+        int ids[3] = { localIds[tri[0]], localIds[tri[1]], localIds[tri[2]] };
+        record[0] = 3;
+        memcpy(record + 1, ids, sizeof(ids));
+        ok = fwrite(record, sizeof(record), 1, fp) == 1;
+    }
+
+    ok = (fclose(fp) == 0) && ok;
+    return ok;
+}
+
+bool ClusterMeshExporter::writeASCIISTL(int clusterId, FILE *fp) {
+    bool ok = fprintf(fp, "solid cluster_%d\n", clusterId) > 0;
+    for (int i = clusterOffsets[clusterId]; ok && i < clusterOffsets[clusterId + 1]; ++i) {
+        const vtkIdType *tri = triangle(clusterFaces[i]);
+        const float *p0 = point(tri[0]), *p1 = point(tri[1]), *p2 = point(tri[2]);
+        float n[3];
+        computeNormal(p0, p1, p2, n);
+        ok = fprintf(fp, "facet normal %e %e %e\nouter loop\nvertex %e %e %e\nvertex %e %e %e\nvertex %e %e %e\nendloop\nendfacet\n",
+            n[0], n[1], n[2], p0[0], p0[1], p0[2], p1[0], p1[1], p1[2], p2[0], p2[1], p2[2]) > 0;
+    }
+    return ok && fprintf(fp, "endsolid cluster_%d\n", clusterId) > 0;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vtkPolyData.h>
+
+#include <string>
+
+enum ExportFormat { EXPORT_STL, EXPORT_PLY, EXPORT_MULTI_STL };
+
+// Writes the faces of each cluster as its own mesh straight from the label array.
+// Faces are bucketed by cluster in one parallel pass, then every cluster is remapped
+// to local vertex ids and streamed to disk by a worker thread; no intermediate
+// vtkPolyData is built.
+class ClusterMeshExporter {
+private:
+    int numberOfFaces;
+    int numberOfPoints;
+    const vtkIdType *connectivity;
+    const float *points;
+    float *convertedPoints;
+
+    int clusterCnt;
+    int *clusterOffsets;
+    int *clusterFaces;
+
+public:
+    ClusterMeshExporter(vtkPolyData *mesh);
+    ~ClusterMeshExporter();
+
+    // labels holds a cluster id in [0, clusterCnt) per face, faces labeled -1 are skipped.
+    // EXPORT_STL and EXPORT_PLY write <prefix>_<cluster>.stl/.ply, EXPORT_MULTI_STL writes
+    // one <prefix>.stl with a solid per cluster. Returns the number of parts written, -1 on error.
+    int Export(const int *labels, int clusterCnt, const std::string& prefix, ExportFormat format);
+
+private:
+    void bucketFaces(const int *labels, int threadCnt);
+    bool writeBinarySTL(int clusterId, const std::string& fileName);
+    bool writePLY(int clusterId, const std::string& fileName, int *localIds, int *localStamps, int *vertexList);
+    bool writeASCIISTL(int clusterId, FILE *fp);
+
+    inline const float* point(vtkIdType id) { return points + 3 * id; }
+    inline const vtkIdType* triangle(int faceId) { return connectivity + 4 * faceId + 1; }
+
+    ClusterMeshExporter(const ClusterMeshExporter&);
+    void operator = (const ClusterMeshExporter&);
+};
\ No newline at end of file
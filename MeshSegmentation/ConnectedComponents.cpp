@@ -0,0 +1,145 @@
+#include "ConnectedComponents.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "DisjointSet.h"
+#include "MemoryTracker.h"
+#include "PerfCounters.h"
+
+using namespace std;
+
+// edges below which the union pass does not start another thread
+static const int componentEdgesPerThread = 1 << 16;
+
+struct largerShare {
+    const double *shares;
+    largerShare(const double *shares) : shares(shares) {}
+    bool operator () (int a, int b) const {
+        return shares[a] > shares[b] || (shares[a] == shares[b] && a < b);
+    }
+};
+
+GraphComponents::GraphComponents(const DualGraph *graph) {
+    numberOfFaces = graph->numberOfFaces;
+    MemoryTracker::Allocate(MEMORY_ASSIGNMENT, (long long) numberOfFaces * 2 * sizeof(int));
+
+    {
+        ConcurrentDisjointSet sets(numberOfFaces);
+        MemoryTracker::Allocate(MEMORY_ASSIGNMENT, sets.Bytes());
+        int edgeCnt = graph->numberOfEdges;
+        int threadCnt = thread::hardware_concurrency();
+        threadCnt = threadCnt > 0 ? threadCnt : 4;
+        if (threadCnt > edgeCnt / componentEdgesPerThread) {
+            threadCnt = edgeCnt / componentEdgesPerThread > 1 ? edgeCnt / componentEdgesPerThread : 1;
+        }
+        const int *edges = graph->edges;
+        vector< future<void> > tasks;
+        for (int t = 0; t < threadCnt; ++t) {
+            int begin = (int) ((long long) edgeCnt * t / threadCnt), end = (int) ((long long) edgeCnt * (t + 1) / threadCnt);
+            ConcurrentDisjointSet *shared = &sets;
+            tasks.push_back(async(launch::async, [=]() {
+                for (int e = begin; e < end; ++e) {
+                    shared->Union(edges[2 * e], edges[2 * e + 1]);
+                }
+            }));
+        }
+        for (size_t t = 0; t < tasks.size(); ++t) {
+            tasks[t].get();
+        }
+        PerfCounters::Add(PERF_EDGES_SCANNED, edgeCnt);
+
+        // every set ends up rooted at its lowest face, which is seen before the rest
+        componentOf = new int[numberOfFaces];
+        componentCnt = 0;
+        for (int u = 0; u < numberOfFaces; ++u) {
+            int root = sets.FindSet(u);
+            componentOf[u] = root == u ? componentCnt++ : componentOf[root];
+        }
+        MemoryTracker::Release(MEMORY_ASSIGNMENT, sets.Bytes());
+    }
+
+    offsets = new int[componentCnt + 1];
+    areas = new double[componentCnt];
+    memset(offsets, 0, (componentCnt + 1) * sizeof(int));
+    memset(areas, 0, componentCnt * sizeof(double));
+    for (int u = 0; u < numberOfFaces; ++u) {
+        ++offsets[componentOf[u] + 1];
+        areas[componentOf[u]] += graph->areas[u];
+    }
+    for (int c = 0; c < componentCnt; ++c) {
+        offsets[c + 1] += offsets[c];
+    }
+    faces = new int[numberOfFaces];
+    vector<int> fill(offsets, offsets + componentCnt);
+    for (int u = 0; u < numberOfFaces; ++u) {
+        faces[fill[componentOf[u]]++] = u;
+    }
+}
+
+GraphComponents::~GraphComponents() {
+    delete[] faces;
+    delete[] offsets;
+    delete[] componentOf;
+    delete[] areas;
+    MemoryTracker::Release(MEMORY_ASSIGNMENT, (long long) numberOfFaces * 2 * sizeof(int));
+}
+
+void GraphComponents::AllocateSeeds(int seedCnt, int *quotas) const {
+    double totalArea = 0.0;
+    for (int c = 0; c < componentCnt; ++c) {
+        totalArea += areas[c];
+    }
+    // degenerate meshes are split by face count instead
+    vector<double> shares(componentCnt);
+    for (int c = 0; c < componentCnt; ++c) {
+        shares[c] = totalArea > 0 ? areas[c] : (double) Size(c);
+    }
+    double totalShare = totalArea > 0 ? totalArea : (double) numberOfFaces;
+
+    vector<int> order(componentCnt);
+    for (int c = 0; c < componentCnt; ++c) {
+        order[c] = c;
+        quotas[c] = 0;
+    }
+    sort(order.begin(), order.end(), largerShare(&shares[0]));
+    int left = seedCnt;
+    for (int i = 0; i < componentCnt && left > 0; ++i) {
+        quotas[order[i]] = 1;
+        --left;
+    }
+    if (left == 0) {
+        return;
+    }
+
+    // whole parts of the proportional share first, then the largest remainders
+    int rest = left;
+    vector<double> remainders(componentCnt);
+    for (int c = 0; c < componentCnt; ++c) {
+        double ideal = rest * shares[c] / totalShare;
+        int whole = (int) floor(ideal);
+        whole = whole < Size(c) - quotas[c] ? whole : Size(c) - quotas[c];
+        quotas[c] += whole;
+        left -= whole;
+        remainders[c] = ideal - whole;
+    }
+    sort(order.begin(), order.end(), largerShare(&remainders[0]));
+    while (left > 0) {
+        int given = 0;
+        for (int i = 0; i < componentCnt && left > 0; ++i) {
+            if (quotas[order[i]] < Size(order[i])) {
+                ++quotas[order[i]];
+                --left;
+                ++given;
+            }
+        }
+        if (given == 0) {
+            break;
+        }
+    }
+}
\ No newline at end of file
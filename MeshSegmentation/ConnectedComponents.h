@@ -0,0 +1,35 @@
+#pragma once
+
+#include "DualGraph.h"
+
+// Connected components of a dual graph, the separate bodies of an assembly. Components
+// are numbered in the order of their lowest face and list their faces in id order.
+class GraphComponents {
+private:
+    int numberOfFaces;
+    int componentCnt;
+    int *faces;         // the faces component by component, numberOfFaces
+    int *offsets;       // componentCnt + 1
+    int *componentOf;   // numberOfFaces
+    double *areas;      // componentCnt
+
+public:
+    // the edges are united over the hardware threads, see ConcurrentDisjointSet
+    GraphComponents(const DualGraph *graph);
+    ~GraphComponents();
+
+    int Count() const { return componentCnt; }
+    int Size(int component) const { return offsets[component + 1] - offsets[component]; }
+    const int* Faces(int component) const { return faces + offsets[component]; }
+    const int* ComponentOf() const { return componentOf; }
+    double Area(int component) const { return areas[component]; }
+
+    // Splits seedCnt seeds over the components into quotas[Count()]: one for every
+    // component, largest first, while they last, the rest in proportion to area by
+    // largest remainder. No component gets more seeds than it has faces.
+    void AllocateSeeds(int seedCnt, int *quotas) const;
+
+private:
+    GraphComponents(const GraphComponents&);
+    void operator = (const GraphComponents&);
+};
\ No newline at end of file
@@ -1,51 +1,202 @@
 #pragma once
 
+#include <stddef.h>
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+// Union-find over the ids [base, base + len), or over an explicit list of ids when
+// they are spread too thinly for a dense table. Every id starts as a set of its own.
+// Finds halve the path they walk, unions link the smaller set under the larger, so
+// chains stay short without recursion. Not safe to share between threads, even for
+// finds, since they write the parents; see ConcurrentDisjointSet for that.
 class DisjointSet {
 private:
-    int *p;
-    int *rank;
-    int size;
+    std::vector<int> p;         // parent slot of every slot
+    std::vector<int> sizes;     // set size, valid at roots
+    int base;
+    std::vector<int> ids;       // sparse only: the id of every slot
+    std::unordered_map<int, int> slots;
+
+    // lists whose ids span more than this many times their count go sparse
+    static const int maxSpread = 4;
 
 public:
-    DisjointSet() : p(NULL), rank(NULL), size(0) {}
-    DisjointSet(int len) : size(len) {
-        p = new int[size];
-        rank = new int[size];
-        memset(p, 0, size * sizeof(int));
-        memset(rank, 0, size * sizeof(int));
+    DisjointSet() : base(0) {}
+    DisjointSet(int len, int first = 0) : base(0) {
+        init(len, first);
     }
-    ~DisjointSet() {
-        if (p) {
-            delete[] p;
-            delete[] rank;
+
+    // a set over elements[0 .. cnt - 1], dense over their range when it is compact
+    DisjointSet(const int *elements, int cnt) : base(0) {
+        if (cnt == 0) {
+            return;
+        }
+        int lo = elements[0], hi = elements[0];
+        for (int i = 1; i < cnt; ++i) {
+            lo = elements[i] < lo ? elements[i] : lo;
+            hi = elements[i] > hi ? elements[i] : hi;
+        }
+        if ((long long) hi - lo < (long long) maxSpread * cnt) {
+            init(hi - lo + 1, lo);
+            return;
+        }
+        init(cnt, 0);
+        ids.assign(elements, elements + cnt);
+        slots.rehash(cnt);
+        for (int i = 0; i < cnt; ++i) {
+            slots[elements[i]] = i;
         }
     }
 
+    // makes x a set of its own again, only sound while nothing is linked to it
     void MakeSet(int x) {
-        p[x] = x;
-        rank[x] = 0;
+        int s = slot(x);
+        p[s] = s;
+        sizes[s] = 1;
+    }
+
+    // returns false when x and y already were in one set
+    bool Union(int x, int y) {
+        int a = root(slot(x)), b = root(slot(y));
+        if (a == b) {
+            return false;
+        }
+        if (sizes[a] < sizes[b]) {
+            int t = a;
+            a = b;
+            b = t;
+        }
+        p[b] = a;
+        sizes[a] += sizes[b];
+        return true;
+    }
+
+    int FindSet(int x) {
+        return id(root(slot(x)));
+    }
+
+    int SetSize(int x) {
+        return sizes[root(slot(x))];
+    }
+
+    long long Bytes() const {
+        return 2LL * p.size() * sizeof(int) + (long long) ids.size() * (sizeof(int) + 4 * sizeof(void*));
+    }
+
+private:
+    void init(int len, int first) {
+        base = first;
+        p.resize(len);
+        sizes.assign(len, 1);
+        for (int i = 0; i < len; ++i) {
+            p[i] = i;
+        }
+    }
+
+    int slot(int x) const {
+        return ids.empty() ? x - base : slots.find(x)->second;
+    }
+
+    int id(int s) const {
+        return ids.empty() ? s + base : ids[s];
+    }
+
+    int root(int s) {
+        while (p[s] != s) {
+            p[s] = p[p[s]];
+            s = p[s];
+        }
+        return s;
+    }
+
+    DisjointSet(const DisjointSet&);
+    void operator = (const DisjointSet&);
+};
+
+// Union-find over [base, base + len) that any number of threads may find and unite
+// in at once. A union links the root with the higher id under the other by a
+// compare-and-swap on its parent and retries from the new roots when another thread
+// got there first, so roots only ever point to lower ids and no cycle can form.
+// Finds halve their path with compare-and-swaps whose failures are harmless, since
+// a parent only ever moves up its own tree. Once all threads are done every set is
+// rooted at its lowest id, so FindSet gives the same answer however they raced.
+class ConcurrentDisjointSet {
+private:
+    std::atomic<int> *p;
+    int len;
+    int base;
+
+public:
+    ConcurrentDisjointSet(int len, int first = 0) : len(len), base(first) {
+        p = new std::atomic<int>[len];
+        for (int i = 0; i < len; ++i) {
+            p[i].store(i, std::memory_order_relaxed);
+        }
+    }
+    ~ConcurrentDisjointSet() {
+        delete[] p;
     }
 
-    void Union(int x, int y) {
-        link(FindSet(x), FindSet(y));
+    bool Union(int x, int y) {
+        int a = x - base, b = y - base;
+        while (true) {
+            a = root(a);
+            b = root(b);
+            if (a == b) {
+                return false;
+            }
+            if (a < b) {
+                int t = a;
+                a = b;
+                b = t;
+            }
+            int expected = a;
+            if (p[a].compare_exchange_strong(expected, b)) {
+                return true;
+            }
+        }
+    }
+
+    int FindSet(int x) {
+        return root(x - base) + base;
     }
 
-    int FindSet(int x) const {
-        if (x != p[x]) {
-            p[x] = FindSet(p[x]);
+    bool SameSet(int x, int y) {
+        int a = x - base, b = y - base;
+        while (true) {
+            a = root(a);
+            b = root(b);
+            if (a == b) {
+                return true;
+            }
+            // a root that is still a root means the sets were apart at that moment
+            if (p[a].load() == a) {
+                return false;
+            }
         }
-        return p[x];
+    }
+
+    long long Bytes() const {
+        return (long long) len * sizeof(std::atomic<int>);
     }
 
 private:
-    void link(int x, int y) {
-        if (rank[x] > rank[y]) {
-            p[y] = x;
-        } else {
-            p[x] = y;
-            if (rank[x] == rank[y]) {
-                ++rank[y];
+    int root(int s) {
+        while (true) {
+            int parent = p[s].load();
+            if (parent == s) {
+                return s;
+            }
+            int grand = p[parent].load();
+            if (grand != parent) {
+                p[s].compare_exchange_weak(parent, grand);
             }
+            s = grand;
         }
     }
+
+    ConcurrentDisjointSet(const ConcurrentDisjointSet&);
+    void operator = (const ConcurrentDisjointSet&);
 };
\ No newline at end of file
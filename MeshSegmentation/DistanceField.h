@@ -0,0 +1,168 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "DualGraph.h"
+#include "EngineTraits.h"
+#include "IndexedHeap.h"
+#include "PerfCounters.h"
+#include "Progress.h"
+
+// Edge weights in the distance type of the engine. Double weights are used in place,
+// narrower types get a converted copy so the relax loop reads fewer bytes per edge.
+template <class Distance>
+class EdgeWeights {
+private:
+    std::vector<Distance> storage;
+
+public:
+    EdgeWeights(const DualGraph *graph) : storage(graph->weights, graph->weights + graph->numberOfEdges) {}
+    const Distance* Data() const { return storage.empty() ? NULL : &storage[0]; }
+};
+
+template <>
+class EdgeWeights<double> {
+private:
+    const double *data;
+
+public:
+    EdgeWeights(const DualGraph *graph) : data(graph->weights) {}
+    const double* Data() const { return data; }
+};
+
+// peak bytes of one ComputeDistanceField call, the distance table and heap included
+template <class Traits>
+long long DistanceFieldBytes(int numberOfFaces) {
+    return (long long) numberOfFaces * sizeof(typename Traits::Distance) + IndexedHeap<typename Traits::Distance>::Bytes(numberOfFaces, true);
+}
+
+// Dijkstra from source over the dual graph into distances[numberOfFaces]; faces the
+// source cannot reach keep Traits::Infinity(); a cancelled run stops half way. Faces
+// enter the heap when first reached, keyed by distances itself. heap may pass a heap
+// of an earlier call to reuse its storage.
+template <class Traits>
+void ComputeDistanceField(const DualGraph *graph, const typename Traits::Distance *weights, int source, typename Traits::Distance *distances,
+    IndexedHeap<typename Traits::Distance> *heap = NULL) {
+    typedef typename Traits::Distance Distance;
+
+    int numberOfFaces = graph->numberOfFaces;
+    const int *offsets = graph->offsets;
+    const int *neighbors = graph->neighbors;
+    const int *edgeIds = graph->edgeIds;
+
+    for (int j = 0; j < numberOfFaces; ++j) {
+        distances[j] = Traits::Infinity();
+    }
+
+    IndexedHeap<Distance> localHeap;
+    IndexedHeap<Distance>& minHeap = heap ? *heap : localHeap;
+    minHeap.Reserve(numberOfFaces, distances);
+    minHeap.Push(source, 0);
+
+    // counted locally and published once, the loop stays free of atomics
+    long long pushes = 1, pops = 0, scanned = 0, relaxed = 0, decreased = 0;
+    while (!minHeap.Empty()) {
+        // u = EXTRACT_MIN(Q)
+        int u = minHeap.Pop();
+        ++pops;
+        if ((pops & 4095) == 0 && Progress::IsCancelled()) {
+            break;
+        }
+
+        // for each vertex v in u's neighbor, do "relax" operation; faces already
+        // extracted never improve, weights being non-negative
+        scanned += offsets[u + 1] - offsets[u];
+        for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+            int v = neighbors[k];
+            Distance tmp = distances[u] + weights[edgeIds[k]];
+            if (tmp < distances[v]) {
+                if (minHeap.Contains(v)) {
+                    minHeap.DecreaseKey(v, tmp);
+                    ++decreased;
+                } else {
+                    minHeap.Push(v, tmp);
+                    ++pushes;
+                }
+                ++relaxed;
+            }
+        }
+    }
+    minHeap.Reset();
+    PerfCounters::Add(PERF_HEAP_PUSHES, pushes);
+    PerfCounters::Add(PERF_HEAP_POPS, pops);
+    PerfCounters::Add(PERF_EDGES_SCANNED, scanned);
+    PerfCounters::Add(PERF_RELAXATIONS, relaxed);
+    PerfCounters::Add(PERF_DECREASE_KEYS, decreased);
+}
+
+// Multi-source Dijkstra from sources[sourceCnt], labeled sourceLabels: every face
+// reached gets the distance to its nearest source and that source's label, ties going
+// to the lower label, the same as folding one ComputeDistanceField per source. Only
+// the faces reached are written, the caller fills the rest with Traits::Infinity()
+// and Traits::Unassigned(). Keys are distance and label, heap may pass a heap of an
+// earlier call to reuse.
+template <class Traits>
+void ComputeNearestSources(const DualGraph *graph, const typename Traits::Distance *weights, const int *sources, const typename Traits::Label *sourceLabels,
+    int sourceCnt, typename Traits::Distance *distances, typename Traits::Label *labels,
+    IndexedHeap< std::pair<typename Traits::Distance, typename Traits::Label> > *heap = NULL) {
+    typedef typename Traits::Distance Distance;
+    typedef typename Traits::Label Label;
+    typedef std::pair<Distance, Label> Key;
+
+    const int *offsets = graph->offsets;
+    const int *neighbors = graph->neighbors;
+    const int *edgeIds = graph->edgeIds;
+
+    IndexedHeap<Key> localHeap;
+    IndexedHeap<Key>& minHeap = heap ? *heap : localHeap;
+    minHeap.Reserve(graph->numberOfFaces);
+
+    long long pushes = 0, pops = 0, scanned = 0, relaxed = 0, decreased = 0;
+    for (int i = 0; i < sourceCnt; ++i) {
+        int s = sources[i];
+        if (distances[s] > 0 || sourceLabels[i] < labels[s]) {
+            distances[s] = 0;
+            labels[s] = sourceLabels[i];
+            if (minHeap.Contains(s)) {
+                minHeap.Update(s, Key(0, sourceLabels[i]));
+            } else {
+                minHeap.Push(s, Key(0, sourceLabels[i]));
+                ++pushes;
+            }
+        }
+    }
+
+    while (!minHeap.Empty()) {
+        int u = minHeap.Pop();
+        ++pops;
+        if ((pops & 4095) == 0 && Progress::IsCancelled()) {
+            break;
+        }
+
+        scanned += offsets[u + 1] - offsets[u];
+        Label label = labels[u];
+        for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+            int v = neighbors[k];
+            Distance tmp = distances[u] + weights[edgeIds[k]];
+            if (tmp < distances[v] || (tmp == distances[v] && label < labels[v])) {
+                distances[v] = tmp;
+                labels[v] = label;
+                if (minHeap.Contains(v)) {
+                    minHeap.DecreaseKey(v, Key(tmp, label));
+                    ++decreased;
+                } else {
+                    minHeap.Push(v, Key(tmp, label));
+                    ++pushes;
+                }
+                ++relaxed;
+            }
+        }
+    }
+    minHeap.Reset();
+    PerfCounters::Add(PERF_HEAP_PUSHES, pushes);
+    PerfCounters::Add(PERF_HEAP_POPS, pops);
+    PerfCounters::Add(PERF_EDGES_SCANNED, scanned);
+    PerfCounters::Add(PERF_RELAXATIONS, relaxed);
+    PerfCounters::Add(PERF_DECREASE_KEYS, decreased);
+}
\ No newline at end of file
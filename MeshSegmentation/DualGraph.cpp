@@ -0,0 +1,377 @@
+#include "DualGraph.h"
+
+#include <vtkDataSetAttributes.h>
+#include <vtkDoubleArray.h>
+#include <vtkEdgeListIterator.h>
+#include <vtkIdList.h>
+#include <vtkMath.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MemoryTracker.h"
+#include "WeightPolicies.h"
+#include "vtkConvertToDualGraph.h"
+
+DualGraph::DualGraph() : numberOfFaces(0), numberOfEdges(0), offsets(NULL), neighbors(NULL), edgeIds(NULL), edges(NULL),
+    weights(NULL), edgeLens(NULL), centers(NULL), areas(NULL), backingFile(NULL) {}
+
+DualGraph::~DualGraph() {
+    release();
+}
+
+// owned storage only, mapped graphs are backed by the cache file
+static long long storageBytes(int numberOfFaces, int numberOfEdges) {
+    return (numberOfFaces + 1LL) * sizeof(int) + 6LL * numberOfEdges * sizeof(int)
+        + 2LL * numberOfEdges * sizeof(double) + 4LL * numberOfFaces * sizeof(double);
+}
+
+void DualGraph::Allocate(int numberOfFaces, int numberOfEdges) {
+    release();
+    MemoryTracker::Allocate(MEMORY_DUAL_GRAPH, storageBytes(numberOfFaces, numberOfEdges));
+
+    this->numberOfFaces = numberOfFaces;
+    this->numberOfEdges = numberOfEdges;
+    offsets = new int[numberOfFaces + 1];
+    neighbors = new int[2 * numberOfEdges];
+    edgeIds = new int[2 * numberOfEdges];
+    edges = new int[2 * numberOfEdges];
+    weights = new double[numberOfEdges];
+    edgeLens = new double[numberOfEdges];
+    centers = new double[3 * numberOfFaces];
+    areas = new double[numberOfFaces];
+}
+
+void DualGraph::Attach(MappedFile *file, int numberOfFaces, int numberOfEdges) {
+    if (backingFile && backingFile != file) {
+        delete backingFile;
+    }
+    backingFile = file;
+    this->numberOfFaces = numberOfFaces;
+    this->numberOfEdges = numberOfEdges;
+}
+
+DualGraph* DualGraph::FromGraph(vtkGraph *g) {
+    DualGraph *res = new DualGraph;
+    int numberOfFaces = g->GetNumberOfVertices();
+    int numberOfEdges = g->GetNumberOfEdges();
+    res->Allocate(numberOfFaces, numberOfEdges);
+
+    vtkDoubleArray *weights = vtkDoubleArray::SafeDownCast(g->GetEdgeData()->GetArray("Weights"));
+    vtkDoubleArray *edgeLens = vtkDoubleArray::SafeDownCast(g->GetEdgeData()->GetArray("EdgeLens"));
+    vtkDoubleArray *centers = vtkDoubleArray::SafeDownCast(g->GetVertexData()->GetArray("Centers"));
+    vtkDoubleArray *areas = vtkDoubleArray::SafeDownCast(g->GetVertexData()->GetArray("Areas"));
+
+    memcpy(res->weights, weights->GetPointer(0), numberOfEdges * sizeof(double));
+    memcpy(res->edgeLens, edgeLens->GetPointer(0), numberOfEdges * sizeof(double));
+    memcpy(res->centers, centers->GetPointer(0), 3 * numberOfFaces * sizeof(double));
+    memcpy(res->areas, areas->GetPointer(0), numberOfFaces * sizeof(double));
+
+    vtkSmartPointer<vtkEdgeListIterator> edgeIt = vtkSmartPointer<vtkEdgeListIterator>::New();
+    g->GetEdges(edgeIt);
+    while (edgeIt->HasNext()) {
+        vtkEdgeType edge = edgeIt->Next();
+        res->edges[2 * edge.Id] = edge.Source;
+        res->edges[2 * edge.Id + 1] = edge.Target;
+    }
+    res->buildNeighbors();
+
+    return res;
+}
+
+DualGraph* DualGraph::Coarsen(const DualGraph *fine, int *parents) {
+    int fineFaces = fine->numberOfFaces;
+
+    // match faces in id order, each to its closest unmatched neighbor
+    int coarseFaces = 0;
+    for (int i = 0; i < fineFaces; ++i) {
+        parents[i] = -1;
+    }
+    for (int u = 0; u < fineFaces; ++u) {
+        if (parents[u] >= 0) {
+            continue;
+        }
+        int mate = -1;
+        double mateWeight = 0;
+        for (int k = fine->offsets[u]; k < fine->offsets[u + 1]; ++k) {
+            int v = fine->neighbors[k];
+            double w = fine->weights[fine->edgeIds[k]];
+            if (v != u && parents[v] < 0 && (mate < 0 || w < mateWeight)) {
+                mate = v;
+                mateWeight = w;
+            }
+        }
+        parents[u] = coarseFaces;
+        if (mate >= 0) {
+            parents[mate] = coarseFaces;
+        }
+        ++coarseFaces;
+    }
+
+    // members of every coarse face, so its edges can be gathered in one place
+    std::vector<int> memberOffsets(coarseFaces + 1, 0), members(fineFaces);
+    for (int u = 0; u < fineFaces; ++u) {
+        ++memberOffsets[parents[u] + 1];
+    }
+    for (int c = 0; c < coarseFaces; ++c) {
+        memberOffsets[c + 1] += memberOffsets[c];
+    }
+    std::vector<int> fill(memberOffsets.begin(), memberOffsets.end() - 1);
+    for (int u = 0; u < fineFaces; ++u) {
+        members[fill[parents[u]]++] = u;
+    }
+
+    // every fine edge is collected from its lower coarse end; slots[b] is the coarse
+    // edge to b while stamps[b] names the coarse face being gathered
+    std::vector<int> coarseEdges, stamps(coarseFaces, -1), slots(coarseFaces);
+    std::vector<double> lengthSums, densitySums, weightSums;
+    std::vector<int> parallelCnts;
+    for (int a = 0; a < coarseFaces; ++a) {
+        for (int m = memberOffsets[a]; m < memberOffsets[a + 1]; ++m) {
+            int u = members[m];
+            for (int k = fine->offsets[u]; k < fine->offsets[u + 1]; ++k) {
+                int b = parents[fine->neighbors[k]];
+                if (b <= a) {
+                    continue;
+                }
+                int edgeId = fine->edgeIds[k];
+                if (stamps[b] != a) {
+                    stamps[b] = a;
+                    slots[b] = (int) lengthSums.size();
+                    coarseEdges.push_back(a);
+                    coarseEdges.push_back(b);
+                    lengthSums.push_back(0.0);
+                    densitySums.push_back(0.0);
+                    weightSums.push_back(0.0);
+                    parallelCnts.push_back(0);
+                }
+                // weight per unit of center distance, length weighted
+                int slot = slots[b];
+                double span = sqrt(vtkMath::Distance2BetweenPoints(fine->Center(u), fine->Center(fine->neighbors[k])));
+                lengthSums[slot] += fine->edgeLens[edgeId];
+                densitySums[slot] += span > 0 ? fine->edgeLens[edgeId] * fine->weights[edgeId] / span : 0.0;
+                weightSums[slot] += fine->weights[edgeId];
+                ++parallelCnts[slot];
+            }
+        }
+    }
+
+    DualGraph *res = new DualGraph;
+    int coarseEdgeCnt = (int) lengthSums.size();
+    res->Allocate(coarseFaces, coarseEdgeCnt);
+    for (int c = 0; c < coarseFaces; ++c) {
+        double area = 0, center[3] = { 0, 0, 0 };
+        int cnt = memberOffsets[c + 1] - memberOffsets[c];
+        for (int m = memberOffsets[c]; m < memberOffsets[c + 1]; ++m) {
+            area += fine->areas[members[m]];
+        }
+        for (int m = memberOffsets[c]; m < memberOffsets[c + 1]; ++m) {
+            int u = members[m];
+            double weight = area > 0 ? fine->areas[u] / area : 1.0 / cnt;
+            center[0] += weight * fine->centers[3 * u];
+            center[1] += weight * fine->centers[3 * u + 1];
+            center[2] += weight * fine->centers[3 * u + 2];
+        }
+        res->areas[c] = area;
+        memcpy(res->centers + 3 * c, center, sizeof(center));
+    }
+
+    for (int e = 0; e < coarseEdgeCnt; ++e) {
+        int a = coarseEdges[2 * e], b = coarseEdges[2 * e + 1];
+        double span = sqrt(vtkMath::Distance2BetweenPoints(res->Center(a), res->Center(b)));
+        res->edges[2 * e] = a;
+        res->edges[2 * e + 1] = b;
+        res->edgeLens[e] = lengthSums[e];
+        res->weights[e] = span > 0 && densitySums[e] > 0 && lengthSums[e] > 0
+            ? densitySums[e] / lengthSums[e] * span : weightSums[e] / parallelCnts[e];
+    }
+    res->buildNeighbors();
+
+    return res;
+}
+
+DualGraph* DualGraph::FromVertices(vtkPolyData *mesh, const WeightParameters& weights, int *faceVertices) {
+    int numberOfFaces = mesh->GetNumberOfCells();
+    int numberOfVertices = mesh->GetNumberOfPoints();
+    vtkPoints *points = mesh->GetPoints();
+    if (numberOfFaces == 0) {
+        return NULL;
+    }
+
+    // centers and areas of the faces, every face side keyed by its vertices
+    std::vector<double> normals(3 * numberOfFaces), centers(3 * numberOfFaces), areas(numberOfFaces);
+    std::vector< std::pair<long long, int> > sides(3 * (size_t) numberOfFaces);
+    vtkSmartPointer<vtkIdList> corners = vtkSmartPointer<vtkIdList>::New();
+    for (int i = 0; i < numberOfFaces; ++i) {
+        mesh->GetCellPoints(i, corners);
+        if (corners->GetNumberOfIds() != 3) {
+            return NULL;
+        }
+        double p[3][3];
+        for (int j = 0; j < 3; ++j) {
+            faceVertices[3 * i + j] = (int) corners->GetId(j);
+            points->GetPoint(corners->GetId(j), p[j]);
+        }
+        double a[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+        double b[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+        double cross[3];
+        vtkMath::Cross(a, b, cross);
+        areas[i] = vtkMath::Norm(cross) / 2;
+        for (int k = 0; k < 3; ++k) {
+            centers[3 * i + k] = (p[0][k] + p[1][k] + p[2][k]) / 3;
+        }
+        for (int j = 0; j < 3; ++j) {
+            long long s = faceVertices[3 * i + j], t = faceVertices[3 * i + (j + 1) % 3];
+            sides[3 * i + j] = std::make_pair(s < t ? s * numberOfVertices + t : t * numberOfVertices + s, i);
+        }
+    }
+    std::sort(sides.begin(), sides.end());
+    // oriented as the dual graph has them, so both modes see the same angles
+    ComputeFaceNormals(mesh, &normals[0]);
+
+    // the sides of one edge are adjacent now, its first two faces give the terms
+    std::vector<int> edges;
+    std::vector<DualEdgeTerms> terms;
+    edges.reserve(3 * (size_t) numberOfFaces);
+    terms.reserve(3 * (size_t) numberOfFaces / 2);
+    for (size_t i = 0; i < sides.size(); ) {
+        size_t j = i + 1;
+        while (j < sides.size() && sides[j].first == sides[i].first) {
+            ++j;
+        }
+        int s = (int) (sides[i].first / numberOfVertices), t = (int) (sides[i].first % numberOfVertices);
+        double ps[3], pt[3];
+        points->GetPoint(s, ps);
+        points->GetPoint(t, pt);
+        double length = sqrt(vtkMath::Distance2BetweenPoints(ps, pt));
+
+        DualEdgeTerms edgeTerms = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+        if (j - i > 1) {
+            int f = sides[i].second, g = sides[i + 1].second;
+            ComputeEdgeTerms(areas[f], areas[g], &normals[3 * f], &normals[3 * g], &centers[3 * f], &centers[3 * g], length, edgeTerms);
+        }
+        edgeTerms.phy = length;
+        edgeTerms.length = length;
+        edges.push_back(s);
+        edges.push_back(t);
+        terms.push_back(edgeTerms);
+        i = j;
+    }
+
+    int edgeCnt = (int) terms.size();
+    DualGraph *res = new DualGraph;
+    res->Allocate(numberOfVertices, edgeCnt);
+    memcpy(res->edges, &edges[0], 2 * edgeCnt * sizeof(int));
+    ComputeWeights(&terms[0], edgeCnt, AverageTerms(&terms[0], edgeCnt), weights, res->weights);
+    for (int e = 0; e < edgeCnt; ++e) {
+        res->edgeLens[e] = terms[e].length;
+    }
+    for (int v = 0; v < numberOfVertices; ++v) {
+        points->GetPoint(v, res->centers + 3 * v);
+        res->areas[v] = 0.0;
+    }
+    for (int i = 0; i < numberOfFaces; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            res->areas[faceVertices[3 * i + j]] += areas[i] / 3;
+        }
+    }
+    res->buildNeighbors();
+
+    return res;
+}
+
+DualGraph* DualGraph::Subgraph(const DualGraph *graph, const int *faces, int cnt, const std::unordered_map<int, int>& localIds) {
+    // local id of every slot of the listed faces, -1 outside them
+    std::vector<int> slotIds;
+    int edgeCnt = 0;
+    for (int i = 0; i < cnt; ++i) {
+        int u = faces[i];
+        for (int k = graph->offsets[u]; k < graph->offsets[u + 1]; ++k) {
+            std::unordered_map<int, int>::const_iterator it = localIds.find(graph->neighbors[k]);
+            slotIds.push_back(it != localIds.end() ? it->second : -1);
+            edgeCnt += slotIds.back() > i;
+        }
+    }
+
+    DualGraph *res = new DualGraph;
+    res->Allocate(cnt, edgeCnt);
+    int e = 0, slot = 0;
+    for (int i = 0; i < cnt; ++i) {
+        int u = faces[i];
+        memcpy(res->centers + 3 * i, graph->Center(u), 3 * sizeof(double));
+        res->areas[i] = graph->areas[u];
+        for (int k = graph->offsets[u]; k < graph->offsets[u + 1]; ++k) {
+            int j = slotIds[slot++];
+            if (j > i) {
+                res->edges[2 * e] = i;
+                res->edges[2 * e + 1] = j;
+                res->weights[e] = graph->weights[graph->edgeIds[k]];
+                res->edgeLens[e] = graph->edgeLens[graph->edgeIds[k]];
+                ++e;
+            }
+        }
+    }
+    res->buildNeighbors();
+
+    return res;
+}
+
+// count degrees, then scatter both directions of every edge
+void DualGraph::buildNeighbors() {
+    memset(offsets, 0, (numberOfFaces + 1) * sizeof(int));
+    for (int i = 0; i < numberOfEdges; ++i) {
+        ++offsets[edges[2 * i] + 1];
+        ++offsets[edges[2 * i + 1] + 1];
+    }
+    for (int i = 0; i < numberOfFaces; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    int *fill = new int[numberOfFaces];
+    memcpy(fill, offsets, numberOfFaces * sizeof(int));
+    for (int i = 0; i < numberOfEdges; ++i) {
+        int s = edges[2 * i], t = edges[2 * i + 1];
+        neighbors[fill[s]] = t;
+        edgeIds[fill[s]++] = i;
+        neighbors[fill[t]] = s;
+        edgeIds[fill[t]++] = i;
+    }
+    delete[] fill;
+}
+
+void DualGraph::release() {
+    if (backingFile) {
+        delete backingFile;
+        backingFile = NULL;
+    } else {
+        delete[] offsets;
+        delete[] neighbors;
+        delete[] edgeIds;
+        delete[] edges;
+        delete[] weights;
+        delete[] edgeLens;
+        delete[] centers;
+        delete[] areas;
+        if (offsets) {
+            MemoryTracker::Release(MEMORY_DUAL_GRAPH, storageBytes(numberOfFaces, numberOfEdges));
+        }
+    }
+    offsets = NULL;
+    neighbors = NULL;
+    edgeIds = NULL;
+    edges = NULL;
+    weights = NULL;
+    edgeLens = NULL;
+    centers = NULL;
+    areas = NULL;
+    numberOfFaces = 0;
+    numberOfEdges = 0;
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vtkGraph.h>
+
+#include <unordered_map>
+
+class MappedFile;
+class vtkPolyData;
+struct WeightParameters;
+
+// Compressed sparse row form of the dual graph produced by vtkConvertToDualGraph.
+// The neighbors of face i are neighbors[offsets[i]] .. neighbors[offsets[i + 1] - 1],
+// and edgeIds holds the dual edge each of those slots belongs to.
+class DualGraph {
+public:
+    int numberOfFaces;
+    int numberOfEdges;
+
+    int *offsets;       // numberOfFaces + 1
+    int *neighbors;     // 2 * numberOfEdges
+    int *edgeIds;       // 2 * numberOfEdges
+    int *edges;         // source and target of each edge, 2 * numberOfEdges
+    double *weights;    // numberOfEdges
+    double *edgeLens;   // numberOfEdges
+    double *centers;    // 3 * numberOfFaces
+    double *areas;      // numberOfFaces
+
+private:
+    MappedFile *backingFile;
+
+public:
+    DualGraph();
+    ~DualGraph();
+
+    // allocates owned storage for every array
+    void Allocate(int numberOfFaces, int numberOfEdges);
+
+    // arrays already point into the mapped file, which is released with the graph
+    void Attach(MappedFile *file, int numberOfFaces, int numberOfEdges);
+
+    static DualGraph* FromGraph(vtkGraph *g);
+
+    // One level of heavy edge matching: every face is paired with the unmatched
+    // neighbor it is closest to, i.e. across the lightest edge, or stays alone. Areas
+    // add up, centers are area weighted and parallel edges merge with their lengths
+    // summed. A coarse weight is the mean weight per unit of center distance along
+    // the merged edges times the distance of the coarse centers, so shortest paths
+    // keep the scale of the finest level. parents[numberOfFaces] receives the coarse
+    // face of every face.
+    static DualGraph* Coarsen(const DualGraph *fine, int *parents);
+
+    // The primal graph of a triangle mesh: one node per mesh vertex and one edge per
+    // mesh edge, about half the nodes of the dual graph. Edge terms come from the faces
+    // on either side of an edge, with the same normals as in vtkConvertToDualGraph, but
+    // with the length of the edge as the geodesic term, so the weight policy mixes edge
+    // length and dihedral angle; border edges have no angle. A node's center is the
+    // vertex, its area a third of the faces around it. faceVertices[3 * numberOfFaces]
+    // receives the corners of every face. NULL when the mesh is not triangles only.
+    static DualGraph* FromVertices(vtkPolyData *mesh, const WeightParameters& weights, int *faceVertices);
+
+    // The faces faces[0 .. cnt - 1] with the edges among them as a graph of its own,
+    // face i of the result being faces[i]; localIds maps every listed face to that index.
+    static DualGraph* Subgraph(const DualGraph *graph, const int *faces, int cnt, const std::unordered_map<int, int>& localIds);
+
+    int Degree(int faceId) const { return offsets[faceId + 1] - offsets[faceId]; }
+    const double* Center(int faceId) const { return centers + 3 * faceId; }
+
+    // arrays live in a cache file mapping and are paged in on demand
+    bool IsMapped() const { return backingFile != NULL; }
+
+private:
+    void release();
+    void buildNeighbors();
+
+    DualGraph(const DualGraph&);
+    void operator = (const DualGraph&);
+};
\ No newline at end of file
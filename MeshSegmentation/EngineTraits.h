@@ -0,0 +1,33 @@
+#pragma once
+
+#include <limits>
+
+// Numeric types of the segmentation engine. The assignment kernels are templated on
+// these so that every configuration gets its own specialized inner loops; which one
+// the application uses is fixed at compile time by defining MESHSEG_COMPACT_ENGINE.
+// Face ids are 32-bit int in both configurations, as DualGraph stores them.
+template <class DistanceType, class LabelType>
+struct EngineTraits {
+    typedef DistanceType Distance;
+    typedef LabelType Label;
+
+    static Distance Infinity() { return std::numeric_limits<Distance>::max(); }
+
+    // the largest label value marks faces no seed reaches
+    static Label Unassigned() { return std::numeric_limits<Label>::max(); }
+
+    // whether labels can tell labelCnt centers apart from Unassigned
+    static bool Fits(long long labelCnt) { return labelCnt < (long long) Unassigned(); }
+};
+
+// double distances, exact as before
+typedef EngineTraits<double, int> DefaultEngine;
+
+// half sized distance fields and labels, fewer than 65535 clusters
+typedef EngineTraits<float, unsigned short> CompactEngine;
+
+#ifdef MESHSEG_COMPACT_ENGINE
+typedef CompactEngine Engine;
+#else
+typedef DefaultEngine Engine;
+#endif
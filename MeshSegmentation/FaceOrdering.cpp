@@ -0,0 +1,369 @@
+#include "FaceOrdering.h"
+
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkDataArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPoints.h>
+#include <vtkSmartPointer.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// bits per axis of the quantized centroids, three of them fit a 64 bit key
+static const int curveBits = 21;
+
+static const char *orderNames[] = { "none", "morton", "hilbert", "rcm" };
+
+static const vtkIdType* triangles(vtkPolyData *mesh) {
+    vtkCellArray *polys = mesh->GetPolys();
+    int numberOfFaces = mesh->GetNumberOfCells();
+    if (mesh->GetNumberOfPolys() != numberOfFaces || polys->GetNumberOfConnectivityEntries() != 4 * (vtkIdType) numberOfFaces) {
+        return NULL;
+    }
+    return polys->GetData()->GetPointer(0);
+}
+
+// Skilling, "Programming the Hilbert curve": turns the axes into the transposed
+// Hilbert index in place
+static void axesToTranspose(unsigned int *X) {
+    unsigned int M = 1u << (curveBits - 1), P, Q, t;
+    for (Q = M; Q > 1; Q >>= 1) {
+        P = Q - 1;
+        for (int i = 0; i < 3; ++i) {
+            if (X[i] & Q) {
+                X[0] ^= P;
+            } else {
+                t = (X[0] ^ X[i]) & P;
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+
+    X[1] ^= X[0];
+    X[2] ^= X[1];
+    t = 0;
+    for (Q = M; Q > 1; Q >>= 1) {
+        if (X[2] & Q) {
+            t ^= Q - 1;
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        X[i] ^= t;
+    }
+}
+
+static unsigned long long interleave(const unsigned int *X) {
+    unsigned long long key = 0;
+    for (int b = curveBits - 1; b >= 0; --b) {
+        key = (key << 3) | ((X[0] >> b) & 1) << 2 | ((X[1] >> b) & 1) << 1 | ((X[2] >> b) & 1);
+    }
+    return key;
+}
+
+// box around the centers and the scale that fits its longest side to the curve grid,
+// one scale for all axes keeps the curve cells cubic
+template <class Real>
+static void curveBox(const Real *centers, int numberOfFaces, double *lo, double& scale) {
+    double hi[3] = { 0, 0, 0 };
+    lo[0] = lo[1] = lo[2] = 0;
+    for (int i = 0; i < numberOfFaces; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            if (i == 0 || centers[3 * i + k] < lo[k]) {
+                lo[k] = centers[3 * i + k];
+            }
+            if (i == 0 || centers[3 * i + k] > hi[k]) {
+                hi[k] = centers[3 * i + k];
+            }
+        }
+    }
+
+    double extent = max(hi[0] - lo[0], max(hi[1] - lo[1], hi[2] - lo[2]));
+    scale = extent > 0 ? ((1u << curveBits) - 1) / extent : 0;
+}
+
+template <class Real>
+static unsigned long long curveKey(const double *lo, double scale, const Real *point, bool hilbert) {
+    unsigned int X[3];
+    for (int k = 0; k < 3; ++k) {
+        double q = (point[k] - lo[k]) * scale;
+        X[k] = q <= 0 ? 0 : q >= (1u << curveBits) - 1 ? (1u << curveBits) - 1 : (unsigned int) q;
+    }
+    if (hilbert) {
+        axesToTranspose(X);
+    }
+    return interleave(X);
+}
+
+template <class Real>
+static int* sortAlongCurve(const Real *centers, int numberOfFaces, bool hilbert) {
+    double lo[3], scale;
+    curveBox(centers, numberOfFaces, lo, scale);
+
+    vector< pair<unsigned long long, int> > keys(numberOfFaces);
+    for (int i = 0; i < numberOfFaces; ++i) {
+        keys[i] = make_pair(curveKey(lo, scale, centers + 3 * i, hilbert), i);
+    }
+
+    sort(keys.begin(), keys.end());
+
+    int *newToOld = new int[numberOfFaces];
+    for (int i = 0; i < numberOfFaces; ++i) {
+        newToOld[i] = keys[i].second;
+    }
+    return newToOld;
+}
+
+static int* curveOrder(vtkPolyData *mesh, const vtkIdType *connectivity, bool hilbert) {
+    int numberOfFaces = mesh->GetNumberOfCells();
+    vtkPoints *points = mesh->GetPoints();
+
+    float *centers = new float[3 * numberOfFaces];
+    for (int i = 0; i < numberOfFaces; ++i) {
+        const vtkIdType *tri = connectivity + 4 * i + 1;
+        double c[3] = { 0, 0, 0 }, p[3];
+        for (int k = 0; k < 3; ++k) {
+            points->GetPoint(tri[k], p);
+            c[0] += p[0];
+            c[1] += p[1];
+            c[2] += p[2];
+        }
+        for (int k = 0; k < 3; ++k) {
+            centers[3 * i + k] = (float) (c[k] / 3);
+        }
+    }
+
+    int *newToOld = sortAlongCurve(centers, numberOfFaces, hilbert);
+    delete[] centers;
+    return newToOld;
+}
+
+// faces sharing an edge, found through the faces around each point
+static void buildAdjacency(vtkPolyData *mesh, const vtkIdType *connectivity, vector<int>& offsets, vector<int>& adjacent) {
+    int numberOfFaces = mesh->GetNumberOfCells();
+    int numberOfPoints = mesh->GetNumberOfPoints();
+
+    vector<int> pointOffsets(numberOfPoints + 1, 0), pointFaces(3 * numberOfFaces);
+    for (int i = 0; i < numberOfFaces; ++i) {
+        for (int k = 1; k <= 3; ++k) {
+            ++pointOffsets[connectivity[4 * i + k] + 1];
+        }
+    }
+    for (int p = 0; p < numberOfPoints; ++p) {
+        pointOffsets[p + 1] += pointOffsets[p];
+    }
+    vector<int> fill(pointOffsets.begin(), pointOffsets.end() - 1);
+    for (int i = 0; i < numberOfFaces; ++i) {
+        for (int k = 1; k <= 3; ++k) {
+            pointFaces[fill[connectivity[4 * i + k]]++] = i;
+        }
+    }
+
+    // counted first, then filled in the same order
+    offsets.assign(numberOfFaces + 1, 0);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < numberOfFaces; ++i) {
+            const vtkIdType *tri = connectivity + 4 * i + 1;
+            for (int k = 0; k < 3; ++k) {
+                vtkIdType a = tri[k], b = tri[(k + 1) % 3];
+                for (int j = pointOffsets[a]; j < pointOffsets[a + 1]; ++j) {
+                    int other = pointFaces[j];
+                    const vtkIdType *otherTri = connectivity + 4 * other + 1;
+                    if (other != i && (otherTri[0] == b || otherTri[1] == b || otherTri[2] == b)) {
+                        if (pass == 0) {
+                            ++offsets[i + 1];
+                        } else {
+                            adjacent[fill[i]++] = other;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (int i = 0; i < numberOfFaces; ++i) {
+                offsets[i + 1] += offsets[i];
+            }
+            adjacent.resize(offsets[numberOfFaces]);
+            fill.assign(offsets.begin(), offsets.end() - 1);
+        }
+    }
+}
+
+// breadth first search over the faces not placed yet, returns the number of levels
+// and where the last level begins in queue
+static int bfsLevels(const vector<int>& offsets, const vector<int>& adjacent, const vector<bool>& placed, vector<int>& stamps, int stamp,
+        int start, vector<int>& queue, int& lastLevelBegin) {
+    queue.clear();
+    queue.push_back(start);
+    stamps[start] = stamp;
+
+    int levels = 0;
+    size_t levelBegin = 0;
+    while (levelBegin < queue.size()) {
+        size_t levelEnd = queue.size();
+        lastLevelBegin = (int) levelBegin;
+        ++levels;
+        for (size_t q = levelBegin; q < levelEnd; ++q) {
+            int v = queue[q];
+            for (int j = offsets[v]; j < offsets[v + 1]; ++j) {
+                int w = adjacent[j];
+                if (!placed[w] && stamps[w] != stamp) {
+                    stamps[w] = stamp;
+                    queue.push_back(w);
+                }
+            }
+        }
+        levelBegin = levelEnd;
+    }
+    return levels;
+}
+
+class DegreeLess {
+private:
+    const vector<int>& offsets;
+
+public:
+    DegreeLess(const vector<int>& offsets) : offsets(offsets) {}
+
+    bool operator() (int a, int b) const {
+        int degreeA = offsets[a + 1] - offsets[a], degreeB = offsets[b + 1] - offsets[b];
+        return degreeA < degreeB || (degreeA == degreeB && a < b);
+    }
+
+private:
+    void operator = (const DegreeLess&);
+};
+
+static int* rcmOrder(vtkPolyData *mesh, const vtkIdType *connectivity) {
+    int numberOfFaces = mesh->GetNumberOfCells();
+    vector<int> offsets, adjacent;
+    buildAdjacency(mesh, connectivity, offsets, adjacent);
+
+    int *order = new int[numberOfFaces];
+    vector<bool> placed(numberOfFaces, false);
+    vector<int> stamps(numberOfFaces, 0), queue, candidates;
+    int stamp = 0, placedCnt = 0;
+    DegreeLess degreeLess(offsets);
+
+    for (int first = 0; first < numberOfFaces; ++first) {
+        if (placed[first]) {
+            continue;
+        }
+
+        // George-Liu pseudo-peripheral root: restart from the thinnest face of the
+        // last level while that makes the level structure deeper
+        int root = first, lastLevelBegin;
+        int depth = bfsLevels(offsets, adjacent, placed, stamps, ++stamp, root, queue, lastLevelBegin);
+        for (int iter = 0; iter < 8; ++iter) {
+            int candidate = *min_element(queue.begin() + lastLevelBegin, queue.end(), degreeLess);
+            int candidateDepth = bfsLevels(offsets, adjacent, placed, stamps, ++stamp, candidate, queue, lastLevelBegin);
+            if (candidateDepth <= depth) {
+                break;
+            }
+            root = candidate;
+            depth = candidateDepth;
+        }
+
+        // Cuthill-McKee, neighbors by increasing degree; order doubles as the queue
+        int head = placedCnt;
+        order[placedCnt++] = root;
+        placed[root] = true;
+        while (head < placedCnt) {
+            int v = order[head++];
+            candidates.clear();
+            for (int j = offsets[v]; j < offsets[v + 1]; ++j) {
+                if (!placed[adjacent[j]]) {
+                    placed[adjacent[j]] = true;
+                    candidates.push_back(adjacent[j]);
+                }
+            }
+            sort(candidates.begin(), candidates.end(), degreeLess);
+            for (size_t j = 0; j < candidates.size(); ++j) {
+                order[placedCnt++] = candidates[j];
+            }
+        }
+    }
+
+    reverse(order, order + numberOfFaces);
+    return order;
+}
+
+int* FaceOrdering::Compute(vtkPolyData *mesh, FaceOrder order) {
+    const vtkIdType *connectivity = triangles(mesh);
+    if (order == FACE_ORDER_NONE || !connectivity) {
+        return NULL;
+    }
+
+    if (order == FACE_ORDER_RCM) {
+        return rcmOrder(mesh, connectivity);
+    }
+    return curveOrder(mesh, connectivity, order == FACE_ORDER_HILBERT);
+}
+
+int* FaceOrdering::ComputeFromCenters(const double *centers, int numberOfFaces, FaceOrder order) {
+    if (order != FACE_ORDER_MORTON && order != FACE_ORDER_HILBERT) {
+        return NULL;
+    }
+    return sortAlongCurve(centers, numberOfFaces, order == FACE_ORDER_HILBERT);
+}
+
+HilbertKey::HilbertKey(const double *centers, int numberOfFaces) {
+    curveBox(centers, numberOfFaces, lo, scale);
+}
+
+unsigned long long HilbertKey::operator () (const double *point) const {
+    return curveKey(lo, scale, point, true);
+}
+
+void FaceOrdering::Apply(vtkPolyData *mesh, const int *newToOld) {
+    int numberOfFaces = mesh->GetNumberOfCells();
+    const vtkIdType *connectivity = triangles(mesh);
+
+    vtkSmartPointer<vtkIdTypeArray> cells = vtkSmartPointer<vtkIdTypeArray>::New();
+    cells->SetNumberOfValues(4 * (vtkIdType) numberOfFaces);
+    vtkIdType *dst = cells->GetPointer(0);
+    for (int i = 0; i < numberOfFaces; ++i) {
+        memcpy(dst + 4 * i, connectivity + 4 * newToOld[i], 4 * sizeof(vtkIdType));
+    }
+    mesh->GetPolys()->SetCells(numberOfFaces, cells);
+    // the cell links are stale now, they are rebuilt on the next random access
+    mesh->DeleteCells();
+
+    // in place, whoever holds an array keeps a valid one
+    vtkCellData *cellData = mesh->GetCellData();
+    for (int a = 0; a < cellData->GetNumberOfArrays(); ++a) {
+        vtkDataArray *array = cellData->GetArray(a);
+        if (!array || array->GetNumberOfTuples() != numberOfFaces) {
+            continue;
+        }
+        vtkSmartPointer<vtkDataArray> copy;
+        copy.TakeReference(array->NewInstance());
+        copy->DeepCopy(array);
+        for (int i = 0; i < numberOfFaces; ++i) {
+            array->SetTuple(i, newToOld[i], copy);
+        }
+        array->Modified();
+    }
+    mesh->Modified();
+}
+
+bool FaceOrdering::Parse(const char *name, FaceOrder& order) {
+    for (int i = 0; i <= FACE_ORDER_RCM; ++i) {
+        if (strcmp(name, orderNames[i]) == 0) {
+            order = (FaceOrder) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* FaceOrdering::Name(FaceOrder order) {
+    return orderNames[order];
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vtkPolyData.h>
+
+enum FaceOrder { FACE_ORDER_NONE, FACE_ORDER_MORTON, FACE_ORDER_HILBERT, FACE_ORDER_RCM };
+
+// Renumbers the faces of a triangle mesh so that faces close on the surface are close
+// in memory, which is what the graph traversals of the engine walk along. Morton and
+// Hilbert sort the face centroids along a space filling curve, RCM runs reverse
+// Cuthill-McKee on the face adjacency and keeps the graph bandwidth low.
+class FaceOrdering {
+public:
+    // newToOld[i] is the current id of the face that becomes face i, delete[] by the
+    // caller; NULL for FACE_ORDER_NONE or meshes that are not triangles only
+    static int* Compute(vtkPolyData *mesh, FaceOrder order);
+
+    // the same for face centers given as x, y, z triples; curve orders only
+    static int* ComputeFromCenters(const double *centers, int numberOfFaces, FaceOrder order);
+
+    // permutes the polys and every cell data array of mesh in place
+    static void Apply(vtkPolyData *mesh, const int *newToOld);
+
+    // "none", "morton", "hilbert" or "rcm"
+    static bool Parse(const char *name, FaceOrder& order);
+    static const char* Name(FaceOrder order);
+};
+
+// Position of a point along the Hilbert curve through the box around centers, the key
+// FACE_ORDER_HILBERT sorts the faces by
+class HilbertKey {
+private:
+    double lo[3];
+    double scale;
+
+public:
+    HilbertKey() : scale(0) { lo[0] = lo[1] = lo[2] = 0; }
+    HilbertKey(const double *centers, int numberOfFaces);
+
+    unsigned long long operator () (const double *point) const;
+};
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "IncrementalUpdate.h"
+
+#include <vtkMath.h>
+#include <vtkPoints.h>
+#include <vtkTriangle.h>
+
+#include <math.h>
+#include <stdio.h>
+
+#include "vtkConvertToDualGraph.h"
+
+using namespace std;
+
+// edges sampled to recover the weight normalization
+static const int calibrationEdges = 4096;
+
+DualGraphPatcher::DualGraphPatcher(vtkPolyData *mesh, DualGraph *graph, const WeightParameters& weights)
+    : mesh(mesh), graph(graph), weights(weights), calibrated(false) {
+    DualEdgeTerms ones = { 1.0, 1.0, 1.0, 1.0, 1.0 };
+    averages = ones;
+    idsI = vtkSmartPointer<vtkIdList>::New();
+    idsJ = vtkSmartPointer<vtkIdList>::New();
+
+    int numberOfFaces = mesh->GetNumberOfCells();
+    flipped.assign(numberOfFaces, 0);
+    if (numberOfFaces > 0) {
+        vector<double> normals(3 * (size_t) numberOfFaces);
+        ComputeFaceNormals(mesh, &normals[0]);
+        vtkPoints *points = mesh->GetPoints();
+        for (int i = 0; i < numberOfFaces; ++i) {
+            mesh->GetCellPoints(i, idsI);
+            if (idsI->GetNumberOfIds() != 3) {
+                continue;
+            }
+            double p[3][3], n[3];
+            for (int a = 0; a < 3; ++a) {
+                points->GetPoint(idsI->GetId(a), p[a]);
+            }
+            vtkTriangle::ComputeNormal(p[0], p[1], p[2], n);
+            flipped[i] = vtkMath::Dot(n, &normals[3 * i]) < 0;
+        }
+    }
+}
+
+// the terms of a dual edge as vtkConvertToDualGraph computes them
+bool DualGraphPatcher::edgeTerms(int edgeId, DualEdgeTerms& terms) {
+    int i = graph->edges[2 * edgeId], j = graph->edges[2 * edgeId + 1];
+    mesh->GetCellPoints(i, idsI);
+    mesh->GetCellPoints(j, idsJ);
+    if (idsI->GetNumberOfIds() != 3 || idsJ->GetNumberOfIds() != 3) {
+        return false;
+    }
+
+    vtkPoints *points = mesh->GetPoints();
+    double p[3][3], q[3][3], shared[2][3];
+    int sharedCnt = 0;
+    for (int a = 0; a < 3; ++a) {
+        points->GetPoint(idsI->GetId(a), p[a]);
+        points->GetPoint(idsJ->GetId(a), q[a]);
+    }
+    for (int a = 0; a < 3; ++a) {
+        for (int b = 0; b < 3 && sharedCnt < 2; ++b) {
+            if (idsI->GetId(a) == idsJ->GetId(b)) {
+                points->GetPoint(idsI->GetId(a), shared[sharedCnt++]);
+                break;
+            }
+        }
+    }
+    if (sharedCnt < 2) {
+        return false;
+    }
+
+    double n0[3], n1[3];
+    vtkTriangle::ComputeNormal(p[0], p[1], p[2], n0);
+    vtkTriangle::ComputeNormal(q[0], q[1], q[2], n1);
+    for (int k = 0; k < 3; ++k) {
+        n0[k] = flipped[i] ? -n0[k] : n0[k];
+        n1[k] = flipped[j] ? -n1[k] : n1[k];
+    }
+    ComputeEdgeTerms(graph->areas[i], graph->areas[j], n0, n1, graph->Center(i), graph->Center(j),
+        sqrt(vtkMath::Distance2BetweenPoints(shared[0], shared[1])), terms);
+    return true;
+}
+
+// Mixed weights are delta * phy / phy mean + (1 - delta) * angle / angle mean; a least
+// squares fit over untouched edges gives both means back. Should the sample not pin
+// them down, e.g. on a flat mesh without any angular term, or the weights come from
+// another policy, the means over the current mesh are taken as a fresh build would.
+void DualGraphPatcher::calibrate(const unordered_set<int>& changedEdges) {
+    calibrated = true;
+    if (weights.policy == WEIGHT_MIXED) {
+        if (fitMixedAverages(changedEdges)) {
+            return;
+        }
+        printf("weight normalization taken from the edited mesh\n");
+    }
+
+    vector<DualEdgeTerms> terms;
+    terms.reserve(graph->numberOfEdges);
+    for (int e = 0; e < graph->numberOfEdges; ++e) {
+        DualEdgeTerms t;
+        if (edgeTerms(e, t)) {
+            terms.push_back(t);
+        }
+    }
+    if (!terms.empty()) {
+        averages = AverageTerms(&terms[0], (int) terms.size());
+    }
+}
+
+// false if the sample does not pin the means down
+bool DualGraphPatcher::fitMixedAverages(const unordered_set<int>& changedEdges) {
+    double delta = weights.delta;
+    int stride = graph->numberOfEdges / calibrationEdges + 1;
+    double saa = 0, sab = 0, sbb = 0, saw = 0, sbw = 0;
+    for (int e = 0; e < graph->numberOfEdges; e += stride) {
+        DualEdgeTerms t;
+        if (changedEdges.count(e) || !edgeTerms(e, t)) {
+            continue;
+        }
+        double a = delta * t.phy, b = (1 - delta) * t.angle, w = graph->weights[e];
+        saa += a * a;
+        sab += a * b;
+        sbb += b * b;
+        saw += a * w;
+        sbw += b * w;
+    }
+
+    double det = saa * sbb - sab * sab;
+    if (det > 1e-9 * saa * sbb) {
+        double x = (saw * sbb - sbw * sab) / det, y = (sbw * saa - saw * sab) / det;
+        if (x > 0 && y > 0) {
+            averages.phy = 1 / x;
+            averages.angle = 1 / y;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DualGraphPatcher::Patch(const int *faceIds, int cnt, vector<int>& edgeIds, vector<double>& oldWeights, vector<double>& oldLens) {
+    edgeIds.clear();
+    unordered_set<int> changedEdges;
+    for (int i = 0; i < cnt; ++i) {
+        int face = faceIds[i];
+        for (int k = graph->offsets[face]; k < graph->offsets[face + 1]; ++k) {
+            if (changedEdges.insert(graph->edgeIds[k]).second) {
+                edgeIds.push_back(graph->edgeIds[k]);
+            }
+        }
+    }
+    if (!calibrated) {
+        calibrate(changedEdges);
+    }
+
+    vtkPoints *points = mesh->GetPoints();
+    for (int i = 0; i < cnt; ++i) {
+        int face = faceIds[i];
+        mesh->GetCellPoints(face, idsI);
+        if (idsI->GetNumberOfIds() != 3) {
+            continue;
+        }
+        double p0[3], p1[3], p2[3];
+        points->GetPoint(idsI->GetId(0), p0);
+        points->GetPoint(idsI->GetId(1), p1);
+        points->GetPoint(idsI->GetId(2), p2);
+        graph->areas[face] = vtkTriangle::TriangleArea(p0, p1, p2);
+        for (int k = 0; k < 3; ++k) {
+            graph->centers[3 * face + k] = (p0[k] + p1[k] + p2[k]) / 3;
+        }
+    }
+
+    oldWeights.resize(edgeIds.size());
+    oldLens.resize(edgeIds.size());
+    for (size_t i = 0; i < edgeIds.size(); ++i) {
+        int e = edgeIds[i];
+        oldWeights[i] = graph->weights[e];
+        oldLens[i] = graph->edgeLens[e];
+        DualEdgeTerms t;
+        if (edgeTerms(e, t)) {
+            graph->weights[e] = EdgeWeight(t, averages, weights);
+            graph->edgeLens[e] = t.length;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <vtkIdList.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "DualGraph.h"
+#include "EngineTraits.h"
+#include "PerfCounters.h"
+#include "WeightPolicies.h"
+
+// Brings a dual graph up to date after the points of some faces moved, with faces and
+// connectivity unchanged: centers and areas of those faces and the weights and lengths
+// of the dual edges around them are recomputed in place with the policy the graph was
+// built with. Weights are normalized by the mean terms of the whole mesh; for the mixed
+// policy these are recovered once from edges the edit did not touch and then kept, so
+// no other edge changes, other policies take the means over the mesh as it is. Face
+// normals are oriented as ComputeFaceNormals does it, which only depends on how the
+// faces connect, so the faces it flips are found once and stay flipped.
+class DualGraphPatcher {
+private:
+    vtkPolyData *mesh;
+    DualGraph *graph;
+    WeightParameters weights;
+    DualEdgeTerms averages;
+    bool calibrated;
+    vtkSmartPointer<vtkIdList> idsI, idsJ;
+    std::vector<char> flipped;  // faces ComputeFaceNormals turns against their winding
+
+public:
+    DualGraphPatcher(vtkPolyData *mesh, DualGraph *graph, const WeightParameters& weights);
+
+    // edgeIds receives the dual edges around faceIds, oldWeights and oldLens their
+    // weights and lengths before the patch
+    void Patch(const int *faceIds, int cnt, std::vector<int>& edgeIds, std::vector<double>& oldWeights, std::vector<double>& oldLens);
+
+private:
+    bool edgeTerms(int edgeId, DualEdgeTerms& terms);
+    void calibrate(const std::unordered_set<int>& changedEdges);
+    bool fitMixedAverages(const std::unordered_set<int>& changedEdges);
+
+    DualGraphPatcher(const DualGraphPatcher&);
+    void operator = (const DualGraphPatcher&);
+};
+
+// Multi-source Dijkstra frontier ordered by distance, then label, over the engine's
+// distance table and an int label per face; -1 compares above every label. The first
+// label a face had before an offer changed it is kept in oldLabels.
+template <class Traits>
+class nearestFrontier {
+private:
+    typedef typename Traits::Distance Distance;
+    typedef std::pair< std::pair<Distance, unsigned>, int > QueueElem;
+
+    Distance *distances;
+    int *labels;
+    std::unordered_map<int, int>& oldLabels;
+    std::priority_queue< QueueElem, std::vector<QueueElem>, std::greater<QueueElem> > queue;
+
+public:
+    long long pushes, pops;
+
+    nearestFrontier(Distance *distances, int *labels, std::unordered_map<int, int>& oldLabels)
+        : distances(distances), labels(labels), oldLabels(oldLabels), pushes(0), pops(0) {}
+
+    bool Offer(int face, Distance d, int label) {
+        if (d < distances[face] || (d == distances[face] && (unsigned) label < (unsigned) labels[face])) {
+            oldLabels.insert(std::make_pair(face, labels[face]));
+            distances[face] = d;
+            labels[face] = label;
+            queue.push(std::make_pair(std::make_pair(d, (unsigned) label), face));
+            ++pushes;
+            return true;
+        }
+        return false;
+    }
+
+    // next face whose entry is still current, false once the frontier is empty
+    bool Pop(int& face) {
+        while (!queue.empty()) {
+            QueueElem top = queue.top();
+            queue.pop();
+            ++pops;
+            if (top.first.first == distances[top.second] && top.first.second == (unsigned) labels[top.second]) {
+                face = top.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    nearestFrontier(const nearestFrontier&);
+    void operator = (const nearestFrontier&);
+};
+
+// Re-decides the nearest center after the weights of edgeIds changed, oldWeights being
+// what they were. Faces whose shortest path ran over one of them, i.e. those reached
+// along tight edges of the same label, are cleared and filled again by a multi-source
+// Dijkstra from the faces around them and from both ends of every changed edge, so
+// weights that went down spread as far as they improve something. Ties go to the lower
+// label as in the full assignment. relabeled receives every face whose label changed
+// together with its old label; labels are -1 where no center reaches.
+template <class Traits>
+void RepairNearest(const DualGraph *graph, const std::vector<int>& edgeIds, const std::vector<double>& oldWeights, const int *centerIds, int centerCnt,
+    typename Traits::Distance *distances, int *labels, std::vector< std::pair<int, int> >& relabeled) {
+    typedef typename Traits::Distance Distance;
+
+    const int *offsets = graph->offsets;
+    const int *neighbors = graph->neighbors;
+    const int *slotEdges = graph->edgeIds;
+    const int *edges = graph->edges;
+    const double *weights = graph->weights;
+
+    std::unordered_map<int, double> previous;
+    for (size_t i = 0; i < edgeIds.size(); ++i) {
+        previous[edgeIds[i]] = oldWeights[i];
+    }
+    std::unordered_set<int> centers(centerIds, centerIds + centerCnt);
+
+    // faces whose distance came over a changed edge, and all they passed it on to
+    std::vector<int> cleared;
+    std::unordered_set<int> isCleared;
+    for (size_t i = 0; i < edgeIds.size(); ++i) {
+        int e = edgeIds[i];
+        Distance w = (Distance) oldWeights[i];
+        for (int side = 0; side < 2; ++side) {
+            int x = edges[2 * e + side], y = edges[2 * e + 1 - side];
+            if (labels[x] >= 0 && labels[y] == labels[x] && distances[y] == distances[x] + w && !centers.count(y) && isCleared.insert(y).second) {
+                cleared.push_back(y);
+            }
+        }
+    }
+    long long scanned = 0;
+    for (size_t i = 0; i < cleared.size(); ++i) {
+        int x = cleared[i];
+        scanned += offsets[x + 1] - offsets[x];
+        for (int k = offsets[x]; k < offsets[x + 1]; ++k) {
+            int y = neighbors[k];
+            std::unordered_map<int, double>::const_iterator it = previous.find(slotEdges[k]);
+            Distance w = (Distance) (it != previous.end() ? it->second : weights[slotEdges[k]]);
+            if (labels[y] == labels[x] && distances[y] == distances[x] + w && !centers.count(y) && isCleared.insert(y).second) {
+                cleared.push_back(y);
+            }
+        }
+    }
+
+    std::unordered_map<int, int> oldLabels;
+    for (size_t i = 0; i < cleared.size(); ++i) {
+        oldLabels[cleared[i]] = labels[cleared[i]];
+        distances[cleared[i]] = Traits::Infinity();
+        labels[cleared[i]] = -1;
+    }
+
+    nearestFrontier<Traits> frontier(distances, labels, oldLabels);
+    for (size_t i = 0; i < cleared.size(); ++i) {
+        int x = cleared[i];
+        for (int k = offsets[x]; k < offsets[x + 1]; ++k) {
+            int y = neighbors[k];
+            if (labels[y] >= 0) {
+                frontier.Offer(x, distances[y] + (Distance) weights[slotEdges[k]], labels[y]);
+            }
+        }
+    }
+    for (size_t i = 0; i < edgeIds.size(); ++i) {
+        int e = edgeIds[i];
+        for (int side = 0; side < 2; ++side) {
+            int x = edges[2 * e + side], y = edges[2 * e + 1 - side];
+            if (labels[x] >= 0) {
+                frontier.Offer(y, distances[x] + (Distance) weights[e], labels[x]);
+            }
+        }
+    }
+
+    long long relaxed = 0;
+    int u;
+    while (frontier.Pop(u)) {
+        scanned += offsets[u + 1] - offsets[u];
+        for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+            relaxed += frontier.Offer(neighbors[k], distances[u] + (Distance) weights[slotEdges[k]], labels[u]);
+        }
+    }
+    PerfCounters::Add(PERF_HEAP_PUSHES, frontier.pushes);
+    PerfCounters::Add(PERF_HEAP_POPS, frontier.pops);
+    PerfCounters::Add(PERF_EDGES_SCANNED, scanned);
+    PerfCounters::Add(PERF_RELAXATIONS, relaxed);
+
+    relabeled.clear();
+    for (std::unordered_map<int, int>::iterator it = oldLabels.begin(); it != oldLabels.end(); ++it) {
+        if (labels[it->first] != it->second) {
+            relabeled.push_back(*it);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+// Min-heap over the ids [0, capacity) with a position table, so a queued id can have
+// its key lowered, raised or be removed in place instead of being queued again. Each
+// node has Arity children; 4 keeps sift-downs shallow and the children of a node on
+// one cache line. Only ids move in the heap, keys are stored by id, either in an array
+// of the heap's own or in one the caller owns, such as the distance table of a
+// Dijkstra. Ties go to the lower id. Reset empties the heap in O(size) and keeps all
+// storage, so one heap can serve many runs.
+template <class Key, int Arity = 4>
+class IndexedHeap {
+private:
+    std::vector<int> heap;
+    std::vector<int> pos;       // slot of every id in heap, -1 when not queued
+    std::vector<Key> ownKeys;
+    Key *keys;
+    int size;
+
+public:
+    IndexedHeap(int capacity = 0, Key *externalKeys = NULL) : keys(NULL), size(0) {
+        Reserve(capacity, externalKeys);
+    }
+
+    // Empties the heap and makes room for the ids below capacity, keyed by
+    // externalKeys[capacity] or by keys the heap keeps itself when that is NULL
+    void Reserve(int capacity, Key *externalKeys = NULL) {
+        Reset();
+        if ((int) pos.size() < capacity) {
+            pos.resize(capacity, -1);
+            heap.resize(capacity);
+        }
+        if (externalKeys) {
+            keys = externalKeys;
+        } else {
+            if ((int) ownKeys.size() < capacity) {
+                ownKeys.resize(capacity);
+            }
+            keys = ownKeys.empty() ? NULL : &ownKeys[0];
+        }
+    }
+
+    void Reset() {
+        for (int i = 0; i < size; ++i) {
+            pos[heap[i]] = -1;
+        }
+        size = 0;
+    }
+
+    // bytes a heap over capacity ids holds
+    static long long Bytes(int capacity, bool externalKeys) {
+        return (long long) capacity * (2 * sizeof(int) + (externalKeys ? 0 : sizeof(Key)));
+    }
+
+    bool Empty() const { return size == 0; }
+    int Size() const { return size; }
+    bool Contains(int id) const { return pos[id] >= 0; }
+    const Key& KeyOf(int id) const { return keys[id]; }
+    int Top() const { return heap[0]; }
+    const Key& TopKey() const { return keys[heap[0]]; }
+
+    void Push(int id, const Key& key) {
+        keys[id] = key;
+        heap[size] = id;
+        pos[id] = size++;
+        siftUp(pos[id]);
+    }
+
+    // key must not be above the current one
+    void DecreaseKey(int id, const Key& key) {
+        keys[id] = key;
+        siftUp(pos[id]);
+    }
+
+    // a queued id gets a new key either way
+    void Update(int id, const Key& key) {
+        keys[id] = key;
+        siftUp(pos[id]);
+        siftDown(pos[id]);
+    }
+
+    int Pop() {
+        int top = heap[0];
+        pos[top] = -1;
+        if (--size > 0) {
+            heap[0] = heap[size];
+            pos[heap[0]] = 0;
+            siftDown(0);
+        }
+        return top;
+    }
+
+    void Remove(int id) {
+        int i = pos[id];
+        pos[id] = -1;
+        if (--size > i) {
+            int moved = heap[size];
+            heap[i] = moved;
+            pos[moved] = i;
+            siftUp(i);
+            siftDown(pos[moved]);
+        }
+    }
+
+private:
+    bool less(int a, int b) const {
+        return keys[a] < keys[b] || (!(keys[b] < keys[a]) && a < b);
+    }
+
+    void siftUp(int i) {
+        int id = heap[i];
+        while (i > 0) {
+            int p = (i - 1) / Arity;
+            if (!less(id, heap[p])) {
+                break;
+            }
+            heap[i] = heap[p];
+            pos[heap[i]] = i;
+            i = p;
+        }
+        heap[i] = id;
+        pos[id] = i;
+    }
+
+    void siftDown(int i) {
+        int id = heap[i];
+        while (true) {
+            int first = i * Arity + 1;
+            if (first >= size) {
+                break;
+            }
+            int last = first + Arity < size ? first + Arity : size;
+            int best = first;
+            for (int c = first + 1; c < last; ++c) {
+                if (less(heap[c], heap[best])) {
+                    best = c;
+                }
+            }
+            if (!less(heap[best], id)) {
+                break;
+            }
+            heap[i] = heap[best];
+            pos[heap[i]] = i;
+            i = best;
+        }
+        heap[i] = id;
+        pos[id] = i;
+    }
+
+    IndexedHeap(const IndexedHeap&);
+    void operator = (const IndexedHeap&);
+};
\ No newline at end of file
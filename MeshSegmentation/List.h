@@ -1,49 +1,95 @@
 #pragma once
 
-template <class listElem>
-class ListNode {
-public:
-    listElem key;
-    ListNode *next;
+#include <stddef.h>
 
-public:
-    ListNode() : next(NULL) {}
-    ListNode(const listElem& elem) : key(elem), next(NULL) {}
-    ~ListNode() {
-        if (next) {
-            delete next;
-        }
-    }
-};
+#include <vector>
 
+// Append-only sequence kept in chunks that double in size up to maxChunkSize, so n
+// elements cost O(log n) allocations and nothing is allocated or freed per element.
+// Iteration runs contiguously within a chunk; clear keeps the chunks for reuse and
+// the destructor frees them all at once, without walking the elements.
 template <class listElem>
 class List {
 private:
-    ListNode<listElem> *root, *tail;
+    static const int firstChunkSize = 16;
+    static const int maxChunkSize = 1 << 20;
+
+    std::vector<listElem*> chunks;
     int size;
+    int tailChunk;  // chunk the next element goes to
+    int tailUsed;   // elements in it
 
 public:
-    typedef ListNode<listElem>* iterator;
+    class iterator {
+    private:
+        const List *list;
+        int chunk;
+        listElem *elem, *chunkEnd;
+
+    public:
+        iterator(const List *list, int chunk) : list(list), chunk(chunk), elem(NULL), chunkEnd(NULL) { enter(); }
+
+        listElem& operator * () const { return *elem; }
+        listElem* operator -> () const { return elem; }
+        bool operator == (const iterator& other) const { return elem == other.elem; }
+        bool operator != (const iterator& other) const { return elem != other.elem; }
+
+        iterator& operator ++ () {
+            if (++elem == chunkEnd) {
+                ++chunk;
+                enter();
+            }
+            return *this;
+        }
+
+    private:
+        void enter() {
+            int used = chunk <= list->tailChunk ? list->chunkUsed(chunk) : 0;
+            elem = used > 0 ? list->chunks[chunk] : NULL;
+            chunkEnd = used > 0 ? elem + used : NULL;
+        }
+    };
 
 public:
-    List() : size(0) {
-        root = new ListNode<listElem>();
-        tail = root;
-    }
+    List() : size(0), tailChunk(0), tailUsed(0) {}
 
     ~List() {
-        delete root;
-        root = NULL;
-        tail = NULL;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            delete[] chunks[i];
+        }
     }
 
     void push_back(const listElem& elem) {
-        ListNode<listElem> *tmp = new ListNode<listElem>(elem);
-        tail->next = tmp;
-        tail = tmp;
+        if (tailChunk < (int) chunks.size() && tailUsed == chunkCapacity(tailChunk)) {
+            ++tailChunk;
+            tailUsed = 0;
+        }
+        if (tailChunk == (int) chunks.size()) {
+            chunks.push_back(new listElem[chunkCapacity(tailChunk)]);
+        }
+        chunks[tailChunk][tailUsed++] = elem;
         ++size;
     }
 
+    void clear() {
+        size = 0;
+        tailChunk = 0;
+        tailUsed = 0;
+    }
+
     int Size() { return size; }
-    iterator begin() { return root->next; }
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, (int) chunks.size()); }
+
+private:
+    static int chunkCapacity(int chunk) {
+        return chunk < 16 && (firstChunkSize << chunk) < maxChunkSize ? firstChunkSize << chunk : maxChunkSize;
+    }
+
+    int chunkUsed(int chunk) const {
+        return chunk < tailChunk ? chunkCapacity(chunk) : tailUsed;
+    }
+
+    List(const List&);
+    void operator = (const List&);
 };
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+
+// Copy-on-write memory mapping of a whole file. Writes through Data() stay
+// private to the process and never reach the file on disk.
+class MappedFile {
+private:
+    char *data;
+    size_t size;
+#ifdef _WIN32
+    void *fileHandle;
+    void *mappingHandle;
+#else
+    int fd;
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const std::string& fileName);
+    void Close();
+
+    char* Data() { return data; }
+    size_t Size() { return size; }
+
+private:
+    MappedFile(const MappedFile&);
+    void operator = (const MappedFile&);
+};
\ No newline at end of file
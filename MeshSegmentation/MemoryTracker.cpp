@@ -0,0 +1,119 @@
+#include "MemoryTracker.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+using namespace std;
+
+static atomic<long long> currentBytes[MEMORY_STAGE_COUNT + 1];
+static atomic<long long> peakBytes[MEMORY_STAGE_COUNT + 1];
+
+static const char *stageNames[MEMORY_STAGE_COUNT] = {
+    "dual graph", "distance fields", "assignment", "merge", "division"
+};
+
+static void raisePeak(int slot, long long value) {
+    long long peak = peakBytes[slot];
+    while (value > peak && !peakBytes[slot].compare_exchange_weak(peak, value)) {
+    }
+}
+
+void MemoryTracker::Allocate(MemoryStage stage, long long bytes) {
+    raisePeak(stage, currentBytes[stage] += bytes);
+    raisePeak(MEMORY_STAGE_COUNT, currentBytes[MEMORY_STAGE_COUNT] += bytes);
+}
+
+void MemoryTracker::Release(MemoryStage stage, long long bytes) {
+    currentBytes[stage] -= bytes;
+    currentBytes[MEMORY_STAGE_COUNT] -= bytes;
+}
+
+long long MemoryTracker::Current(MemoryStage stage) {
+    return currentBytes[stage];
+}
+
+long long MemoryTracker::Peak(MemoryStage stage) {
+    return peakBytes[stage];
+}
+
+long long MemoryTracker::CurrentTotal() {
+    return currentBytes[MEMORY_STAGE_COUNT];
+}
+
+long long MemoryTracker::PeakTotal() {
+    return peakBytes[MEMORY_STAGE_COUNT];
+}
+
+void MemoryTracker::ResetPeaks() {
+    for (int i = 0; i <= MEMORY_STAGE_COUNT; ++i) {
+        peakBytes[i] = (long long) currentBytes[i];
+    }
+}
+
+#ifdef __linux__
+// reads a "Key:   123 kB" line of /proc/self/status
+static long long readStatusField(const char *key) {
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (!fp) {
+        return 0;
+    }
+
+    char line[256];
+    long long kb = 0;
+    size_t keyLen = strlen(key);
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, key, keyLen) == 0 && line[keyLen] == ':') {
+            sscanf(line + keyLen + 1, "%lld", &kb);
+            break;
+        }
+    }
+    fclose(fp);
+    return kb * 1024;
+}
+#endif
+
+long long MemoryTracker::ResidentBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? (long long) counters.WorkingSetSize : 0;
+#elif defined(__linux__)
+    return readStatusField("VmRSS");
+#else
+    return 0;
+#endif
+}
+
+long long MemoryTracker::PeakResidentBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? (long long) counters.PeakWorkingSetSize : 0;
+#elif defined(__linux__)
+    return readStatusField("VmHWM");
+#else
+    return 0;
+#endif
+}
+
+const char* MemoryTracker::Name(MemoryStage stage) {
+    return stageNames[stage];
+}
+
+void MemoryTracker::Print() {
+    const double mb = 1024.0 * 1024.0;
+    for (int i = 0; i < MEMORY_STAGE_COUNT; ++i) {
+        printf("  %-16s current %9.1lf MB\tpeak %9.1lf MB\n", stageNames[i], currentBytes[i] / mb, peakBytes[i] / mb);
+    }
+    printf("  %-16s current %9.1lf MB\tpeak %9.1lf MB\n", "tracked total", currentBytes[MEMORY_STAGE_COUNT] / mb, peakBytes[MEMORY_STAGE_COUNT] / mb);
+    printf("  %-16s current %9.1lf MB\tpeak %9.1lf MB\n", "process resident", ResidentBytes() / mb, PeakResidentBytes() / mb);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+enum MemoryStage { MEMORY_DUAL_GRAPH, MEMORY_DISTANCES, MEMORY_ASSIGNMENT, MEMORY_MERGE, MEMORY_DIVISION, MEMORY_STAGE_COUNT };
+
+// Byte accounting for the large buffers of the engine, grouped by the stage that owns
+// them. Only the big arrays report here; vtk objects and small bookkeeping do not, so
+// the process resident size is reported next to it for the full picture.
+class MemoryTracker {
+public:
+    static void Allocate(MemoryStage stage, long long bytes);
+    static void Release(MemoryStage stage, long long bytes);
+
+    static long long Current(MemoryStage stage);
+    static long long Peak(MemoryStage stage);
+    static long long CurrentTotal();
+    static long long PeakTotal();
+    static void ResetPeaks();
+
+    // as reported by the OS, 0 when unknown
+    static long long ResidentBytes();
+    static long long PeakResidentBytes();
+
+    static const char* Name(MemoryStage stage);
+    static void Print();
+};
\ No newline at end of file
@@ -0,0 +1,230 @@
+#include "MeshGenerators.h"
+
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkMath.h>
+#include <vtkPoints.h>
+
+#include <math.h>
+
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+static vtkSmartPointer<vtkPolyData> buildPolyData(const vector<float>& coords, const vector<int>& triangles) {
+    vtkSmartPointer<vtkFloatArray> pointData = vtkSmartPointer<vtkFloatArray>::New();
+    pointData->SetNumberOfComponents(3);
+    pointData->SetNumberOfTuples(coords.size() / 3);
+    float *dst = pointData->GetPointer(0);
+    for (size_t i = 0; i < coords.size(); ++i) {
+        dst[i] = coords[i];
+    }
+
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetData(pointData);
+
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+        vtkIdType tri[3] = { triangles[i], triangles[i + 1], triangles[i + 2] };
+        polys->InsertNextCell(3, tri);
+    }
+
+    vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+    mesh->SetPoints(points);
+    mesh->SetPolys(polys);
+    return mesh;
+}
+
+// triangulates a grid that wraps around in both directions
+static void periodicGridTriangles(int nu, int nv, vector<int>& triangles) {
+    triangles.reserve(6 * nu * nv);
+    for (int i = 0; i < nu; ++i) {
+        for (int j = 0; j < nv; ++j) {
+            int a = i * nv + j;
+            int b = ((i + 1) % nu) * nv + j;
+            int c = ((i + 1) % nu) * nv + (j + 1) % nv;
+            int d = i * nv + (j + 1) % nv;
+            triangles.push_back(a);
+            triangles.push_back(b);
+            triangles.push_back(c);
+            triangles.push_back(a);
+            triangles.push_back(c);
+            triangles.push_back(d);
+        }
+    }
+}
+
+static void gridSize(int targetFaces, double aspect, int& nu, int& nv) {
+    nv = (int) floor(sqrt(targetFaces / (2.0 * aspect)) + 0.5);
+    nv = nv < 3 ? 3 : nv;
+    nu = (int) floor(targetFaces / (2.0 * nv) + 0.5);
+    nu = nu < 3 ? 3 : nu;
+}
+
+vtkSmartPointer<vtkPolyData> GenerateIcosphere(int targetFaces) {
+    int level = 0;
+    while (20.0 * pow(4.0, level + 0.5) < targetFaces) {
+        ++level;
+    }
+
+    const float t = 1.618034f;
+    float base[12][3] = {
+        { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+        { 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+        { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+    };
+    int faces[20][3] = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+    };
+
+    vector<float> coords;
+    vector<int> triangles;
+    for (int i = 0; i < 12; ++i) {
+        float len = sqrt(base[i][0] * base[i][0] + base[i][1] * base[i][1] + base[i][2] * base[i][2]);
+        coords.push_back(base[i][0] / len);
+        coords.push_back(base[i][1] / len);
+        coords.push_back(base[i][2] / len);
+    }
+    for (int i = 0; i < 20; ++i) {
+        triangles.push_back(faces[i][0]);
+        triangles.push_back(faces[i][1]);
+        triangles.push_back(faces[i][2]);
+    }
+
+    for (int l = 0; l < level; ++l) {
+        unordered_map<long long, int> midpoints;
+        vector<int> next;
+        next.reserve(4 * triangles.size());
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            int v[3] = { triangles[i], triangles[i + 1], triangles[i + 2] };
+            int m[3];
+            for (int j = 0; j < 3; ++j) {
+                int a = v[j], b = v[(j + 1) % 3];
+                long long edgeKey = a < b ? (long long) a << 32 | b : (long long) b << 32 | a;
+                unordered_map<long long, int>::iterator it = midpoints.find(edgeKey);
+                if (it != midpoints.end()) {
+                    m[j] = it->second;
+                    continue;
+                }
+
+                float p[3] = { coords[3 * a] + coords[3 * b], coords[3 * a + 1] + coords[3 * b + 1], coords[3 * a + 2] + coords[3 * b + 2] };
+                float len = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+                m[j] = (int) coords.size() / 3;
+                coords.push_back(p[0] / len);
+                coords.push_back(p[1] / len);
+                coords.push_back(p[2] / len);
+                midpoints[edgeKey] = m[j];
+            }
+
+            int sub[12] = { v[0], m[0], m[2], v[1], m[1], m[0], v[2], m[2], m[1], m[0], m[1], m[2] };
+            next.insert(next.end(), sub, sub + 12);
+        }
+        triangles.swap(next);
+    }
+
+    return buildPolyData(coords, triangles);
+}
+
+vtkSmartPointer<vtkPolyData> GenerateTorus(int targetFaces) {
+    const double R = 1.0, r = 0.35;
+    int nu, nv;
+    gridSize(targetFaces, R / r, nu, nv);
+
+    vector<float> coords(3 * nu * nv);
+    for (int i = 0; i < nu; ++i) {
+        double u = 2 * vtkMath::Pi() * i / nu;
+        for (int j = 0; j < nv; ++j) {
+            double v = 2 * vtkMath::Pi() * j / nv;
+            float *p = &coords[3 * (i * nv + j)];
+            p[0] = (float) ((R + r * cos(v)) * cos(u));
+            p[1] = (float) ((R + r * cos(v)) * sin(u));
+            p[2] = (float) (r * sin(v));
+        }
+    }
+
+    vector<int> triangles;
+    periodicGridTriangles(nu, nv, triangles);
+    return buildPolyData(coords, triangles);
+}
+
+vtkSmartPointer<vtkPolyData> GenerateAssembly(int targetFaces) {
+    const double R = 1.0, r = 0.35, spacing = 3.0;
+    const double scales[3] = { 0.25, 0.5, 1.0 };
+    double totalArea = 0;
+    for (int b = 0; b < 27; ++b) {
+        totalArea += scales[b % 3] * scales[b % 3];
+    }
+
+    vector<float> coords;
+    vector<int> triangles;
+    for (int b = 0; b < 27; ++b) {
+        double scale = scales[b % 3];
+        double origin[3] = { spacing * (b % 3), spacing * (b / 3 % 3), spacing * (b / 9) };
+        int nu, nv;
+        gridSize((int) (targetFaces * scale * scale / totalArea), R / r, nu, nv);
+
+        int first = (int) coords.size() / 3;
+        for (int i = 0; i < nu; ++i) {
+            double u = 2 * vtkMath::Pi() * i / nu;
+            for (int j = 0; j < nv; ++j) {
+                double v = 2 * vtkMath::Pi() * j / nv;
+                coords.push_back((float) (origin[0] + scale * (R + r * cos(v)) * cos(u)));
+                coords.push_back((float) (origin[1] + scale * (R + r * cos(v)) * sin(u)));
+                coords.push_back((float) (origin[2] + scale * r * sin(v)));
+            }
+        }
+        vector<int> body;
+        periodicGridTriangles(nu, nv, body);
+        for (size_t i = 0; i < body.size(); ++i) {
+            triangles.push_back(first + body[i]);
+        }
+    }
+    return buildPolyData(coords, triangles);
+}
+
+static void superellipse(double t, double exponent, double& x, double& y) {
+    double c = cos(t), s = sin(t);
+    x = (c < 0 ? -1 : 1) * pow(fabs(c), 2.0 / exponent);
+    y = (s < 0 ? -1 : 1) * pow(fabs(s), 2.0 / exponent);
+}
+
+vtkSmartPointer<vtkPolyData> GenerateNoisyPart(int targetFaces, unsigned int seed) {
+    const double pathSize = 2.0, profileSize = 0.5, exponent = 10.0, noise = 2e-3;
+    int nu, nv;
+    gridSize(targetFaces, pathSize / profileSize, nu, nv);
+
+    unsigned long long state = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    vector<float> coords(3 * nu * nv);
+    for (int i = 0; i < nu; ++i) {
+        double px, py;
+        superellipse(2 * vtkMath::Pi() * i / nu, exponent, px, py);
+        px *= pathSize;
+        py *= pathSize;
+        double len = sqrt(px * px + py * py);
+        double dx = px / len, dy = py / len;
+
+        for (int j = 0; j < nv; ++j) {
+            double qx, qz;
+            superellipse(2 * vtkMath::Pi() * j / nv, exponent, qx, qz);
+
+            double jitter[3];
+            for (int k = 0; k < 3; ++k) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                jitter[k] = ((state >> 11) * (1.0 / 9007199254740992.0) - 0.5) * 2 * noise;
+            }
+
+            float *p = &coords[3 * (i * nv + j)];
+            p[0] = (float) (px + profileSize * qx * dx + jitter[0]);
+            p[1] = (float) (py + profileSize * qx * dy + jitter[1]);
+            p[2] = (float) (profileSize * qz + jitter[2]);
+        }
+    }
+
+    vector<int> triangles;
+    periodicGridTriangles(nu, nv, triangles);
+    return buildPolyData(coords, triangles);
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// Deterministic synthetic triangle meshes for benchmarking. Each generator picks
+// its resolution so the face count lands close to targetFaces; points are float
+// like the ones vtkSTLReader produces.
+
+// recursively subdivided icosahedron, 20 * 4^n faces
+vtkSmartPointer<vtkPolyData> GenerateIcosphere(int targetFaces);
+
+// torus on a periodic grid, 2 * nu * nv faces
+vtkSmartPointer<vtkPolyData> GenerateTorus(int targetFaces);
+
+// rounded-square profile swept along a rounded-square path: flat panels joined by
+// tight fillets, with seeded per-vertex noise standing in for scanner error
+vtkSmartPointer<vtkPolyData> GenerateNoisyPart(int targetFaces, unsigned int seed);
+
+// assembly of 27 separate tori of three sizes on a lattice, the small ones with a
+// few hundred faces each; the face counts follow the areas
+vtkSmartPointer<vtkPolyData> GenerateAssembly(int targetFaces);
\ No newline at end of file
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+
+#include "DualGraph.h"
+#include "EngineTraits.h"
+#include "IndexedHeap.h"
+#include "MemoryTracker.h"
+#include "PerfCounters.h"
+
+// Coarser and coarser versions of a dual graph, built by repeated heavy edge matching
+// until a level has at most targetFaces faces or matching stops shrinking the graph.
+// Level 0 is the graph passed in and is not owned.
+class MultilevelHierarchy {
+private:
+    std::vector<const DualGraph*> graphs;
+    std::vector<int*> parents;
+
+public:
+    MultilevelHierarchy(const DualGraph *fine, int targetFaces) {
+        graphs.push_back(fine);
+        while (graphs.back()->numberOfFaces > targetFaces) {
+            const DualGraph *level = graphs.back();
+            int *levelParents = new int[level->numberOfFaces];
+            MemoryTracker::Allocate(MEMORY_DUAL_GRAPH, (long long) level->numberOfFaces * sizeof(int));
+            DualGraph *coarse = DualGraph::Coarsen(level, levelParents);
+            graphs.push_back(coarse);
+            parents.push_back(levelParents);
+
+            // mostly isolated faces left, another level would not pay off
+            if (coarse->numberOfFaces > 0.9 * level->numberOfFaces) {
+                break;
+            }
+        }
+    }
+
+    ~MultilevelHierarchy() {
+        for (size_t i = 0; i < parents.size(); ++i) {
+            MemoryTracker::Release(MEMORY_DUAL_GRAPH, (long long) graphs[i]->numberOfFaces * sizeof(int));
+            delete[] parents[i];
+            delete graphs[i + 1];
+        }
+    }
+
+    int Levels() const { return (int) graphs.size(); }
+    const DualGraph* Graph(int level) const { return graphs[level]; }
+
+    // node of level + 1 each node of level was merged into
+    const int* Parents(int level) const { return parents[level]; }
+
+    // the node of level that contains face faceId of level 0
+    int Ancestor(int faceId, int level) const {
+        for (int i = 0; i < level; ++i) {
+            faceId = parents[i][faceId];
+        }
+        return faceId;
+    }
+
+private:
+    MultilevelHierarchy(const MultilevelHierarchy&);
+    void operator = (const MultilevelHierarchy&);
+};
+
+// Re-decides the nearest center of the faces within rings steps of a cluster border.
+// Labels and distances come projected from the coarser level and are trusted away
+// from borders; the band is cleared and filled by a multi-source Dijkstra from the
+// faces around it, so every band face takes the label of its nearest source. Center
+// faces stay fixed at distance 0.
+template <class Traits>
+void RefineBoundary(const DualGraph *graph, const typename Traits::Distance *weights, const int *centerIds, int centerCnt, int rings,
+    typename Traits::Distance *distances, typename Traits::Label *labels) {
+    typedef typename Traits::Distance Distance;
+
+    int numberOfFaces = graph->numberOfFaces;
+    const int *offsets = graph->offsets;
+    const int *neighbors = graph->neighbors;
+    const int *edgeIds = graph->edgeIds;
+
+    // band marks hold the ring a face joined in, 0 outside the band
+    std::vector<unsigned char> band(numberOfFaces, 0);
+    MemoryTracker::Allocate(MEMORY_ASSIGNMENT, numberOfFaces);
+    std::vector<int> frontier, next;
+    for (int u = 0; u < numberOfFaces; ++u) {
+        for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+            if (labels[neighbors[k]] != labels[u]) {
+                band[u] = 1;
+                frontier.push_back(u);
+                break;
+            }
+        }
+    }
+    long long scanned = 2LL * graph->numberOfEdges;
+    for (int ring = 2; ring <= rings; ++ring) {
+        next.clear();
+        for (size_t i = 0; i < frontier.size(); ++i) {
+            int u = frontier[i];
+            scanned += offsets[u + 1] - offsets[u];
+            for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+                int v = neighbors[k];
+                if (!band[v]) {
+                    band[v] = (unsigned char) ring;
+                    next.push_back(v);
+                }
+            }
+        }
+        frontier.swap(next);
+    }
+
+    for (int i = 0; i < centerCnt; ++i) {
+        band[centerIds[i]] = 0;
+        distances[centerIds[i]] = 0;
+        labels[centerIds[i]] = (typename Traits::Label) i;
+    }
+
+    // sources are the faces outside the band that touch it, keyed by distances in place
+    IndexedHeap<Distance> queue(numberOfFaces, distances);
+    long long heapBytes = IndexedHeap<Distance>::Bytes(numberOfFaces, true);
+    MemoryTracker::Allocate(MEMORY_ASSIGNMENT, heapBytes);
+    for (int u = 0; u < numberOfFaces; ++u) {
+        if (band[u]) {
+            distances[u] = Traits::Infinity();
+            labels[u] = Traits::Unassigned();
+            continue;
+        }
+        for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+            if (band[neighbors[k]] && distances[u] < Traits::Infinity()) {
+                queue.Push(u, distances[u]);
+                break;
+            }
+        }
+    }
+
+    long long pushes = queue.Size(), pops = 0, relaxed = 0, decreased = 0;
+    while (!queue.Empty()) {
+        int u = queue.Pop();
+        ++pops;
+
+        scanned += offsets[u + 1] - offsets[u];
+        for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+            int v = neighbors[k];
+            if (!band[v]) {
+                continue;
+            }
+            Distance tmp = distances[u] + weights[edgeIds[k]];
+            if (tmp < distances[v]) {
+                labels[v] = labels[u];
+                if (queue.Contains(v)) {
+                    queue.DecreaseKey(v, tmp);
+                    ++decreased;
+                } else {
+                    queue.Push(v, tmp);
+                    ++pushes;
+                }
+                ++relaxed;
+            }
+        }
+    }
+    MemoryTracker::Release(MEMORY_ASSIGNMENT, numberOfFaces + heapBytes);
+
+    PerfCounters::Add(PERF_EDGES_SCANNED, scanned);
+    PerfCounters::Add(PERF_RELAXATIONS, relaxed);
+    PerfCounters::Add(PERF_HEAP_PUSHES, pushes);
+    PerfCounters::Add(PERF_HEAP_POPS, pops);
+    PerfCounters::Add(PERF_DECREASE_KEYS, decreased);
+}
\ No newline at end of file
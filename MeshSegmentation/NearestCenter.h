@@ -0,0 +1,180 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "EngineTraits.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESHSEG_SSE2
+#include <emmintrin.h>
+#endif
+
+// faces per block of the face-major layout; a center's run of lanes fills whole cache lines
+const int nearestLanes = 16;
+
+// Argmin over the centers of one block. best holds the distance to beat per lane and
+// index the winning slot as a Distance, left untouched where no slot is strictly
+// closer, so slots seen in label order keep the lowest label on ties.
+template <class Distance>
+struct ArgminLanes {
+    static void Run(const Distance *block, int cnt, Distance *best, Distance *index) {
+        for (int c = 0; c < cnt; ++c) {
+            const Distance *lane = block + c * nearestLanes;
+            for (int l = 0; l < nearestLanes; ++l) {
+                bool less = lane[l] < best[l];
+                best[l] = less ? lane[l] : best[l];
+                index[l] = less ? (Distance) c : index[l];
+            }
+        }
+    }
+};
+
+#ifdef MESHSEG_SSE2
+template <>
+struct ArgminLanes<float> {
+    static void Run(const float *block, int cnt, float *best, float *index) {
+        __m128 b[4], i[4];
+        for (int r = 0; r < 4; ++r) {
+            b[r] = _mm_loadu_ps(best + 4 * r);
+            i[r] = _mm_loadu_ps(index + 4 * r);
+        }
+        for (int c = 0; c < cnt; ++c) {
+            const float *lane = block + c * nearestLanes;
+            __m128 slot = _mm_set1_ps((float) c);
+            for (int r = 0; r < 4; ++r) {
+                __m128 d = _mm_load_ps(lane + 4 * r);
+                __m128 less = _mm_cmplt_ps(d, b[r]);
+                b[r] = _mm_min_ps(d, b[r]);
+                i[r] = _mm_or_ps(_mm_and_ps(less, slot), _mm_andnot_ps(less, i[r]));
+            }
+        }
+        for (int r = 0; r < 4; ++r) {
+            _mm_storeu_ps(best + 4 * r, b[r]);
+            _mm_storeu_ps(index + 4 * r, i[r]);
+        }
+    }
+};
+
+template <>
+struct ArgminLanes<double> {
+    static void Run(const double *block, int cnt, double *best, double *index) {
+        __m128d b[8], i[8];
+        for (int r = 0; r < 8; ++r) {
+            b[r] = _mm_loadu_pd(best + 2 * r);
+            i[r] = _mm_loadu_pd(index + 2 * r);
+        }
+        for (int c = 0; c < cnt; ++c) {
+            const double *lane = block + c * nearestLanes;
+            __m128d slot = _mm_set1_pd((double) c);
+            for (int r = 0; r < 8; ++r) {
+                __m128d d = _mm_load_pd(lane + 2 * r);
+                __m128d less = _mm_cmplt_pd(d, b[r]);
+                b[r] = _mm_min_pd(d, b[r]);
+                i[r] = _mm_or_pd(_mm_and_pd(less, slot), _mm_andnot_pd(less, i[r]));
+            }
+        }
+        for (int r = 0; r < 8; ++r) {
+            _mm_storeu_pd(best + 2 * r, b[r]);
+            _mm_storeu_pd(index + 2 * r, i[r]);
+        }
+    }
+};
+#endif
+
+// Distance fields of a batch of centers, face-major in blocks of nearestLanes faces:
+// block b holds the distances of its faces to every center of the batch, one aligned
+// run of lanes per slot. The fields are computed center by center and stored here,
+// then the nearest center is found block by block with contiguous reads.
+template <class Traits>
+class DistanceBlocks {
+public:
+    typedef typename Traits::Distance Distance;
+    typedef typename Traits::Label Label;
+
+private:
+    char *storage;
+    Distance *data;
+    int numberOfFaces;
+    int blockCnt;
+    int slotCnt;
+
+public:
+    DistanceBlocks(int numberOfFaces, int slotCnt) : numberOfFaces(numberOfFaces), slotCnt(slotCnt) {
+        blockCnt = (numberOfFaces + nearestLanes - 1) / nearestLanes;
+        storage = new char[Bytes(numberOfFaces, slotCnt)];
+        data = (Distance *) (((size_t) storage + 63) & ~(size_t) 63);
+    }
+
+    ~DistanceBlocks() {
+        delete[] storage;
+    }
+
+    static long long Bytes(int numberOfFaces, int slotCnt) {
+        long long blocks = (numberOfFaces + nearestLanes - 1) / nearestLanes;
+        return blocks * slotCnt * nearestLanes * sizeof(Distance) + 63;
+    }
+
+    // copies a field into its slot, lanes past the last face read as unreachable;
+    // slots are stored concurrently and never share a cache line
+    void Store(int slot, const Distance *field) {
+        for (int b = 0; b < blockCnt; ++b) {
+            Distance *lane = data + ((size_t) b * slotCnt + slot) * nearestLanes;
+            int first = b * nearestLanes;
+            int n = numberOfFaces - first < nearestLanes ? numberOfFaces - first : nearestLanes;
+            memcpy(lane, field + first, n * sizeof(Distance));
+            for (int l = n; l < nearestLanes; ++l) {
+                lane[l] = Traits::Infinity();
+            }
+        }
+    }
+
+    // folds the first cnt slots, labeled firstLabel onwards, into the nearest label so
+    // far; blocks are split into contiguous ranges over the hardware threads
+    void FoldNearest(int cnt, int firstLabel, Distance *minDis, Label *minDisId) {
+        int threadCnt = std::thread::hardware_concurrency();
+        threadCnt = threadCnt > 0 ? threadCnt : 4;
+        threadCnt = threadCnt < blockCnt ? threadCnt : (blockCnt > 0 ? blockCnt : 1);
+
+        int chunk = (blockCnt + threadCnt - 1) / threadCnt;
+        std::vector< std::future<void> > tasks;
+        for (int t = 0; t < threadCnt; ++t) {
+            int begin = t * chunk, end = (t + 1) * chunk < blockCnt ? (t + 1) * chunk : blockCnt;
+            tasks.push_back(std::async(std::launch::async, [=]() {
+                foldBlocks(begin, end, cnt, firstLabel, minDis, minDisId);
+            }));
+        }
+        for (size_t t = 0; t < tasks.size(); ++t) {
+            tasks[t].get();
+        }
+    }
+
+private:
+    void foldBlocks(int begin, int end, int cnt, int firstLabel, Distance *minDis, Label *minDisId) {
+        Distance best[nearestLanes], index[nearestLanes];
+        for (int b = begin; b < end; ++b) {
+            int first = b * nearestLanes;
+            int n = numberOfFaces - first < nearestLanes ? numberOfFaces - first : nearestLanes;
+            for (int l = 0; l < nearestLanes; ++l) {
+                best[l] = l < n ? minDis[first + l] : Traits::Infinity();
+                index[l] = -1;
+            }
+
+            ArgminLanes<Distance>::Run(data + (size_t) b * slotCnt * nearestLanes, cnt, best, index);
+
+            for (int l = 0; l < n; ++l) {
+                if (index[l] >= 0) {
+                    minDis[first + l] = best[l];
+                    minDisId[first + l] = (Label) (firstLabel + (int) index[l]);
+                }
+            }
+        }
+    }
+
+    DistanceBlocks(const DistanceBlocks&);
+    void operator = (const DistanceBlocks&);
+};
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "PerfCounters.h"
+#include "Trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const int hardwareCnt = PERF_COUNTER_COUNT - PERF_CYCLES;
+
+static atomic<long long> totals[PERF_CYCLES];
+
+static const char *counterNames[PERF_COUNTER_COUNT] = {
+    "edges_scanned", "relaxations", "heap_pushes", "heap_pops", "decrease_keys",
+    "cycles", "instructions", "llc_misses", "branch_misses"
+};
+
+#ifdef __linux__
+static int openHardwareCounter(int counter) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (counter) {
+    case PERF_CYCLES:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_INSTRUCTIONS:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_LLC_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+PerfCounters::PerfCounters() {
+    for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+        values[i] = 0;
+        valid[i] = i < PERF_CYCLES;
+    }
+    for (int i = 0; i < hardwareCnt; ++i) {
+        fds[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    closeHardware();
+}
+
+void PerfCounters::Start() {
+    closeHardware();
+#ifdef __linux__
+    // inherited counters only follow threads created after they are opened
+    for (int i = 0; i < hardwareCnt; ++i) {
+        fds[i] = openHardwareCounter(PERF_CYCLES + i);
+    }
+    for (int i = 0; i < hardwareCnt; ++i) {
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+
+    for (int i = 0; i < PERF_CYCLES; ++i) {
+        algorithmBase[i] = totals[i];
+    }
+}
+
+void PerfCounters::Stop() {
+    for (int i = 0; i < PERF_CYCLES; ++i) {
+        values[i] = totals[i] - algorithmBase[i];
+    }
+
+    for (int i = 0; i < hardwareCnt; ++i) {
+        valid[PERF_CYCLES + i] = false;
+        values[PERF_CYCLES + i] = 0;
+#ifdef __linux__
+        if (fds[i] < 0) {
+            continue;
+        }
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time enabled, time running; scaled up when the PMU was multiplexed
+        unsigned long long data[3];
+        if (read(fds[i], data, sizeof(data)) == (ssize_t) sizeof(data) && data[2] > 0) {
+            values[PERF_CYCLES + i] = (long long) ((double) data[0] * data[1] / data[2]);
+            valid[PERF_CYCLES + i] = true;
+        }
+#endif
+    }
+    closeHardware();
+
+    if (Trace::IsEnabled()) {
+        for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+            if (valid[i]) {
+                Trace::Counter(counterNames[i], (double) values[i]);
+            }
+        }
+    }
+}
+
+void PerfCounters::Print(const char *label) {
+    printf("  %s :", label);
+    for (int i = 0; i < PERF_CYCLES; ++i) {
+        if (values[i]) {
+            printf(" %s %lld", counterNames[i], values[i]);
+        }
+    }
+
+    if (!valid[PERF_CYCLES]) {
+        printf(" | hardware counters unavailable\n");
+        return;
+    }
+    printf(" |");
+    for (int i = PERF_CYCLES; i < PERF_COUNTER_COUNT; ++i) {
+        if (valid[i]) {
+            printf(" %s %lld", counterNames[i], values[i]);
+        }
+    }
+    if (valid[PERF_INSTRUCTIONS] && values[PERF_CYCLES] > 0) {
+        printf(" IPC %.2lf", (double) values[PERF_INSTRUCTIONS] / values[PERF_CYCLES]);
+    }
+    if (valid[PERF_LLC_MISSES] && values[PERF_INSTRUCTIONS] > 0) {
+        printf(" LLC MPKI %.2lf", values[PERF_LLC_MISSES] * 1000.0 / values[PERF_INSTRUCTIONS]);
+    }
+    printf("\n");
+}
+
+void PerfCounters::Add(PerfCounter counter, long long value) {
+    totals[counter] += value;
+}
+
+const char* PerfCounters::Name(PerfCounter counter) {
+    return counterNames[counter];
+}
+
+void PerfCounters::closeHardware() {
+    for (int i = 0; i < hardwareCnt; ++i) {
+#ifdef __linux__
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+#endif
+        fds[i] = -1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+// Algorithmic counters come first, hardware counters follow from PERF_CYCLES on
+enum PerfCounter {
+    PERF_EDGES_SCANNED, PERF_RELAXATIONS, PERF_HEAP_PUSHES, PERF_HEAP_POPS, PERF_DECREASE_KEYS,
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_LLC_MISSES, PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+// Counts what a stage did and what it cost the CPU. The algorithms bump process-wide
+// totals through Add, once per task rather than per operation, and a PerfCounters
+// brackets a stage with Start and Stop to report the difference. On Linux the
+// hardware counters are read through perf_event_open and include threads spawned
+// after Start; elsewhere, or without permission, they are reported as unavailable.
+class PerfCounters {
+private:
+    long long algorithmBase[PERF_CYCLES];
+    long long values[PERF_COUNTER_COUNT];
+    bool valid[PERF_COUNTER_COUNT];
+    int fds[PERF_COUNTER_COUNT - PERF_CYCLES];
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    void Start();
+    void Stop();
+
+    bool IsValid(PerfCounter counter) { return valid[counter]; }
+    long long Get(PerfCounter counter) { return values[counter]; }
+
+    // one line per stage, e.g. next to the Step 1-4 timings
+    void Print(const char *label);
+
+    static void Add(PerfCounter counter, long long value);
+    static const char* Name(PerfCounter counter);
+
+private:
+    void closeHardware();
+
+    PerfCounters(const PerfCounters&);
+    void operator = (const PerfCounters&);
+};
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "Progress.h"
+
+#include <stddef.h>
+
+using namespace std;
+
+atomic<bool> Progress::cancelled(false);
+
+static Progress::Callback progressCallback = NULL;
+static void *progressData = NULL;
+static atomic<int> currentStage(PROGRESS_DUAL_GRAPH);
+static atomic<int> lastPercent(-1);
+
+static const char *stageNames[PROGRESS_STAGE_COUNT] = { "dual graph", "seeds", "assignment", "merge", "exact assignment" };
+
+void Progress::SetCallback(Callback callback, void *data) {
+    progressCallback = callback;
+    progressData = data;
+}
+
+void Progress::Reset() {
+    cancelled = false;
+    lastPercent = -1;
+}
+
+void Progress::BeginStage(ProgressStage stage) {
+    currentStage = stage;
+    lastPercent = 0;
+    if (progressCallback) {
+        progressCallback(progressData, stage, 0);
+    }
+}
+
+void Progress::Report(long long done, long long total) {
+    int percent = total > 0 ? (int) (done * 100 / total) : 100;
+    // whoever moves the percent on reports it, the same percent is not reported twice
+    int last = lastPercent;
+    while (percent > last) {
+        if (lastPercent.compare_exchange_weak(last, percent)) {
+            if (progressCallback) {
+                progressCallback(progressData, (ProgressStage) currentStage.load(), percent);
+            }
+            return;
+        }
+    }
+}
+
+void Progress::Cancel() {
+    cancelled = true;
+}
+
+const char* Progress::Name(ProgressStage stage) {
+    return stageNames[stage];
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+
+enum ProgressStage { PROGRESS_DUAL_GRAPH, PROGRESS_SEEDS, PROGRESS_ASSIGNMENT, PROGRESS_MERGE, PROGRESS_EXACT, PROGRESS_STAGE_COUNT };
+
+// Progress and cancellation of the pipeline while it runs off the thread that shows
+// it. The pipeline enters stages and reports how far into one it is; the callback
+// hears about every stage and every whole percent, from whichever thread reported.
+// Cancel only raises a flag: the Dijkstra and merge loops poll it and wind down
+// early, and everything they produced after that is to be thrown away.
+class Progress {
+public:
+    typedef void (*Callback)(void *data, ProgressStage stage, int percent);
+
+private:
+    static std::atomic<bool> cancelled;
+
+public:
+    // NULL stops reporting; must not race with a running pipeline
+    static void SetCallback(Callback callback, void *data);
+
+    // clears the cancel flag, before a run
+    static void Reset();
+    static void BeginStage(ProgressStage stage);
+    static void Report(long long done, long long total);
+
+    static void Cancel();
+    static bool IsCancelled() { return cancelled.load(std::memory_order_relaxed); }
+
+    static const char* Name(ProgressStage stage);
+};
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "RegionGrowing.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "MemoryTracker.h"
+#include "PerfCounters.h"
+
+using namespace std;
+
+struct flatterFace {
+    const double *curvature;
+    flatterFace(const double *curvature) : curvature(curvature) {}
+    bool operator () (int a, int b) const {
+        return curvature[a] < curvature[b] || (curvature[a] == curvature[b] && a < b);
+    }
+};
+
+// edge weight, then face and region
+typedef pair< double, pair<int, int> > regionOffer;
+
+int GrowRegions(const DualGraph *graph, double threshold, int *labels) {
+    int numberOfFaces = graph->numberOfFaces;
+    const int *offsets = graph->offsets;
+    const int *neighbors = graph->neighbors;
+    const int *edgeIds = graph->edgeIds;
+    const double *weights = graph->weights;
+    long long scratchBytes = (long long) numberOfFaces * (sizeof(double) + 2 * sizeof(int));
+    MemoryTracker::Allocate(MEMORY_ASSIGNMENT, scratchBytes);
+
+    double mean = 0.0;
+    for (int e = 0; e < graph->numberOfEdges; ++e) {
+        mean += weights[e];
+    }
+    mean = graph->numberOfEdges > 0 ? mean / graph->numberOfEdges : 0.0;
+    double limit = threshold * mean;
+
+    vector<double> curvature(numberOfFaces, 0.0);
+    vector<int> order(numberOfFaces);
+    for (int i = 0; i < numberOfFaces; ++i) {
+        for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+            curvature[i] = max(curvature[i], weights[edgeIds[k]]);
+        }
+        order[i] = i;
+        labels[i] = -1;
+    }
+    if (numberOfFaces > 0) {
+        sort(order.begin(), order.end(), flatterFace(&curvature[0]));
+    }
+
+    // offers of a region to a face are keyed by the edge weight and win ties against
+    // the next face in order, which comes up keyed by its curvature
+    priority_queue<regionOffer, vector<regionOffer>, greater<regionOffer> > queue;
+    long long scanned = 0;
+    int regionCnt = 0;
+    int next = 0;
+    while (true) {
+        while (next < numberOfFaces && labels[order[next]] >= 0) {
+            ++next;
+        }
+        int u, region;
+        if (!queue.empty() && (next == numberOfFaces || queue.top().first <= curvature[order[next]])) {
+            u = queue.top().second.first;
+            region = queue.top().second.second;
+            queue.pop();
+            if (labels[u] >= 0) {
+                continue;
+            }
+        } else if (next < numberOfFaces) {
+            u = order[next];
+            region = regionCnt++;
+        } else {
+            break;
+        }
+
+        labels[u] = region;
+        scanned += offsets[u + 1] - offsets[u];
+        for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+            int v = neighbors[k];
+            double weight = weights[edgeIds[k]];
+            if (labels[v] < 0 && weight <= limit) {
+                queue.push(make_pair(weight, make_pair(v, region)));
+            }
+        }
+    }
+
+    PerfCounters::Add(PERF_EDGES_SCANNED, scanned);
+    MemoryTracker::Release(MEMORY_ASSIGNMENT, scratchBytes);
+    return regionCnt;
+}
\ No newline at end of file
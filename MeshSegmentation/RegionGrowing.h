@@ -0,0 +1,11 @@
+#pragma once
+
+#include "DualGraph.h"
+
+// Oversegments the mesh in one pass over the dual graph, with no distance tables. A
+// face's curvature is the weight of its heaviest dual edge. The regions grow at once as
+// a priority flood over edges up to threshold times the mean edge weight, lightest edge
+// first; faces come up flattest first and start a region only if no flood reached them
+// through a lighter edge by then. labels receives the region of every face; returns how
+// many regions there are. O(F log F) for ordering the faces and the flood.
+int GrowRegions(const DualGraph *graph, double threshold, int *labels);
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include "SeedSampling.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+#include <vtkMath.h>
+
+#include "MemoryTracker.h"
+#include "PerfCounters.h"
+
+using namespace std;
+
+static const char *seedModeNames[] = { "random", "poisson", "farthest" };
+
+// passes of Poisson disk sampling before the faces left are taken as they come
+static const int maxPoissonPasses = 64;
+
+SeedSampler::SeedSampler(const DualGraph *graph) : graph(graph), trackedBytes(0) {}
+
+SeedSampler::~SeedSampler() {
+    MemoryTracker::Release(MEMORY_ASSIGNMENT, trackedBytes);
+}
+
+// the cell of a point in a grid of the given cell size, hashed; cells that collide
+// only cost a few extra distance tests
+static long long cellKey(long long x, long long y, long long z) {
+    return (x * 73856093LL) ^ (y * 19349663LL) ^ (z * 83492791LL);
+}
+
+void SeedSampler::Poisson(const int *faces, int faceCnt, double area, int cnt, unsigned int seed, int *seeds) {
+    if (cnt <= 0) {
+        return;
+    }
+
+    // weighted random order: the smallest -log(u) / area comes first, faces without
+    // area last
+    unsigned long long state = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    vector< pair<double, int> > order(faceCnt);
+    for (int i = 0; i < faceCnt; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        double u = ((state >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+        double faceArea = graph->areas[faces[i]];
+        order[i] = make_pair(faceArea > 0 ? -log(u) / faceArea : numeric_limits<double>::max(), faces[i]);
+    }
+    sort(order.begin(), order.end());
+
+    vector<char> taken(faceCnt, 0);
+    int found = 0;
+    double radius = area > 0 ? sqrt(area / cnt) : 0.0;
+    for (int pass = 0; found < cnt && pass < maxPoissonPasses && radius > 0; ++pass, radius *= 0.8) {
+        unordered_map< long long, vector<int> > cells;
+        for (int i = 0; i < found; ++i) {
+            const double *p = graph->Center(seeds[i]);
+            cells[cellKey((long long) floor(p[0] / radius), (long long) floor(p[1] / radius), (long long) floor(p[2] / radius))].push_back(seeds[i]);
+        }
+
+        double radius2 = radius * radius;
+        for (int i = 0; i < faceCnt && found < cnt; ++i) {
+            if (taken[i]) {
+                continue;
+            }
+            const double *p = graph->Center(order[i].second);
+            long long cx = (long long) floor(p[0] / radius), cy = (long long) floor(p[1] / radius), cz = (long long) floor(p[2] / radius);
+            bool isFree = true;
+            for (int dx = -1; dx <= 1 && isFree; ++dx) {
+                for (int dy = -1; dy <= 1 && isFree; ++dy) {
+                    for (int dz = -1; dz <= 1 && isFree; ++dz) {
+                        unordered_map< long long, vector<int> >::const_iterator it = cells.find(cellKey(cx + dx, cy + dy, cz + dz));
+                        if (it == cells.end()) {
+                            continue;
+                        }
+                        for (size_t k = 0; k < it->second.size() && isFree; ++k) {
+                            isFree = vtkMath::Distance2BetweenPoints(p, graph->Center(it->second[k])) >= radius2;
+                        }
+                    }
+                }
+            }
+            if (isFree) {
+                taken[i] = 1;
+                seeds[found++] = order[i].second;
+                cells[cellKey(cx, cy, cz)].push_back(order[i].second);
+            }
+        }
+    }
+
+    // faces stacked on one point never get apart, they come in drawing order
+    for (int i = 0; i < faceCnt && found < cnt; ++i) {
+        if (!taken[i]) {
+            taken[i] = 1;
+            seeds[found++] = order[i].second;
+        }
+    }
+}
+
+void SeedSampler::Farthest(const int *faces, int faceCnt, int cnt, int *seeds) {
+    if (cnt <= 0 || faceCnt == 0) {
+        return;
+    }
+
+    int numberOfFaces = graph->numberOfFaces;
+    if (distances.empty()) {
+        spans.resize(graph->numberOfEdges);
+        for (int e = 0; e < graph->numberOfEdges; ++e) {
+            spans[e] = sqrt(vtkMath::Distance2BetweenPoints(graph->Center(graph->edges[2 * e]), graph->Center(graph->edges[2 * e + 1])));
+        }
+        distances.assign(numberOfFaces, numeric_limits<double>::max());
+        search.Reserve(numberOfFaces, &distances[0]);
+        farthest.Reserve(numberOfFaces);
+        trackedBytes = (long long) graph->numberOfEdges * sizeof(double) + (long long) numberOfFaces * sizeof(double)
+            + IndexedHeap<double>::Bytes(numberOfFaces, true) + IndexedHeap<double>::Bytes(numberOfFaces, false);
+        MemoryTracker::Allocate(MEMORY_ASSIGNMENT, trackedBytes);
+    }
+
+    // the face nearest the area weighted centroid starts
+    double centroid[3] = { 0, 0, 0 }, area = 0;
+    for (int i = 0; i < faceCnt; ++i) {
+        area += graph->areas[faces[i]];
+    }
+    for (int i = 0; i < faceCnt; ++i) {
+        const double *p = graph->Center(faces[i]);
+        double weight = area > 0 ? graph->areas[faces[i]] / area : 1.0 / faceCnt;
+        centroid[0] += weight * p[0];
+        centroid[1] += weight * p[1];
+        centroid[2] += weight * p[2];
+    }
+    int first = faces[0];
+    double firstDis2 = vtkMath::Distance2BetweenPoints(centroid, graph->Center(first));
+    for (int i = 1; i < faceCnt; ++i) {
+        double dis2 = vtkMath::Distance2BetweenPoints(centroid, graph->Center(faces[i]));
+        if (dis2 < firstDis2) {
+            first = faces[i];
+            firstDis2 = dis2;
+        }
+    }
+
+    seeds[0] = first;
+    grow(first);
+    for (int found = 1; found < cnt && !farthest.Empty(); ++found) {
+        int next = farthest.Top();
+        farthest.Remove(next);
+        seeds[found] = next;
+        grow(next);
+    }
+
+    farthest.Reset();
+    for (int i = 0; i < faceCnt; ++i) {
+        distances[faces[i]] = numeric_limits<double>::max();
+    }
+}
+
+// Dijkstra from a new seed that stops at faces an earlier seed is at least as near to
+void SeedSampler::grow(int seed) {
+    const int *offsets = graph->offsets;
+    const int *neighbors = graph->neighbors;
+    const int *edgeIds = graph->edgeIds;
+
+    distances[seed] = 0;
+    search.Push(seed, 0);
+    long long pops = 0, scanned = 0, relaxed = 0;
+    while (!search.Empty()) {
+        int u = search.Pop();
+        ++pops;
+        scanned += offsets[u + 1] - offsets[u];
+        for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+            int v = neighbors[k];
+            double tmp = distances[u] + spans[edgeIds[k]];
+            if (tmp < distances[v]) {
+                if (search.Contains(v)) {
+                    search.DecreaseKey(v, tmp);
+                } else {
+                    search.Push(v, tmp);
+                }
+                if (farthest.Contains(v)) {
+                    farthest.Update(v, -tmp);
+                } else {
+                    farthest.Push(v, -tmp);
+                }
+                ++relaxed;
+            }
+        }
+    }
+    PerfCounters::Add(PERF_HEAP_POPS, pops);
+    PerfCounters::Add(PERF_EDGES_SCANNED, scanned);
+    PerfCounters::Add(PERF_RELAXATIONS, relaxed);
+}
+
+bool SeedSampler::Parse(const char *name, SeedMode& mode) {
+    for (int i = 0; i < SEED_MODE_COUNT; ++i) {
+        if (strcmp(name, seedModeNames[i]) == 0) {
+            mode = (SeedMode) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* SeedSampler::Name(SeedMode mode) {
+    return seedModeNames[mode];
+}
\ No newline at end of file
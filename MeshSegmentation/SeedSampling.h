@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "DualGraph.h"
+#include "IndexedHeap.h"
+
+enum SeedMode { SEED_RANDOM, SEED_POISSON, SEED_FARTHEST, SEED_MODE_COUNT };
+
+// Deterministic, well spread seed faces for AutomaticSelectSeeds, drawn from the face
+// centers and areas of the dual graph one connected component at a time. The scratch
+// arrays span the whole graph and are reset after every component, so one sampler
+// serves every component of a mesh; they are only allocated by the first Farthest.
+class SeedSampler {
+private:
+    const DualGraph *graph;
+    std::vector<double> spans;      // center distance across every edge, built on first use
+    std::vector<double> distances;  // geodesic distance to the nearest seed, numberOfFaces
+    IndexedHeap<double> search;     // keyed by distances
+    IndexedHeap<double> farthest;   // negated distances, the farthest face on top
+    long long trackedBytes;
+
+public:
+    SeedSampler(const DualGraph *graph);
+    ~SeedSampler();
+
+    // Area weighted Poisson disk sampling: faces are visited in a random order drawn
+    // with their area as weight and taken when no seed so far lies within the radius,
+    // looked up in a spatial hash of the seeds. The radius starts at sqrt(area / cnt)
+    // and shrinks until cnt seeds are found. faces[faceCnt] is one component of the
+    // graph and area its area; the same seed value draws the same faces.
+    void Poisson(const int *faces, int faceCnt, double area, int cnt, unsigned int seed, int *seeds);
+
+    // Farthest point sampling by geodesic distance between face centers: the first
+    // seed is the face nearest the centroid of the component, every next one the face
+    // farthest from all seeds so far. Each new seed only runs a Dijkstra over the
+    // faces it is nearer to than the others, so the searches together are incremental.
+    void Farthest(const int *faces, int faceCnt, int cnt, int *seeds);
+
+    // "random", "poisson" or "farthest"
+    static bool Parse(const char *name, SeedMode& mode);
+    static const char* Name(SeedMode mode);
+
+private:
+    void grow(int seed);
+
+    SeedSampler(const SeedSampler&);
+    void operator = (const SeedSampler&);
+};
\ No newline at end of file
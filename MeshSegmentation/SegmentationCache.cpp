@@ -0,0 +1,490 @@
+#include "SegmentationCache.h"
+
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPoints.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MemoryTracker.h"
+#include "PerfCounters.h"
+#include "Utils.h"
+#include "vtkConvertToDualGraph.h"
+
+#ifdef _WIN32
+#define ftell64 _ftelli64
+#define fseek64 _fseeki64
+#else
+#define ftell64 ftello
+#define fseek64 fseeko
+#endif
+
+static const char cacheMagic[8] = { 'M', 'S', 'E', 'G', 'C', 'A', 'C', 'H' };
+static const unsigned long long sectionAlignment = 64;
+
+SegmentationCache::SegmentationCache(vtkPolyData *mesh, const WeightParameters& weights) {
+    unsigned long long h = HashBytes(NULL, 0, SEGMENTATION_CACHE_VERSION);
+
+    vtkDataArray *points = mesh->GetPoints()->GetData();
+    long long numberOfPoints = points->GetNumberOfTuples();
+    int pointSize = points->GetDataTypeSize();
+    h = HashBytes(&numberOfPoints, sizeof(numberOfPoints), h);
+    h = HashBytes(&pointSize, sizeof(pointSize), h);
+    h = HashBytes(points->GetVoidPointer(0), (size_t) numberOfPoints * 3 * pointSize, h);
+
+    vtkIdTypeArray *polys = mesh->GetPolys()->GetData();
+    h = HashBytes(polys->GetPointer(0), (size_t) polys->GetNumberOfTuples() * sizeof(vtkIdType), h);
+
+    // the default policy hashes delta alone, the version covers changes to its formula; user
+    // and custom weights are told apart by the version their caller gives them, their
+    // function addresses change from run to run
+    h = HashBytes(&weights.delta, sizeof(weights.delta), h);
+    if (weights.policy != WEIGHT_MIXED) {
+        int policy = weights.policy;
+        h = HashBytes(&policy, sizeof(policy), h);
+        h = HashBytes(&weights.epsilon, sizeof(weights.epsilon), h);
+        h = HashBytes(&weights.curvatureGain, sizeof(weights.curvatureGain), h);
+        if (weights.policy == WEIGHT_USER || weights.policy == WEIGHT_CUSTOM) {
+            h = HashBytes(&weights.policyVersion, sizeof(weights.policyVersion), h);
+        }
+    }
+    key = h;
+    numberOfFaces = mesh->GetNumberOfCells();
+
+    char name[32];
+    std::string dir = GetCacheDirectory();
+    sprintf(name, "%016llx", key);
+    graphFileName = dir + "/" + name + ".graph.msc";
+    labelFileName = dir + "/" + name + ".labels.msc";
+}
+
+std::string SegmentationCache::GetCacheDirectory() {
+    const char *dir = getenv("MESHSEG_CACHE_DIR");
+    std::string res = dir && *dir ? dir : "cache";
+
+#ifdef _WIN32
+    _mkdir(res.c_str());
+#else
+    mkdir(res.c_str(), 0755);
+#endif
+
+    return res;
+}
+
+DualGraph* SegmentationCache::LoadGraph() {
+    const CacheHeader *header;
+    MappedFile *file = open(graphFileName, header);
+    return file ? attachGraph(file, header) : NULL;
+}
+
+DualGraph* SegmentationCache::LoadGraphFile(const std::string& fileName) {
+    const CacheHeader *header;
+    MappedFile *file = openFile(fileName, header);
+    return file ? attachGraph(file, header) : NULL;
+}
+
+DualGraph* SegmentationCache::attachGraph(MappedFile *file, const CacheHeader *header) {
+    unsigned long long F = header->numberOfFaces, E = header->numberOfEdges;
+    const unsigned long long expected[CACHE_SECTION_COUNT] = {
+        (F + 1) * sizeof(int), 2 * E * sizeof(int), 2 * E * sizeof(int), 2 * E * sizeof(int),
+        E * sizeof(double), E * sizeof(double), 3 * F * sizeof(double), F * sizeof(double),
+        0, 0, 0
+    };
+    for (int i = 0; i < CACHE_SECTION_COUNT; ++i) {
+        if (header->sectionSizes[i] != expected[i]) {
+            delete file;
+            return NULL;
+        }
+    }
+
+    char *base = file->Data();
+    DualGraph *graph = new DualGraph;
+    graph->offsets = (int *) (base + header->sectionOffsets[SECTION_OFFSETS]);
+    graph->neighbors = (int *) (base + header->sectionOffsets[SECTION_NEIGHBORS]);
+    graph->edgeIds = (int *) (base + header->sectionOffsets[SECTION_EDGE_IDS]);
+    graph->edges = (int *) (base + header->sectionOffsets[SECTION_EDGES]);
+    graph->weights = (double *) (base + header->sectionOffsets[SECTION_WEIGHTS]);
+    graph->edgeLens = (double *) (base + header->sectionOffsets[SECTION_EDGE_LENS]);
+    graph->centers = (double *) (base + header->sectionOffsets[SECTION_CENTERS]);
+    graph->areas = (double *) (base + header->sectionOffsets[SECTION_AREAS]);
+    graph->Attach(file, (int) F, (int) E);
+
+    return graph;
+}
+
+bool SegmentationCache::SaveGraph(const DualGraph *graph) {
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.numberOfFaces = graph->numberOfFaces;
+    header.numberOfEdges = graph->numberOfEdges;
+
+    unsigned long long F = graph->numberOfFaces, E = graph->numberOfEdges;
+    const void *data[CACHE_SECTION_COUNT] = {
+        graph->offsets, graph->neighbors, graph->edgeIds, graph->edges,
+        graph->weights, graph->edgeLens, graph->centers, graph->areas,
+        NULL, NULL, NULL
+    };
+    const unsigned long long sizes[CACHE_SECTION_COUNT] = {
+        (F + 1) * sizeof(int), 2 * E * sizeof(int), 2 * E * sizeof(int), 2 * E * sizeof(int),
+        E * sizeof(double), E * sizeof(double), 3 * F * sizeof(double), F * sizeof(double),
+        0, 0, 0
+    };
+    memcpy(header.sectionSizes, sizes, sizeof(sizes));
+
+    return write(graphFileName, header, data);
+}
+
+// Buffered writes into one section of a file being built, every section through a
+// handle of its own so all of them can be filled in the same pass over the faces
+class sectionWriter {
+private:
+    FILE *fp;
+    bool ok;
+
+public:
+    sectionWriter(const std::string& fileName, unsigned long long offset) {
+        fp = fopen(fileName.c_str(), "r+b");
+        ok = fp && fseek64(fp, (long long) offset, SEEK_SET) == 0;
+    }
+
+    ~sectionWriter() {
+        Close();
+    }
+
+    template <class T>
+    void Write(const T *data, size_t cnt) {
+        ok = ok && (cnt == 0 || fwrite(data, sizeof(T), cnt, fp) == cnt);
+    }
+
+    bool Close() {
+        if (fp) {
+            ok = (fclose(fp) == 0) && ok;
+            fp = NULL;
+        }
+        return ok;
+    }
+
+private:
+    sectionWriter(const sectionWriter&);
+    void operator = (const sectionWriter&);
+};
+
+// edges whose weights are computed together while streaming
+static const int weightBlock = 4096;
+
+bool SegmentationCache::BuildGraph(vtkPolyData *mesh, const WeightParameters& weights) {
+    std::string tmpName = graphFileName + ".tmp";
+    FILE *fp = fopen(tmpName.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+
+    // normals come from the whole mesh at once, the first edge of every face turns the
+    // faces below it into edge ids; nothing else is kept per face
+    int F = numberOfFaces;
+    long long faceBytes = (long long) F * (3 * sizeof(double) + sizeof(int));
+    MemoryTracker::Allocate(MEMORY_DUAL_GRAPH, faceBytes);
+    std::vector<double> normals(3 * (size_t) F);
+    if (F > 0) {
+        ComputeFaceNormals(mesh, &normals[0]);
+    }
+    std::vector<int> firstEdge(F + 1, 0);
+
+    // pass one: degrees, edge ids and the sums the weights are normalized by, the edges
+    // in the order vtkConvertToDualGraph numbers them
+    DualFaceWalker walker(mesh);
+    std::vector< std::pair<int, int> > across, lowerAcross;
+    DualEdgeTerms sum = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    header.sectionOffsets[SECTION_OFFSETS] = (sizeof(CacheHeader) + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+    {
+        sectionWriter offsets(tmpName, header.sectionOffsets[SECTION_OFFSETS]);
+        int slot = 0;
+        offsets.Write(&slot, 1);
+        long long scanned = 0;
+        double center[3], area, lateral[3], otherCenter[3], otherArea, otherLateral[3];
+        for (int i = 0; i < F; ++i) {
+            walker.Geometry(i, center, area, lateral);
+            int degree = walker.Neighbors(i, across);
+            scanned += degree;
+            slot += degree;
+            offsets.Write(&slot, 1);
+            firstEdge[i + 1] = firstEdge[i];
+            for (size_t k = 0; k < across.size(); ++k) {
+                int j = across[k].first;
+                if (i < j) {
+                    walker.Geometry(j, otherCenter, otherArea, otherLateral);
+                    DualEdgeTerms t;
+                    ComputeEdgeTerms(area, otherArea, &normals[3 * i], &normals[3 * j], center, otherCenter, lateral[across[k].second], t);
+                    sum.phy += t.phy;
+                    sum.angle += t.angle;
+                    sum.dihedral += t.dihedral;
+                    sum.curvature += t.curvature;
+                    sum.length += t.length;
+                    ++firstEdge[i + 1];
+                }
+            }
+        }
+        ok = offsets.Close() && ok;
+        PerfCounters::Add(PERF_EDGES_SCANNED, scanned);
+    }
+
+    int E = firstEdge[F];
+    DualEdgeTerms averages = sum;
+    if (E > 0) {
+        averages.phy /= E;
+        averages.angle /= E;
+        averages.dihedral /= E;
+        averages.curvature /= E;
+        averages.length /= E;
+    }
+    header.numberOfFaces = F;
+    header.numberOfEdges = E;
+    unsigned long long sizes[CACHE_SECTION_COUNT] = {
+        (F + 1ULL) * sizeof(int), 2ULL * E * sizeof(int), 2ULL * E * sizeof(int), 2ULL * E * sizeof(int),
+        (unsigned long long) E * sizeof(double), (unsigned long long) E * sizeof(double), 3ULL * F * sizeof(double), (unsigned long long) F * sizeof(double),
+        0, 0, 0
+    };
+    unsigned long long pos = sizeof(CacheHeader);
+    for (int i = 0; i < CACHE_SECTION_COUNT; ++i) {
+        pos = (pos + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+        header.sectionOffsets[i] = pos;
+        header.sectionSizes[i] = sizes[i];
+        pos += sizes[i];
+    }
+    {
+        // the file takes its full length at once, the empty sections at its end included
+        static const char zero = 0;
+        sectionWriter end(tmpName, pos - 1);
+        end.Write(&zero, 1);
+        ok = end.Close() && ok;
+    }
+
+    // pass two: every other section, the slots of a face ordered by edge id as
+    // DualGraph::FromGraph lays them out, those of lower faces first
+    {
+        sectionWriter neighbors(tmpName, header.sectionOffsets[SECTION_NEIGHBORS]);
+        sectionWriter edgeIds(tmpName, header.sectionOffsets[SECTION_EDGE_IDS]);
+        sectionWriter edges(tmpName, header.sectionOffsets[SECTION_EDGES]);
+        sectionWriter weightWriter(tmpName, header.sectionOffsets[SECTION_WEIGHTS]);
+        sectionWriter edgeLens(tmpName, header.sectionOffsets[SECTION_EDGE_LENS]);
+        sectionWriter centers(tmpName, header.sectionOffsets[SECTION_CENTERS]);
+        sectionWriter areas(tmpName, header.sectionOffsets[SECTION_AREAS]);
+
+        std::vector<DualEdgeTerms> terms;
+        terms.reserve(weightBlock);
+        double blockWeights[weightBlock];
+        std::vector< std::pair<int, int> > slots;
+        double center[3], area, lateral[3], otherCenter[3], otherArea, otherLateral[3];
+        for (int i = 0; i < F; ++i) {
+            walker.Geometry(i, center, area, lateral);
+            centers.Write(center, 3);
+            areas.Write(&area, 1);
+
+            walker.Neighbors(i, across);
+            slots.clear();
+            int upper = firstEdge[i];
+            for (size_t k = 0; k < across.size(); ++k) {
+                int j = across[k].first;
+                if (i < j) {
+                    walker.Geometry(j, otherCenter, otherArea, otherLateral);
+                    DualEdgeTerms t;
+                    ComputeEdgeTerms(area, otherArea, &normals[3 * i], &normals[3 * j], center, otherCenter, lateral[across[k].second], t);
+                    terms.push_back(t);
+                    int ends[2] = { i, j };
+                    edges.Write(ends, 2);
+                    edgeLens.Write(&t.length, 1);
+                    slots.push_back(std::make_pair(upper++, j));
+                    if ((int) terms.size() == weightBlock) {
+                        ComputeWeights(&terms[0], weightBlock, averages, weights, blockWeights);
+                        weightWriter.Write(blockWeights, weightBlock);
+                        terms.clear();
+                    }
+                } else {
+                    // the edge of a lower face is found among its own, once for every face
+                    bool seen = false;
+                    for (size_t m = 0; m < k && !seen; ++m) {
+                        seen = across[m].first == j;
+                    }
+                    if (seen) {
+                        continue;
+                    }
+                    walker.Neighbors(j, lowerAcross);
+                    int edgeId = firstEdge[j];
+                    for (size_t m = 0; m < lowerAcross.size(); ++m) {
+                        if (lowerAcross[m].first == i) {
+                            slots.push_back(std::make_pair(edgeId, j));
+                        }
+                        edgeId += lowerAcross[m].first > j;
+                    }
+                }
+            }
+            sort(slots.begin(), slots.end());
+            for (size_t k = 0; k < slots.size(); ++k) {
+                neighbors.Write(&slots[k].second, 1);
+                edgeIds.Write(&slots[k].first, 1);
+            }
+        }
+        if (!terms.empty()) {
+            ComputeWeights(&terms[0], (int) terms.size(), averages, weights, blockWeights);
+            weightWriter.Write(blockWeights, terms.size());
+        }
+
+        ok = neighbors.Close() && ok;
+        ok = edgeIds.Close() && ok;
+        ok = edges.Close() && ok;
+        ok = weightWriter.Close() && ok;
+        ok = edgeLens.Close() && ok;
+        ok = centers.Close() && ok;
+        ok = areas.Close() && ok;
+    }
+    MemoryTracker::Release(MEMORY_DUAL_GRAPH, faceBytes);
+
+    // the header goes in last, a file cut short never passes as a graph
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = SEGMENTATION_CACHE_VERSION;
+    header.headerSize = sizeof(CacheHeader);
+    header.key = key;
+    {
+        sectionWriter head(tmpName, 0);
+        head.Write(&header, 1);
+        ok = head.Close() && ok;
+    }
+
+    if (ok) {
+        remove(graphFileName.c_str());
+        ok = rename(tmpName.c_str(), graphFileName.c_str()) == 0;
+    }
+    if (!ok) {
+        remove(tmpName.c_str());
+    }
+    return ok;
+}
+
+bool SegmentationCache::LoadSegmentation(int& seedCnt, int*& labels, int*& merges, double*& mergeCosts) {
+    const CacheHeader *header;
+    MappedFile *file = open(labelFileName, header);
+    if (!file) {
+        return false;
+    }
+
+    seedCnt = (int) header->seedCnt;
+    bool valid = seedCnt > 2 && header->sectionSizes[SECTION_LABELS] == numberOfFaces * sizeof(int)
+        && header->sectionSizes[SECTION_MERGES] == 2 * (seedCnt - 2) * sizeof(int)
+        && header->sectionSizes[SECTION_MERGE_COSTS] == (seedCnt - 2) * sizeof(double);
+    if (valid) {
+        labels = new int[numberOfFaces];
+        memcpy(labels, file->Data() + header->sectionOffsets[SECTION_LABELS], numberOfFaces * sizeof(int));
+        merges = new int[2 * (seedCnt - 2)];
+        memcpy(merges, file->Data() + header->sectionOffsets[SECTION_MERGES], 2 * (seedCnt - 2) * sizeof(int));
+        mergeCosts = new double[seedCnt - 2];
+        memcpy(mergeCosts, file->Data() + header->sectionOffsets[SECTION_MERGE_COSTS], (seedCnt - 2) * sizeof(double));
+    }
+
+    delete file;
+    return valid;
+}
+
+bool SegmentationCache::SaveSegmentation(int seedCnt, const int *labels, const int *merges, const double *mergeCosts) {
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.numberOfFaces = numberOfFaces;
+    header.seedCnt = seedCnt;
+
+    const void *data[CACHE_SECTION_COUNT] = { NULL };
+    data[SECTION_LABELS] = labels;
+    data[SECTION_MERGES] = merges;
+    data[SECTION_MERGE_COSTS] = mergeCosts;
+    header.sectionSizes[SECTION_LABELS] = numberOfFaces * sizeof(int);
+    header.sectionSizes[SECTION_MERGES] = 2 * (seedCnt - 2) * sizeof(int);
+    header.sectionSizes[SECTION_MERGE_COSTS] = (seedCnt - 2) * sizeof(double);
+
+    return write(labelFileName, header, data);
+}
+
+MappedFile* SegmentationCache::open(const std::string& fileName, const CacheHeader*& header) {
+    MappedFile *file = openFile(fileName, header);
+    if (file && (header->key != key || header->numberOfFaces != numberOfFaces)) {
+        delete file;
+        return NULL;
+    }
+    return file;
+}
+
+MappedFile* SegmentationCache::openFile(const std::string& fileName, const CacheHeader*& header) {
+    MappedFile *file = new MappedFile;
+    if (!file->Open(fileName) || file->Size() < sizeof(CacheHeader)) {
+        delete file;
+        return NULL;
+    }
+
+    header = (const CacheHeader *) file->Data();
+    bool valid = memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) == 0 && header->version == SEGMENTATION_CACHE_VERSION
+        && header->headerSize == sizeof(CacheHeader);
+    for (int i = 0; valid && i < CACHE_SECTION_COUNT; ++i) {
+        valid = header->sectionOffsets[i] % sectionAlignment == 0 && header->sectionOffsets[i] + header->sectionSizes[i] <= file->Size();
+    }
+    if (!valid) {
+        delete file;
+        return NULL;
+    }
+
+    return file;
+}
+
+bool SegmentationCache::write(const std::string& fileName, CacheHeader& header, const void **sectionData) {
+    static const char zeros[64] = { 0 };
+
+    std::string tmpName = fileName + ".tmp";
+    FILE *fp = fopen(tmpName.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = SEGMENTATION_CACHE_VERSION;
+    header.headerSize = sizeof(CacheHeader);
+    header.key = key;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (int i = 0; ok && i < CACHE_SECTION_COUNT; ++i) {
+        unsigned long long pos = (unsigned long long) ftell64(fp);
+        unsigned long long padding = (sectionAlignment - pos % sectionAlignment) % sectionAlignment;
+        ok = fwrite(zeros, 1, (size_t) padding, fp) == padding;
+
+        unsigned long long len = header.sectionSizes[i];
+        header.sectionOffsets[i] = pos + padding;
+        ok = ok && (len == 0 || fwrite(sectionData[i], 1, (size_t) len, fp) == len);
+    }
+
+    // rewrite the header now that the section table is known
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (ok) {
+        remove(fileName.c_str());
+        ok = rename(tmpName.c_str(), fileName.c_str()) == 0;
+    }
+    if (!ok) {
+        remove(tmpName.c_str());
+    }
+
+    return ok;
+}
\ No newline at end of file
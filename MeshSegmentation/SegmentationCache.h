@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vtkPolyData.h>
+
+#include <string>
+
+#include "DualGraph.h"
+#include "MappedFile.h"
+#include "WeightPolicies.h"
+
+// 3: mixed weights of a mesh without concave edges are no longer NaN
+#define SEGMENTATION_CACHE_VERSION 3
+
+enum CacheSection {
+    SECTION_OFFSETS, SECTION_NEIGHBORS, SECTION_EDGE_IDS, SECTION_EDGES,
+    SECTION_WEIGHTS, SECTION_EDGE_LENS, SECTION_CENTERS, SECTION_AREAS,
+    SECTION_LABELS, SECTION_MERGES, SECTION_MERGE_COSTS,
+    CACHE_SECTION_COUNT
+};
+
+// Fixed size file header. Every section starts on a 64 byte boundary so the
+// arrays can be used straight out of the mapping.
+struct CacheHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int headerSize;
+    unsigned long long key;
+    long long numberOfFaces;
+    long long numberOfEdges;
+    long long seedCnt;
+    unsigned long long sectionOffsets[CACHE_SECTION_COUNT];
+    unsigned long long sectionSizes[CACHE_SECTION_COUNT];
+};
+
+// On-disk cache of the dual graph and the segmentation computed on it, keyed by
+// a hash of the mesh geometry and the edge weight parameters. The graph and the
+// labels go to two files of the same format, so saving a new segmentation never
+// has to replace the graph file that is still mapped.
+class SegmentationCache {
+private:
+    unsigned long long key;
+    int numberOfFaces;
+    std::string graphFileName;
+    std::string labelFileName;
+
+public:
+    SegmentationCache(vtkPolyData *mesh, const WeightParameters& weights);
+
+    // returns NULL on a miss, otherwise a graph whose arrays live in the mapped file
+    DualGraph* LoadGraph();
+    bool SaveGraph(const DualGraph *graph);
+
+    // writes the graph of the mesh straight into the graph file, section by section in
+    // two passes over the faces, so the graph never has to fit in memory to get there;
+    // the file holds the same arrays SaveGraph writes for the graph built in memory
+    bool BuildGraph(vtkPolyData *mesh, const WeightParameters& weights);
+
+    // the graph of a file written by this class, for processes that have no mesh to
+    // check the key against; NULL when it is not a valid graph file
+    static DualGraph* LoadGraphFile(const std::string& fileName);
+
+    // labels holds one cluster id per face, merges the (kept, absorbed) pair of each merge step
+    bool LoadSegmentation(int& seedCnt, int*& labels, int*& merges, double*& mergeCosts);
+    bool SaveSegmentation(int seedCnt, const int *labels, const int *merges, const double *mergeCosts);
+
+    unsigned long long Key() { return key; }
+    const std::string& GraphFileName() { return graphFileName; }
+
+    static std::string GetCacheDirectory();
+
+private:
+    MappedFile* open(const std::string& fileName, const CacheHeader*& header);
+    static MappedFile* openFile(const std::string& fileName, const CacheHeader*& header);
+    static DualGraph* attachGraph(MappedFile *file, const CacheHeader *header);
+    bool write(const std::string& fileName, CacheHeader& header, const void **sectionData);
+};
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "SegmentationFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#ifdef _WIN32
+#define ftell64 _ftelli64
+#else
+#define ftell64 ftello
+#endif
+
+static const char segmentationMagic[8] = { 'M', 'S', 'E', 'G', 'R', 'S', 'L', 'T' };
+static const unsigned long long sectionAlignment = 64;
+
+bool SegmentationFile::Open(const std::string& fileName) {
+    header = NULL;
+    if (!file.Open(fileName) || file.Size() < sizeof(SegmentationFileHeader)) {
+        file.Close();
+        return false;
+    }
+
+    const SegmentationFileHeader *h = (const SegmentationFileHeader *) file.Data();
+    if (memcmp(h->magic, segmentationMagic, sizeof(segmentationMagic)) != 0 || h->version != SEGMENTATION_FILE_VERSION
+        || h->headerSize != sizeof(SegmentationFileHeader) || h->fileSize != file.Size() || h->clusterCnt < 2 || h->levelCnt != h->clusterCnt - 1) {
+        file.Close();
+        return false;
+    }
+
+    unsigned long long C = h->clusterCnt, L = h->levelCnt;
+    bool valid = h->labelsOffset + h->numberOfFaces * sizeof(int) <= h->fileSize
+        && h->leafOrderOffset + C * sizeof(int) <= h->fileSize
+        && h->clusterOffsetsOffset + (C + 1) * sizeof(long long) <= h->fileSize
+        && h->faceIdsOffset + h->labeledFaces * sizeof(int) <= h->fileSize
+        && h->mergesOffset + (C - 2) * sizeof(SegmentationMerge) <= h->fileSize
+        && h->levelsOffset + L * C * sizeof(int) <= h->fileSize
+        && h->rangesOffset + 2 * L * C * sizeof(int) <= h->fileSize;
+    if (!valid) {
+        file.Close();
+        return false;
+    }
+
+    header = h;
+    return true;
+}
+
+const int* SegmentationFile::Labels() {
+    return section<int>(header->labelsOffset);
+}
+
+const SegmentationMerge* SegmentationFile::Merges() {
+    return section<SegmentationMerge>(header->mergesOffset);
+}
+
+const int* SegmentationFile::GetLevel(int k) {
+    if (k < 2 || k > header->clusterCnt) {
+        return NULL;
+    }
+    return section<int>(header->levelsOffset) + (header->clusterCnt - k) * header->clusterCnt;
+}
+
+int SegmentationFile::GetLabel(int k, int faceId) {
+    int label = Labels()[faceId];
+    const int *level = GetLevel(k);
+    return label < 0 || !level ? -1 : level[label];
+}
+
+const int* SegmentationFile::GetClusterFaces(int k, int clusterId, long long& count) {
+    count = 0;
+    if (k < 2 || k > header->clusterCnt || clusterId < 0 || clusterId >= header->clusterCnt) {
+        return NULL;
+    }
+
+    const int *range = section<int>(header->rangesOffset) + 2 * ((header->clusterCnt - k) * header->clusterCnt + clusterId);
+    if (range[0] == range[1]) {
+        return NULL;
+    }
+
+    const long long *clusterOffsets = section<long long>(header->clusterOffsetsOffset);
+    count = clusterOffsets[range[1]] - clusterOffsets[range[0]];
+    return section<int>(header->faceIdsOffset) + clusterOffsets[range[0]];
+}
+
+static bool writeSection(FILE *fp, unsigned long long& offset, const void *data, unsigned long long len) {
+    static const char zeros[64] = { 0 };
+
+    unsigned long long pos = (unsigned long long) ftell64(fp);
+    unsigned long long padding = (sectionAlignment - pos % sectionAlignment) % sectionAlignment;
+    offset = pos + padding;
+
+    return fwrite(zeros, 1, (size_t) padding, fp) == padding && (len == 0 || fwrite(data, 1, (size_t) len, fp) == len);
+}
+
+bool SegmentationFile::Write(const std::string& fileName, int numberOfFaces, int clusterCnt, const int *labels, const int *merges, const double *mergeCosts) {
+    int mergeCnt = clusterCnt - 2;
+    int levelCnt = clusterCnt - 1;
+
+    // levels[l] maps seed clusters to their cluster at k = clusterCnt - l
+    std::vector<int> levels(levelCnt * clusterCnt);
+    for (int i = 0; i < clusterCnt; ++i) {
+        levels[i] = i;
+    }
+    for (int l = 1; l < levelCnt; ++l) {
+        int clusterNumA = merges[2 * (l - 1)], clusterNumB = merges[2 * (l - 1) + 1];
+        for (int i = 0; i < clusterCnt; ++i) {
+            int c = levels[(l - 1) * clusterCnt + i];
+            levels[l * clusterCnt + i] = c == clusterNumB ? clusterNumA : c;
+        }
+    }
+
+    // merge tree: leaves are seed clusters, node clusterCnt + s is created by merge s
+    std::vector<int> children(2 * mergeCnt), current(clusterCnt);
+    for (int i = 0; i < clusterCnt; ++i) {
+        current[i] = i;
+    }
+    for (int s = 0; s < mergeCnt; ++s) {
+        children[2 * s] = current[merges[2 * s]];
+        children[2 * s + 1] = current[merges[2 * s + 1]];
+        current[merges[2 * s]] = clusterCnt + s;
+    }
+
+    // depth first leaf order keeps every subtree, i.e. every cluster of every level, contiguous
+    std::vector<int> leafOrder, slotOf(clusterCnt), stack;
+    const int *lastLevel = &levels[(levelCnt - 1) * clusterCnt];
+    for (int c = clusterCnt - 1; c >= 0; --c) {
+        if (lastLevel[c] == c) {
+            stack.push_back(current[c]);
+        }
+    }
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        if (node < clusterCnt) {
+            slotOf[node] = (int) leafOrder.size();
+            leafOrder.push_back(node);
+        } else {
+            stack.push_back(children[2 * (node - clusterCnt) + 1]);
+            stack.push_back(children[2 * (node - clusterCnt)]);
+        }
+    }
+
+    std::vector<int> ranges(2 * levelCnt * clusterCnt, 0);
+    for (int l = 0; l < levelCnt; ++l) {
+        int *levelRanges = &ranges[2 * l * clusterCnt];
+        for (int i = 0; i < clusterCnt; ++i) {
+            int c = levels[l * clusterCnt + i];
+            int slot = slotOf[i];
+            if (levelRanges[2 * c] == levelRanges[2 * c + 1]) {
+                levelRanges[2 * c] = slot;
+                levelRanges[2 * c + 1] = slot + 1;
+            } else {
+                levelRanges[2 * c] = slot < levelRanges[2 * c] ? slot : levelRanges[2 * c];
+                levelRanges[2 * c + 1] = slot + 1 > levelRanges[2 * c + 1] ? slot + 1 : levelRanges[2 * c + 1];
+            }
+        }
+    }
+
+    // counting sort of the faces by slot
+    std::vector<long long> clusterOffsets(clusterCnt + 1, 0);
+    for (int i = 0; i < numberOfFaces; ++i) {
+        if (labels[i] >= 0 && labels[i] < clusterCnt) {
+            ++clusterOffsets[slotOf[labels[i]] + 1];
+        }
+    }
+    for (int i = 0; i < clusterCnt; ++i) {
+        clusterOffsets[i + 1] += clusterOffsets[i];
+    }
+    long long labeledFaces = clusterOffsets[clusterCnt];
+    std::vector<int> faceIds(labeledFaces > 0 ? labeledFaces : 1);
+    std::vector<long long> fill(clusterOffsets.begin(), clusterOffsets.end() - 1);
+    for (int i = 0; i < numberOfFaces; ++i) {
+        if (labels[i] >= 0 && labels[i] < clusterCnt) {
+            faceIds[fill[slotOf[labels[i]]]++] = i;
+        }
+    }
+
+    std::vector<SegmentationMerge> mergeRecords(mergeCnt > 0 ? mergeCnt : 1);
+    for (int s = 0; s < mergeCnt; ++s) {
+        mergeRecords[s].kept = merges[2 * s];
+        mergeRecords[s].absorbed = merges[2 * s + 1];
+        mergeRecords[s].cost = mergeCosts ? mergeCosts[s] : 0.0;
+    }
+
+    std::string tmpName = fileName + ".tmp";
+    FILE *fp = fopen(tmpName.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+
+    SegmentationFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, segmentationMagic, sizeof(segmentationMagic));
+    h.version = SEGMENTATION_FILE_VERSION;
+    h.headerSize = sizeof(SegmentationFileHeader);
+    h.numberOfFaces = numberOfFaces;
+    h.labeledFaces = labeledFaces;
+    h.clusterCnt = clusterCnt;
+    h.levelCnt = levelCnt;
+
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1
+        && writeSection(fp, h.labelsOffset, labels, (unsigned long long) numberOfFaces * sizeof(int))
+        && writeSection(fp, h.leafOrderOffset, &leafOrder[0], clusterCnt * sizeof(int))
+        && writeSection(fp, h.clusterOffsetsOffset, &clusterOffsets[0], (clusterCnt + 1) * sizeof(long long))
+        && writeSection(fp, h.faceIdsOffset, &faceIds[0], labeledFaces * sizeof(int))
+        && writeSection(fp, h.mergesOffset, &mergeRecords[0], mergeCnt * sizeof(SegmentationMerge))
+        && writeSection(fp, h.levelsOffset, &levels[0], levels.size() * sizeof(int))
+        && writeSection(fp, h.rangesOffset, &ranges[0], ranges.size() * sizeof(int));
+
+    h.fileSize = (unsigned long long) ftell64(fp);
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (ok) {
+        remove(fileName.c_str());
+        ok = rename(tmpName.c_str(), fileName.c_str()) == 0;
+    }
+    if (!ok) {
+        remove(tmpName.c_str());
+    }
+
+    return ok;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+
+#include "MappedFile.h"
+
+#define SEGMENTATION_FILE_VERSION 1
+
+struct SegmentationMerge {
+    int kept;
+    int absorbed;
+    double cost;
+};
+
+// Fixed size header of a .seg file, followed by 64 byte aligned sections:
+//   labels         int[numberOfFaces]           seed cluster of each face, -1 if unlabeled
+//   leafOrder      int[clusterCnt]              seed cluster stored at each slot
+//   clusterOffsets long long[clusterCnt + 1]    range of each slot in faceIds
+//   faceIds        int[labeledFaces]            face ids grouped by slot
+//   merges         SegmentationMerge[clusterCnt - 2]
+//   levels         int[levelCnt][clusterCnt]    cluster of each seed cluster at each level
+//   ranges         int[levelCnt][clusterCnt][2] slot range of each cluster at each level
+// Slots follow the leaf order of the merge tree, so every cluster of every level
+// owns one contiguous run of faceIds.
+struct SegmentationFileHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int headerSize;
+    long long numberOfFaces;
+    long long labeledFaces;
+    int clusterCnt;
+    int levelCnt;
+    unsigned long long labelsOffset;
+    unsigned long long leafOrderOffset;
+    unsigned long long clusterOffsetsOffset;
+    unsigned long long faceIdsOffset;
+    unsigned long long mergesOffset;
+    unsigned long long levelsOffset;
+    unsigned long long rangesOffset;
+    unsigned long long fileSize;
+};
+
+// Read side maps the file and hands out pointers into it; nothing is copied.
+// Levels are addressed by their cluster count k, from clusterCnt down to 2.
+class SegmentationFile {
+private:
+    MappedFile file;
+    const SegmentationFileHeader *header;
+
+public:
+    SegmentationFile() : header(NULL) {}
+
+    bool Open(const std::string& fileName);
+
+    int NumberOfFaces() { return (int) header->numberOfFaces; }
+    int ClusterCount() { return header->clusterCnt; }
+
+    const int* Labels();
+    const SegmentationMerge* Merges();
+
+    // maps each seed cluster to its cluster id at level k
+    const int* GetLevel(int k);
+    int GetLabel(int k, int faceId);
+
+    // faces of cluster clusterId at level k, NULL if no such cluster exists at that level
+    const int* GetClusterFaces(int k, int clusterId, long long& count);
+
+    // labels are seed clusters per face, merges the (kept, absorbed) pair of each step
+    static bool Write(const std::string& fileName, int numberOfFaces, int clusterCnt, const int *labels, const int *merges, const double *mergeCosts);
+
+private:
+    template <class T>
+    const T* section(unsigned long long offset) {
+        return (const T *) (file.Data() + offset);
+    }
+};
\ No newline at end of file
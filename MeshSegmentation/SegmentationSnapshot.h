@@ -0,0 +1,32 @@
+#pragma once
+
+// One complete segmentation handed from the pipeline thread to the viewer: a cluster
+// per face, -1 for none, and the seedCnt - 2 merge steps down to two clusters as the
+// cache stores them. Whoever receives a snapshot owns it.
+class SegmentationSnapshot {
+public:
+    int seedCnt;
+    int *labels;
+    int *merges;
+    double *mergeCosts;
+    // the last and best one of a run
+    bool isFinal;
+
+    SegmentationSnapshot(int numberOfFaces, int seedCnt) : seedCnt(seedCnt), isFinal(false) {
+        labels = new int[numberOfFaces];
+        merges = new int[2 * (seedCnt - 2)];
+        mergeCosts = new double[seedCnt - 2];
+    }
+
+    ~SegmentationSnapshot() {
+        delete[] labels;
+        delete[] merges;
+        delete[] mergeCosts;
+    }
+
+private:
+    SegmentationSnapshot(const SegmentationSnapshot&);
+    void operator = (const SegmentationSnapshot&);
+};
+
+typedef void (*SnapshotCallback)(void *data, SegmentationSnapshot *snapshot);
\ No newline at end of file
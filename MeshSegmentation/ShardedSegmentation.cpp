@@ -0,0 +1,380 @@
+#include "ShardedSegmentation.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "ChunkedSegmentation.h"
+#include "EngineTraits.h"
+#include "IndexedHeap.h"
+#include "SegmentationCache.h"
+#include "Trace.h"
+
+using namespace std;
+
+enum ShardCommand { SHARD_ROUND = 1, SHARD_FINISH = 2 };
+
+// the best known center of one face, by its id in the whole graph
+struct shardUpdate {
+    int face;
+    int label;
+    double distance;
+};
+
+#ifdef __linux__
+
+static bool writeAll(int fd, const void *data, size_t len) {
+    const char *p = (const char *) data;
+    while (len > 0) {
+        // a worker that died must not take the coordinator down with SIGPIPE
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void *data, size_t len) {
+    char *p = (char *) data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+// element count first, then the elements
+template <class T>
+static bool writeArray(int fd, const T *data, int cnt) {
+    return writeAll(fd, &cnt, sizeof(int)) && (cnt == 0 || writeAll(fd, data, cnt * sizeof(T)));
+}
+
+template <class T>
+static bool readArray(int fd, vector<T>& data) {
+    int cnt;
+    if (!readAll(fd, &cnt, sizeof(int)) || cnt < 0) {
+        return false;
+    }
+    data.resize(cnt);
+    return cnt == 0 || readAll(fd, &data[0], cnt * sizeof(T));
+}
+
+#endif
+
+// Shard side of the exchange: a multi-source Dijkstra that resumes every round with
+// the ghost faces that improved, ordered by distance, then label. The shard is cut out
+// of the mapped graph file by the worker itself, only its own faces are kept.
+class shardWorker {
+private:
+    typedef Engine::Distance Distance;
+    typedef pair<Distance, int> QueueKey;
+
+    vector<int> offsets, neighbors;
+    vector<Distance> weights;
+    vector<Distance> distances;
+    vector<int> labels;
+    vector<char> dirty;
+    IndexedHeap<QueueKey> queue;
+    vector<int> globalIds;              // core first, then the ghosts
+    unordered_map<int, int> localIds;
+    vector<int> boundary;               // core faces that are ghosts of another shard
+
+public:
+    int coreCnt;
+
+    bool Setup(int fd) {
+#ifdef __linux__
+        vector<char> fileName;
+        int chunkFaces, shard;
+        vector<int> centers;
+        if (!readArray(fd, fileName) || !readAll(fd, &chunkFaces, sizeof(int)) || !readAll(fd, &shard, sizeof(int)) || !readArray(fd, centers)) {
+            return false;
+        }
+        DualGraph *graph = SegmentationCache::LoadGraphFile(string(fileName.begin(), fileName.end()));
+        if (!graph) {
+            return false;
+        }
+
+        // the same cuts as the coordinator's, they only depend on the graph
+        GraphChunks chunks(graph, chunkFaces);
+        vector<int> core;
+        chunks.Faces(graph, shard, NULL, core);
+        DualGraph *local = GraphChunks::Extract(graph, core, 1, globalIds, localIds);
+        coreCnt = (int) core.size();
+        int localCnt = local->numberOfFaces;
+        int slotCnt = 2 * local->numberOfEdges;
+        offsets.assign(local->offsets, local->offsets + localCnt + 1);
+        neighbors.assign(local->neighbors, local->neighbors + slotCnt);
+        weights.resize(slotCnt);
+        for (int k = 0; k < slotCnt; ++k) {
+            weights[k] = (Distance) local->weights[local->edgeIds[k]];
+        }
+        delete local;
+        delete graph;
+
+        for (int i = 0; i < coreCnt; ++i) {
+            for (int k = offsets[i]; k < offsets[i + 1]; ++k) {
+                if (neighbors[k] >= coreCnt) {
+                    boundary.push_back(i);
+                    break;
+                }
+            }
+        }
+
+        distances.assign(localCnt, Engine::Infinity());
+        labels.assign(localCnt, -1);
+        dirty.assign(localCnt, 0);
+        queue.Reserve(localCnt);
+        for (size_t c = 0; c < centers.size(); ++c) {
+            unordered_map<int, int>::iterator it = localIds.find(centers[c]);
+            if (it != localIds.end()) {
+                offer(it->second, 0, (int) c);
+            }
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void Apply(const vector<shardUpdate>& updates) {
+        for (size_t i = 0; i < updates.size(); ++i) {
+            unordered_map<int, int>::iterator it = localIds.find(updates[i].face);
+            if (it != localIds.end()) {
+                offer(it->second, (Distance) updates[i].distance, updates[i].label);
+            }
+        }
+    }
+
+    void Run() {
+        while (!queue.Empty()) {
+            int u = queue.Pop();
+            for (int k = offsets[u]; k < offsets[u + 1]; ++k) {
+                offer(neighbors[k], distances[u] + weights[k], labels[u]);
+            }
+        }
+    }
+
+    // border faces that changed since the last call
+    void Collect(vector<shardUpdate>& updates) {
+        updates.clear();
+        for (size_t i = 0; i < boundary.size(); ++i) {
+            int face = boundary[i];
+            if (dirty[face]) {
+                shardUpdate update = { globalIds[face], labels[face], (double) distances[face] };
+                updates.push_back(update);
+                dirty[face] = 0;
+            }
+        }
+    }
+
+    // labels of the core faces, along the curve
+    const int* Labels() const { return labels.empty() ? NULL : &labels[0]; }
+
+private:
+    void offer(int face, Distance distance, int label) {
+        // -1 compares above every label
+        if (distance < distances[face] || (distance == distances[face] && (unsigned) label < (unsigned) labels[face])) {
+            distances[face] = distance;
+            labels[face] = label;
+            dirty[face] = 1;
+            if (queue.Contains(face)) {
+                queue.DecreaseKey(face, QueueKey(distance, label));
+            } else {
+                queue.Push(face, QueueKey(distance, label));
+            }
+        }
+    }
+};
+
+int RunShardWorker(int fd) {
+#ifdef __linux__
+    shardWorker worker;
+    if (!worker.Setup(fd)) {
+        return 1;
+    }
+
+    vector<shardUpdate> updates;
+    while (true) {
+        int command;
+        if (!readAll(fd, &command, sizeof(int))) {
+            return 1;
+        }
+        if (command == SHARD_FINISH) {
+            return writeArray(fd, worker.Labels(), worker.coreCnt) ? 0 : 1;
+        }
+        if (!readArray(fd, updates)) {
+            return 1;
+        }
+        worker.Apply(updates);
+        worker.Run();
+        worker.Collect(updates);
+        if (!writeArray(fd, updates.empty() ? NULL : &updates[0], (int) updates.size())) {
+            return 1;
+        }
+    }
+#else
+    (void) fd;
+    return 1;
+#endif
+}
+
+#ifdef __linux__
+
+// fork and exec this executable as a worker on one end of a socket pair
+static pid_t launchWorker(int& fd) {
+    int ends[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) {
+        return -1;
+    }
+    // the coordinator end must not leak into the workers launched after this one
+    fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+
+    char fdArg[16];
+    snprintf(fdArg, sizeof(fdArg), "%d", ends[1]);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/proc/self/exe", "MeshSegmentation", "--shard-worker", fdArg, (char *) NULL);
+        _exit(127);
+    }
+    close(ends[1]);
+    if (pid < 0) {
+        close(ends[0]);
+        return -1;
+    }
+    fd = ends[0];
+    return pid;
+}
+
+static void stopWorkers(vector<int>& fds, vector<pid_t>& pids, bool kill) {
+    for (size_t s = 0; s < pids.size(); ++s) {
+        if (fds[s] >= 0) {
+            close(fds[s]);
+        }
+        if (pids[s] > 0) {
+            if (kill) {
+                ::kill(pids[s], SIGTERM);
+            }
+            waitpid(pids[s], NULL, 0);
+        }
+    }
+}
+
+bool AssignSharded(const DualGraph *graph, const string& graphFileName, int shardCnt, const int *centerIds, int centerCnt, int *labels) {
+    // labels hold the shard of every face as its mark until the shard reports back
+    int numberOfFaces = graph->numberOfFaces;
+    int chunkFaces = (numberOfFaces + shardCnt - 1) / shardCnt;
+    GraphChunks chunks(graph, chunkFaces);
+    shardCnt = chunks.Count();
+    vector<int> shardSizes;
+    chunks.MarkFaces(graph, labels, shardSizes);
+
+    vector<int> fds(shardCnt, -1);
+    vector<pid_t> pids(shardCnt, -1);
+    for (int s = 0; s < shardCnt; ++s) {
+        pids[s] = launchWorker(fds[s]);
+        if (pids[s] < 0) {
+            printf("could not start shard worker %d\n", s);
+            stopWorkers(fds, pids, true);
+            return false;
+        }
+    }
+
+    // every worker maps the graph file and cuts its shard out of it
+    Trace::Begin("shard_setup");
+    bool ok = true;
+    for (int s = 0; s < shardCnt && ok; ++s) {
+        ok = writeArray(fds[s], graphFileName.c_str(), (int) graphFileName.size()) && writeAll(fds[s], &chunkFaces, sizeof(int))
+            && writeAll(fds[s], &s, sizeof(int)) && writeArray(fds[s], centerIds, centerCnt);
+    }
+    Trace::End();
+
+    // every round carries the border changes of the last one to the shards that hold
+    // the face as a ghost, those of its neighbors
+    vector< vector<shardUpdate> > inbox(shardCnt);
+    vector<shardUpdate> reply;
+    vector<int> targets;
+    int rounds = 0;
+    long long messages = 0;
+    bool changed = true;
+    while (ok && changed) {
+        TraceScope trace("shard_round", "pipeline", rounds);
+        int command = SHARD_ROUND;
+        for (int s = 0; s < shardCnt && ok; ++s) {
+            ok = writeAll(fds[s], &command, sizeof(int)) && writeArray(fds[s], inbox[s].empty() ? NULL : &inbox[s][0], (int) inbox[s].size());
+            inbox[s].clear();
+        }
+
+        changed = false;
+        for (int s = 0; s < shardCnt && ok; ++s) {
+            ok = readArray(fds[s], reply);
+            for (size_t i = 0; ok && i < reply.size(); ++i) {
+                int face = reply[i].face;
+                if (face < 0 || face >= numberOfFaces) {
+                    ok = false;
+                    break;
+                }
+                targets.clear();
+                for (int k = graph->offsets[face]; k < graph->offsets[face + 1]; ++k) {
+                    int t = -2 - labels[graph->neighbors[k]];
+                    if (t != s && find(targets.begin(), targets.end(), t) == targets.end()) {
+                        targets.push_back(t);
+                        inbox[t].push_back(reply[i]);
+                        changed = true;
+                        ++messages;
+                    }
+                }
+            }
+        }
+        ++rounds;
+    }
+
+    // the core of a shard comes back in the order Faces lists it
+    vector<int> core, coreLabels;
+    for (int s = 0; s < shardCnt && ok; ++s) {
+        int command = SHARD_FINISH;
+        ok = writeAll(fds[s], &command, sizeof(int)) && readArray(fds[s], coreLabels);
+        chunks.Faces(graph, s, labels, core);
+        ok = ok && coreLabels.size() == core.size();
+        for (size_t i = 0; ok && i < core.size(); ++i) {
+            labels[core[i]] = coreLabels[i];
+        }
+    }
+    stopWorkers(fds, pids, !ok);
+
+    if (!ok) {
+        printf("a shard worker failed\n");
+        return false;
+    }
+    printf("sharded : %d workers, %d rounds, %lld ghost updates\n", shardCnt, rounds, messages);
+    return true;
+}
+
+#else
+
+bool AssignSharded(const DualGraph *graph, const string& graphFileName, int shardCnt, const int *centerIds, int centerCnt, int *labels) {
+    printf("sharded segmentation needs Linux\n");
+    return false;
+}
+
+#endif
\ No newline at end of file
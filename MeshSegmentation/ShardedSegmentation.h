@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+#include "DualGraph.h"
+
+// Steps 3.2 and 3.3 spread over shardCnt worker processes on this machine. The dual
+// graph is cut into Hilbert-ordered shards (see GraphChunks); every worker maps the
+// graph from graphFileName, a file written by SegmentationCache that must hold graph,
+// and copies out its shard plus one ring of ghost faces owned by its neighbors. Workers
+// run a multi-source Dijkstra ordered by distance, then label, and report the faces
+// along their border by their ids in graph; the coordinator forwards the changes to the
+// shards of their neighbors and runs another round until nothing changes. The fixed
+// point is the nearest center of every face with the lowest label on ties, the same
+// labels the single process path yields. Apart from labels, which marks the shard of
+// every face meanwhile, the coordinator only holds the updates of a round.
+// labels[numberOfFaces] receives the label of every face, -1 where no center reaches.
+// Returns false when the workers cannot be started or one of them fails, labels are
+// then incomplete. Workers are this executable started again, so this needs Linux.
+bool AssignSharded(const DualGraph *graph, const std::string& graphFileName, int shardCnt, const int *centerIds, int centerCnt, int *labels);
+
+// entry point of a worker process, fd is its end of the coordinator socket
+int RunShardWorker(int fd);
\ No newline at end of file
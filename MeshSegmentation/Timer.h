@@ -0,0 +1,34 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+// Wall-clock time in seconds. clock() counts CPU time of the whole process,
+// which adds up across the worker threads and overstates parallel stages.
+class WallTimer {
+private:
+    double begin;
+
+public:
+    WallTimer() { Start(); }
+
+    void Start() { begin = Now(); }
+    double Elapsed() { return Now() - begin; }
+
+    static double Now() {
+#ifdef _WIN32
+        LARGE_INTEGER counter, frequency;
+        QueryPerformanceCounter(&counter);
+        QueryPerformanceFrequency(&frequency);
+        return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+};
\ No newline at end of file
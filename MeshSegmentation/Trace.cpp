@@ -0,0 +1,154 @@
+#include "Trace.h"
+#include "Timer.h"
+
+#include <stdio.h>
+
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    char phase;
+    int arg;
+    double timestamp;
+    double value;
+};
+
+struct TraceThread {
+    int tid;
+    const char *name;
+    vector<TraceEvent> events;
+    vector<size_t> openSpans;
+};
+
+bool Trace::enabled = false;
+
+// thread buffers live until the process exits, the pool threads of async come and go
+static mutex registryMutex;
+static vector<TraceThread*> registry;
+static double origin = 0;
+static TRACE_THREAD_LOCAL TraceThread *localThread = NULL;
+
+static TraceThread* currentThread() {
+    if (!localThread) {
+        TraceThread *thread = new TraceThread;
+        thread->name = "worker";
+        thread->events.reserve(1024);
+
+        lock_guard<mutex> lock(registryMutex);
+        thread->tid = (int) registry.size() + 1;
+        registry.push_back(thread);
+        localThread = thread;
+    }
+    return localThread;
+}
+
+static inline double now() {
+    return (WallTimer::Now() - origin) * 1e6;
+}
+
+void Trace::Enable(bool enable) {
+    if (enable && !enabled) {
+        origin = WallTimer::Now();
+    }
+    enabled = enable;
+}
+
+void Trace::Begin(const char *name, const char *category, int arg) {
+    if (!enabled) {
+        return;
+    }
+    TraceThread *thread = currentThread();
+    TraceEvent event = { name, category, 'X', arg, now(), 0 };
+    thread->openSpans.push_back(thread->events.size());
+    thread->events.push_back(event);
+}
+
+void Trace::End() {
+    TraceThread *thread = localThread;
+    if (!thread || thread->openSpans.empty()) {
+        return;
+    }
+    TraceEvent& event = thread->events[thread->openSpans.back()];
+    thread->openSpans.pop_back();
+    event.value = now() - event.timestamp;
+}
+
+void Trace::Counter(const char *name, double value) {
+    if (!enabled) {
+        return;
+    }
+    TraceEvent event = { name, "counter", 'C', -1, now(), value };
+    currentThread()->events.push_back(event);
+}
+
+void Trace::Instant(const char *name, const char *category) {
+    if (!enabled) {
+        return;
+    }
+    TraceEvent event = { name, category, 'i', -1, now(), 0 };
+    currentThread()->events.push_back(event);
+}
+
+void Trace::SetThreadName(const char *name) {
+    currentThread()->name = name;
+}
+
+bool Trace::Write(const string& fileName) {
+    FILE *fp = fopen(fileName.c_str(), "w");
+    if (!fp) {
+        return false;
+    }
+
+    lock_guard<mutex> lock(registryMutex);
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t t = 0; t < registry.size(); ++t) {
+        const TraceThread *thread = registry[t];
+        if (thread->events.empty()) {
+            continue;
+        }
+
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", thread->tid, thread->name);
+        first = false;
+
+        for (size_t i = 0; i < thread->events.size(); ++i) {
+            const TraceEvent& event = thread->events[i];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+                event.name, event.category, event.phase, thread->tid, event.timestamp);
+            if (event.phase == 'X') {
+                fprintf(fp, ",\"dur\":%.3f", event.value);
+                if (event.arg >= 0) {
+                    fprintf(fp, ",\"args\":{\"id\":%d}", event.arg);
+                }
+            } else if (event.phase == 'C') {
+                fprintf(fp, ",\"args\":{\"value\":%.17g}", event.value);
+            } else {
+                fprintf(fp, ",\"s\":\"t\"");
+            }
+            fprintf(fp, "}");
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    return fclose(fp) == 0;
+}
+
+void Trace::Clear() {
+    lock_guard<mutex> lock(registryMutex);
+    for (size_t t = 0; t < registry.size(); ++t) {
+        registry[t]->events.clear();
+        registry[t]->openSpans.clear();
+    }
+    origin = WallTimer::Now();
+}
\ No newline at end of file
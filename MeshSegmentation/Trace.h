@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+
+// Records nested spans, counters and instant events per thread and writes them in
+// the Chrome trace event format, which chrome://tracing and ui.perfetto.dev open.
+// Every thread appends to its own buffer so nothing is locked while recording, and
+// a disabled trace costs one branch per span. Names and categories must be string
+// literals, only the pointers are stored.
+class Trace {
+private:
+    static bool enabled;
+
+public:
+    static void Enable(bool enable);
+    static bool IsEnabled() { return enabled; }
+
+    // spans nest per thread; arg >= 0 is shown as args.id
+    static void Begin(const char *name, const char *category = "pipeline", int arg = -1);
+    static void End();
+    static void Counter(const char *name, double value);
+    static void Instant(const char *name, const char *category = "ui");
+    static void SetThreadName(const char *name);
+
+    // must not race with threads that are still recording
+    static bool Write(const std::string& fileName);
+    static void Clear();
+};
+
+class TraceScope {
+private:
+    bool active;
+
+public:
+    TraceScope(const char *name, const char *category = "pipeline", int arg = -1) : active(Trace::IsEnabled()) {
+        if (active) {
+            Trace::Begin(name, category, arg);
+        }
+    }
+
+    ~TraceScope() {
+        if (active) {
+            Trace::End();
+        }
+    }
+
+private:
+    TraceScope(const TraceScope&);
+    void operator = (const TraceScope&);
+};
\ No newline at end of file
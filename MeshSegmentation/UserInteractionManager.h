@@ -26,37 +26,74 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+#include <atomic>
 #include <future>
 #include <set>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "ChunkedSegmentation.h"
+#include "ClusterMeshExporter.h"
+#include "ConnectedComponents.h"
 #include "DisjointSet.h"
+#include "DistanceField.h"
+#include "DualGraph.h"
+#include "FaceOrdering.h"
+#include "IncrementalUpdate.h"
+#include "IndexedHeap.h"
 #include "List.h"
-#include "MinHeap.h"
+#include "MemoryTracker.h"
+#include "Multilevel.h"
+#include "NearestCenter.h"
+#include "PerfCounters.h"
+#include "Progress.h"
+#include "RegionGrowing.h"
+#include "SeedSampling.h"
+#include "SegmentationCache.h"
+#include "SegmentationFile.h"
+#include "SegmentationSnapshot.h"
+#include "ShardedSegmentation.h"
+#include "Timer.h"
+#include "Trace.h"
 #include "Utils.h"
 #include "vtkConvertToDualGraph.h"
 
 using namespace std;
 
-typedef pair<vtkIdType, double> heapElem;
-
 const double goldenRatio = 0.618033988749895;
 
-class heapElemComp {
-public:
-    bool operator() (const heapElem& A, const heapElem& B) {
-        return A.second < B.second || (A.second == B.second && A.first < B.first);
-    }
+enum ClusterStatus { STATUS_NONE, STATUS_SELECT, STATUS_ACTIVE };
+
+// D1, L1 and dual edge count of the border of one pair of clusters
+struct borderTotals {
+    double D, L, cnt;
+    borderTotals() : D(0.0), L(0.0), cnt(0.0) {}
 };
 
-enum ClusterStatus { STATUS_NONE, STATUS_SELECT, STATUS_ACTIVE };
+// D1, L1, D2, L2 and merge cost of a pair of clusters, a row of the pair table of
+// mergeBorders
+struct mergeValues {
+    double D, L, D2, L2, cost;
+};
+
+// edges below which computeBorderSums does not start another thread
+const int borderEdgesPerThread = 1 << 16;
+
+// faces below which assignComponents batches components into one task
+const int componentBatchFaces = 1 << 14;
 
 class UserInteractionManager {
 private:
     vtkSmartPointer<vtkPolyData> Data;
     int numberOfFaces;
     
+    // set once the faces were reordered, see ReorderFaces
+    int *originalFaceIds;
+    int *reorderedFaceIds;
+
     int clusterCnt;
     int *clusterStatuses;
     unsigned char **clusterColors;
@@ -64,10 +101,38 @@ private:
     int *faceIdToClusterMap;
     vtkSmartPointer<vtkIdTypeArray> *clusterFaceIds;
     vtkSmartPointer<vtkUnsignedCharArray> faceColors;
-    vtkSmartPointer<vtkMutableUndirectedGraph> g;
-    vtkSmartPointer<vtkDoubleArray> centers;
-    vtkSmartPointer<vtkDoubleArray> meshDis;
+    DualGraph *dualGraph;
+    GraphComponents *components;
+    SegmentationCache *cache;
+    bool useCache;
+    int randomSeed;
+    SeedMode seedMode;
+    long long memoryBudget;
+    WeightParameters weightParameters;
+    int multilevelFaces;
+    int multilevelBand;
+    int multilevelClusterFaces;
+    int progressiveFaces;
+    MultilevelHierarchy *hierarchy;
+    bool vertexMode;
+    DualGraph *vertexGraph;
+    int *faceVertices;
+    int outOfCoreFaces;
+    int outOfCoreHalo;
+    int shardCnt;
+    double regionThreshold;
+    bool deferRendering;
+
+    // kept from the last assignment for UpdateFaces
+    int *centerFaceIds;
+    Engine::Distance *nearestDis;
+    double *borderSums;
+    int borderSeedCnt;
+    DualGraphPatcher *patcher;
     int **clusterSteps;
+    int *clusterMerges;
+    double *clusterMergeCosts;
+    PerfCounters dijkstraCounters;
 
 public:
     UserInteractionManager() {}
@@ -76,9 +141,35 @@ public:
         this->Data = Data;
 
         numberOfFaces = Data->GetNumberOfCells();
+        originalFaceIds = NULL;
+        reorderedFaceIds = NULL;
 
         clusterCnt = 64;
-        g = NULL;
+        dualGraph = NULL;
+        components = NULL;
+        cache = NULL;
+        useCache = true;
+        randomSeed = -1;
+        seedMode = SEED_RANDOM;
+        memoryBudget = 0;
+        multilevelFaces = 0;
+        multilevelBand = 4;
+        multilevelClusterFaces = 16;
+        progressiveFaces = 0;
+        hierarchy = NULL;
+        vertexMode = false;
+        vertexGraph = NULL;
+        faceVertices = NULL;
+        outOfCoreFaces = 0;
+        outOfCoreHalo = 16;
+        shardCnt = 0;
+        regionThreshold = 0.0;
+        deferRendering = false;
+        centerFaceIds = NULL;
+        nearestDis = NULL;
+        borderSums = NULL;
+        borderSeedCnt = 0;
+        patcher = NULL;
 
         double h, s, v;
         h = goldenRatio * 8 - 4;
@@ -105,6 +196,8 @@ public:
         }
 
         clusterSteps = NULL;
+        clusterMerges = NULL;
+        clusterMergeCosts = NULL;
 
         faceColors = vtkSmartPointer<vtkUnsignedCharArray>::New();
         faceColors->SetNumberOfComponents(4);
@@ -136,6 +229,8 @@ public:
         delete[] clusterStatuses;
         delete[] clusterFaceIds;
         delete[] faceIdToClusterMap;
+        delete[] originalFaceIds;
+        delete[] reorderedFaceIds;
 
         if (clusterSteps) {
             for (int i = 0; i < clusterCnt; ++i) {
@@ -143,9 +238,21 @@ public:
             }
             delete[] clusterSteps;
         }
+        delete[] clusterMerges;
+        delete[] clusterMergeCosts;
+        delete hierarchy;
+        releaseVertexGraph();
+        delete patcher;
+        delete[] centerFaceIds;
+        releaseNearestDistances();
+        releaseBorderSums();
+        delete components;
+        delete dualGraph;
+        delete cache;
     }
 
     void SetClusterStep(int seedCnt, int k, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
+        TraceScope trace("set_cluster_step", "ui", k);
         colorHashMap.clear();
 
         int cnt = 0;
@@ -165,10 +272,13 @@ public:
         }
         Data->GetCellData()->RemoveArray("Colors");
         Data->GetCellData()->SetScalars(faceColors);
-        interactor->GetRenderWindow()->Render();
+        if (interactor) {
+            interactor->GetRenderWindow()->Render();
+        }
     }
 
     void ConfirmClusterSegmentation(int seedCnt, int k) {
+        TraceScope trace("confirm_clusters", "ui", k);
         for (int i = 0; i < seedCnt; ++i) {
             int clusterId = clusterSteps[seedCnt - k][i];
 
@@ -188,6 +298,7 @@ public:
     }
 
     void ManualMergeClusters(int beginClusterId, int endClusterId, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
+        TraceScope trace("manual_merge", "ui", endClusterId);
         for (int i = 0; i < clusterFaceIds[endClusterId]->GetNumberOfTuples(); ++i) {
             int faceId = clusterFaceIds[endClusterId]->GetValue(i);
             clusterFaceIds[beginClusterId]->InsertNextValue(faceId);
@@ -198,263 +309,1370 @@ public:
         highlightFace(interactor, clusterFaceIds[beginClusterId], clusterColors[colorHashMap[beginClusterId]]);
     }
 
+    // benchmarks turn the cache off and pin the seed so runs are comparable
+    void SetCacheEnabled(bool enabled) { useCache = enabled; }
+    void SetRandomSeed(int seed) { randomSeed = seed; }
+
+    // How AutomaticSelectSeeds spreads the seeds, see SeedSampler; the sampled modes
+    // are deterministic and drawn with the random seed, or 0 when there is none
+    void SetSeedMode(SeedMode mode) { seedMode = mode; }
+    SeedMode GetSeedMode() { return seedMode; }
+
+    // Steps 3.2 and 3.3 run on the mesh vertices, about half as many nodes as faces,
+    // and every face takes the label most of its corners have; see assignVertices.
+    // Only for triangle meshes, others keep to the faces. The first UpdateFaces after
+    // it assigns the faces exactly, as after a multilevel run.
+    void SetVertexGraph(bool enabled) { vertexMode = enabled; }
+    bool GetVertexGraph() { return vertexMode; }
+
+    // bytes the tracked buffers may use, 0 for no limit; see getDistanceBatchSize
+    void SetMemoryBudget(long long bytes) { memoryBudget = bytes; }
+
+    // policy the dual edge weights are built with, see WeightPolicies.h; they are part
+    // of the cache key, so this has to come before segmenting
+    void SetWeights(const WeightParameters& weights) {
+        if (dualGraph) {
+            cout << "Edge weights can only be changed before segmenting" << endl;
+            return;
+        }
+        weightParameters = weights;
+        delete cache;
+        cache = NULL;
+    }
+
+    // Renumbers the faces of the mesh for memory locality, before anything is built
+    // on it. Every array of the engine, the cache and the picked ids use the new
+    // order; seeds are drawn and saved segmentations written in the original one.
+    void ReorderFaces(FaceOrder order) {
+        if (order == FACE_ORDER_NONE) {
+            return;
+        }
+        if (dualGraph || clusterMerges) {
+            cout << "Faces can only be reordered before segmenting" << endl;
+            return;
+        }
+
+        TraceScope trace("reorder_faces", "pipeline", (int) order);
+        int *newToOld = FaceOrdering::Compute(Data, order);
+        if (!newToOld) {
+            cout << "Face reordering needs a triangle mesh" << endl;
+            return;
+        }
+        FaceOrdering::Apply(Data, newToOld);
+
+        if (originalFaceIds) {
+            for (int i = 0; i < numberOfFaces; ++i) {
+                newToOld[i] = originalFaceIds[newToOld[i]];
+            }
+            delete[] originalFaceIds;
+        }
+        originalFaceIds = newToOld;
+
+        delete[] reorderedFaceIds;
+        reorderedFaceIds = new int[numberOfFaces];
+        for (int i = 0; i < numberOfFaces; ++i) {
+            reorderedFaceIds[originalFaceIds[i]] = i;
+        }
+    }
+
+    // Meshes above coarseFaces faces run steps 3.2 and 3.3 on a coarsened dual graph
+    // and refine cluster borders on the way back, 0 always uses the full graph. The
+    // coarse graph keeps at least 16 faces per cluster, see coarseTarget.
+    void SetMultilevel(int coarseFaces) { multilevelFaces = coarseFaces; }
+
+    // Above 0, steps 3 and 4 run as SegmentProgressively with a first labeling from a
+    // graph coarsened to that size, or to the multilevel size when that is set
+    void SetProgressive(int coarseFaces) { progressiveFaces = coarseFaces; }
+    int GetProgressive() { return progressiveFaces; }
+
+    // Meshes above chunkFaces faces are segmented chunk by chunk with only one chunk
+    // graph and its distance fields resident, the dual graph itself is read from the
+    // cache file mapping; 0 segments the whole mesh at once
+    void SetOutOfCore(int chunkFaces) { outOfCoreFaces = chunkFaces; }
+
+    // More than one shard runs steps 3.2 and 3.3 in that many worker processes with
+    // the same labels as in process, see AssignSharded; Linux only
+    void SetShards(int count) { shardCnt = count; }
+
+    // Above 0, steps 3.1 to 3.3 grow regions over the dual graph up to edges of that
+    // many times the mean weight, see GrowRegions, and merge them down to the cluster
+    // count by the cost of step 4; AutomaticSelectSeeds draws no seeds then, and no
+    // distance tables or progressive snapshots are used either
+    void SetRegionGrowing(double threshold) { regionThreshold = threshold; }
+    double GetRegionGrowing() { return regionThreshold; }
+
+    // Step 3.5 leaves the face colors alone, for a pipeline running off the thread
+    // that renders; RenderClusters shows the result once it is handed over
+    void SetDeferRendering(bool defer) { deferRendering = defer; }
+
+    void RenderClusters(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) { renderClusters(interactor); }
+
+    // Back to the seeded state before step 2, after a cancelled run left the clusters
+    // half built; the dual graph is kept
+    void ResetSegmentation() {
+        TraceScope trace("reset_segmentation");
+        for (int i = 0; i <= clusterCnt; ++i) {
+            vtkSmartPointer<vtkIdTypeArray> clusterFaceId = vtkSmartPointer<vtkIdTypeArray>::New();
+            clusterFaceId->SetNumberOfComponents(1);
+            clusterFaceIds[i] = clusterFaceId;
+            clusterStatuses[i] = STATUS_NONE;
+        }
+        for (int i = 0; i < numberOfFaces; ++i) {
+            faceIdToClusterMap[i] = -1;
+        }
+        delete[] clusterMerges;
+        delete[] clusterMergeCosts;
+        clusterMerges = NULL;
+        clusterMergeCosts = NULL;
+        releaseNearestDistances();
+        releaseBorderSums();
+        delete[] centerFaceIds;
+        centerFaceIds = NULL;
+    }
+
+    // counters of the last step 3.2, the shortest path tables alone
+    PerfCounters& GetDijkstraCounters() { return dijkstraCounters; }
+
+    // the cluster of every face after StartSegmentation, -1 where there is none
+    const int* GetFaceLabels() { return faceIdToClusterMap; }
+
     void ConvertPolydataToDualGraph() {
-        vtkSmartPointer<vtkConvertToDualGraph> convert = vtkSmartPointer<vtkConvertToDualGraph>::New();
-        convert->SetInputData(Data);
-        convert->Update();
+        if (dualGraph) {
+            return;
+        }
+
+        Trace::Begin("cache_load_graph");
+        dualGraph = useCache ? getCache()->LoadGraph() : NULL;
+        Trace::End();
+        if (dualGraph) {
+            cout << "dual graph loaded from cache" << endl;
+        } else if (streamGraph()) {
+            // out of core or sharded the graph goes straight into the cache file and is
+            // paged in from there, the file backs this run even with the cache off
+            Trace::Begin("stream_dual_graph");
+            if (getCache()->BuildGraph(Data, weightParameters)) {
+                dualGraph = cache->LoadGraph();
+            }
+            Trace::End();
+        }
+        if (!dualGraph) {
+            vtkSmartPointer<vtkConvertToDualGraph> convert = vtkSmartPointer<vtkConvertToDualGraph>::New();
+            convert->SetInputData(Data);
+            convert->SetWeightParameters(weightParameters);
+            Trace::Begin("build_dual_graph");
+            convert->Update();
+            Trace::End();
+
+            Trace::Begin("flatten_dual_graph");
+            dualGraph = DualGraph::FromGraph(convert->GetOutput());
+            Trace::End();
+            if (useCache) {
+                TraceScope trace("cache_save_graph");
+                cache->SaveGraph(dualGraph);
+            }
+        }
+
+        cout << "vertex number : " << dualGraph->numberOfFaces << endl;
+        cout << "edge number : " << dualGraph->numberOfEdges << endl;
+    }
+
+    bool LoadCachedSegmentation(int seedCnt, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
+        TraceScope trace("cache_load_segmentation");
+        int cachedSeedCnt;
+        int *labels, *merges;
+        double *mergeCosts;
+        if (!getCache()->LoadSegmentation(cachedSeedCnt, labels, merges, mergeCosts)) {
+            return false;
+        }
+        if (cachedSeedCnt != seedCnt) {
+            delete[] labels;
+            delete[] merges;
+            delete[] mergeCosts;
+            return false;
+        }
+
+        ConvertPolydataToDualGraph();
+        // no centers behind cached labels, UpdateFaces only patches the graph then
+        releaseNearestDistances();
+        releaseBorderSums();
+        delete[] centerFaceIds;
+        centerFaceIds = NULL;
+
+        applySegmentation(seedCnt, labels, merges, mergeCosts);
+        delete[] labels;
+
+        renderClusters(interactor);
+
+        return true;
+    }
+
+    // Shows a snapshot of SegmentProgressively and takes it over; must run on the
+    // thread that renders
+    void ApplySnapshot(SegmentationSnapshot *snapshot, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
+        TraceScope trace("apply_snapshot", "ui", snapshot->isFinal);
+        applySegmentation(snapshot->seedCnt, snapshot->labels, snapshot->merges, snapshot->mergeCosts);
+        snapshot->merges = NULL;
+        snapshot->mergeCosts = NULL;
+        delete snapshot;
+
+        renderClusters(interactor);
+    }
+
+    void SaveSegmentationToCache(int seedCnt) {
+        if (clusterMerges && useCache) {
+            TraceScope trace("cache_save_segmentation");
+            getCache()->SaveSegmentation(seedCnt, faceIdToClusterMap, clusterMerges, clusterMergeCosts);
+        }
+    }
+
+    // writes the seed level labels with the whole merge hierarchy, see SegmentationFile
+    bool SaveSegmentation(const std::string& fileName, int seedCnt) {
+        if (!clusterMerges) {
+            return false;
+        }
+        TraceScope trace("save_segmentation", "io");
+        if (!originalFaceIds) {
+            return SegmentationFile::Write(fileName, numberOfFaces, seedCnt, faceIdToClusterMap, clusterMerges, clusterMergeCosts);
+        }
+
+        int *labels = new int[numberOfFaces];
+        for (int i = 0; i < numberOfFaces; ++i) {
+            labels[originalFaceIds[i]] = faceIdToClusterMap[i];
+        }
+        bool res = SegmentationFile::Write(fileName, numberOfFaces, seedCnt, labels, clusterMerges, clusterMergeCosts);
+        delete[] labels;
+        return res;
+    }
+
+    // k selects a level of the merge hierarchy; k <= 0 exports the clusters as currently edited
+    int ExportClusters(const std::string& prefix, int seedCnt, int k, ExportFormat format) {
+        TraceScope trace("export_clusters", "io", k);
+        int *labels = new int[numberOfFaces];
+        for (int i = 0; i < numberOfFaces; ++i) {
+            int clusterId = faceIdToClusterMap[i];
+            labels[i] = (clusterId >= 0 && k > 0 && clusterSteps) ? clusterSteps[seedCnt - k][clusterId] : clusterId;
+        }
 
-        g = vtkSmartPointer<vtkMutableUndirectedGraph>::New();
-        g->ShallowCopy(vtkMutableUndirectedGraph::SafeDownCast(convert->GetOutput()));
-        centers = vtkDoubleArray::SafeDownCast(g->GetVertexData()->GetArray("Centers"));
-        meshDis = vtkDoubleArray::SafeDownCast(g->GetEdgeData()->GetArray("Weights"));
+        ClusterMeshExporter exporter(Data);
+        int res = exporter.Export(labels, clusterCnt + 1, prefix, format);
 
-        cout << "vertex number : " << g->GetNumberOfVertices() << endl;
-        cout << "edge number : " << g->GetNumberOfEdges() << endl;
+        delete[] labels;
+        return res;
     }
 
     void AutomaticSelectSeeds(int seedCnt, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
-        numberOfFaces = g->GetNumberOfVertices();
+        TraceScope trace("select_seeds");
+        numberOfFaces = dualGraph->numberOfFaces;
+        if (!Engine::Fits(seedCnt)) {
+            cout << seedCnt << " seeds are more than the engine labels can hold, build without MESHSEG_COMPACT_ENGINE" << endl;
+            return;
+        }
+        if (regionThreshold > 0) {
+            // region growing places its clusters itself, see growClusters
+            for (int k = 0; k < seedCnt; ++k) {
+                clusterStatuses[k] = STATUS_SELECT;
+            }
+            return;
+        }
 
-        bool *seedMap = new bool[numberOfFaces];
-        memset(seedMap, 0, numberOfFaces * sizeof(bool));
-        vtkMath::RandomSeed(time(NULL));
-        for (int i = 0; i < seedCnt; ++i) {
-            clusterStatuses[i] = STATUS_SELECT;
-            int seedId = (int)vtkMath::Random(0, numberOfFaces);
-            while (seedMap[seedId]) {
-                seedId = (int)vtkMath::Random(0, numberOfFaces);
+        // every body gets seeds in proportion to its area; a connected mesh is one
+        // component listing all faces in order, so it draws the same seeds as ever
+        GraphComponents *parts = getComponents();
+        int *quotas = new int[parts->Count()];
+        parts->AllocateSeeds(seedCnt, quotas);
+
+        int *seedIds = new int[seedCnt];
+        int i = 0;
+        if (seedMode == SEED_RANDOM) {
+            bool *seedMap = new bool[numberOfFaces];
+            memset(seedMap, 0, numberOfFaces * sizeof(bool));
+            vtkMath::RandomSeed(randomSeed >= 0 ? randomSeed : (int) time(NULL));
+            vector<int> originals;
+            for (int c = 0; c < parts->Count(); ++c) {
+                // drawn among the original ids of the component
+                const int *faces = parts->Faces(c);
+                if (originalFaceIds) {
+                    originals.resize(parts->Size(c));
+                    for (int k = 0; k < parts->Size(c); ++k) {
+                        originals[k] = originalFaceIds[faces[k]];
+                    }
+                    sort(originals.begin(), originals.end());
+                    faces = &originals[0];
+                }
+                for (int k = 0; k < quotas[c]; ++k) {
+                    int seedId = faces[(int)vtkMath::Random(0, parts->Size(c))];
+                    while (seedMap[seedId]) {
+                        seedId = faces[(int)vtkMath::Random(0, parts->Size(c))];
+                    }
+                    seedMap[seedId] = true;
+                    // original ids so a random seed picks the same faces in any order
+                    seedIds[i++] = reorderedFaceIds ? reorderedFaceIds[seedId] : seedId;
+                }
+            }
+            delete[] seedMap;
+        } else {
+            SeedSampler sampler(dualGraph);
+            for (int c = 0; c < parts->Count(); ++c) {
+                if (seedMode == SEED_POISSON) {
+                    sampler.Poisson(parts->Faces(c), parts->Size(c), parts->Area(c), quotas[c], randomSeed >= 0 ? randomSeed + c : c, seedIds + i);
+                } else {
+                    sampler.Farthest(parts->Faces(c), parts->Size(c), quotas[c], seedIds + i);
+                }
+                i += quotas[c];
             }
-            seedMap[seedId] = true;
-            clusterFaceIds[i]->InsertNextValue(seedId);
         }
 
-        delete[] seedMap;
+        for (int k = 0; k < i; ++k) {
+            clusterStatuses[k] = STATUS_SELECT;
+            clusterFaceIds[k]->InsertNextValue(seedIds[k]);
+        }
+        delete[] seedIds;
+        delete[] quotas;
     }
 
     double* StartSegmentation(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
-        numberOfFaces = g->GetNumberOfVertices();
+        numberOfFaces = dualGraph->numberOfFaces;
 
         // start clustering
-        double **distances;
         vtkIdType* clusterCenterIds = new vtkIdType[clusterCnt];
         double *dur = new double[5];
-        clock_t begin, end;
+        double begin, end;
 
         cout << "Step 3.1 : Computing approximate centers of each cluster . . ." << endl;
-        begin = clock();
-        // get center of each cluster
-        for (int i = 0; i < clusterCnt; ++i) {
+        begin = WallTimer::Now();
+        Trace::Begin("cluster_centers");
+        // get center of each cluster, region growing has no use for them
+        for (int i = 0; i < clusterCnt && regionThreshold <= 0; ++i) {
             double *centerCoordinate = computeCenterCoordinate(clusterFaceIds[i]);
             clusterCenterIds[i] = getNearestFaceId(centerCoordinate);
             delete[] centerCoordinate;
         }
-        end = clock();
-        dur[0] = (end - begin) * 1.0 / CLOCKS_PER_SEC;
+        end = WallTimer::Now();
+        Trace::End();
+        dur[0] = end - begin;
 
         cout << "Step 3.2 : Computing dijkstra table of each cluster center . . ." << endl;
-        begin = clock();
-
-        future<double*> *getDijkstraResult = new future<double*>[clusterCnt];
-        for (int i = 0; i < clusterCnt; ++i) {
-            getDijkstraResult[i] = async(&UserInteractionManager::getDijkstraTable, this, clusterCenterIds[i]);
-        }
-
-        distances = new double*[clusterCnt];
-        for (int i = 0; i < clusterCnt; ++i) {
-            distances[i] = getDijkstraResult[i].get();
-        }
-
-        delete[] getDijkstraResult;
-
-        end = clock();
-        dur[1] = (end - begin) * 1.0 / CLOCKS_PER_SEC;
-
         cout << "Step 3.3 : Computing the nearest cluster of each mesh . . ." << endl;
-        begin = clock();
-        List<vtkIdType> *minDisIds = new List<vtkIdType>[clusterCnt];
-        for (int i = 0; i < numberOfFaces; ++i) {
-            double minDis = DBL_MAX;
-            int minDisId;
-            for (int j = 0; j < clusterCnt; ++j) {
-                if (distances[j][i] < minDis) {
-                    minDis = distances[j][i];
-                    minDisId = j;
+        dur[1] = dur[2] = 0.0;
+        dijkstraCounters.Start();
+        // UpdateFaces needs the centers and exact nearest distances, chunked labels
+        // do not follow the centers and coarse levels only approximate the distances
+        releaseNearestDistances();
+        delete[] centerFaceIds;
+        centerFaceIds = NULL;
+        if (regionThreshold > 0) {
+            growClusters(dur);
+        } else if (outOfCoreFaces > 0 && numberOfFaces > outOfCoreFaces) {
+            assignChunks(clusterCenterIds, dur);
+        } else if (shardCnt > 1 && assignSharded(clusterCenterIds, dur)) {
+            cout << "clusters assigned by " << shardCnt << " shard workers" << endl;
+            keepCenters(clusterCenterIds);
+        } else {
+            Engine::Distance *minDis = new Engine::Distance[numberOfFaces];
+            Engine::Label *minDisId = new Engine::Label[numberOfFaces];
+            MemoryTracker::Allocate(MEMORY_ASSIGNMENT, (long long) numberOfFaces * (sizeof(Engine::Distance) + sizeof(Engine::Label)));
+            begin = WallTimer::Now();
+            bool onVertices = vertexMode && getVertexGraph();
+            dur[1] += WallTimer::Now() - begin;
+            bool exact = !onVertices && !(multilevelFaces > 0 && numberOfFaces > coarseTarget());
+            if (onVertices) {
+                assignVertices(clusterCenterIds, minDis, minDisId, dur);
+            } else if (!exact) {
+                assignMultilevel(clusterCenterIds, minDis, minDisId, dur);
+            } else {
+                int *centerIds = new int[clusterCnt];
+                for (int i = 0; i < clusterCnt; ++i) {
+                    centerIds[i] = (int) clusterCenterIds[i];
+                }
+                begin = WallTimer::Now();
+                GraphComponents *parts = getComponents();
+                dur[1] += WallTimer::Now() - begin;
+                if (parts->Count() > 1) {
+                    assignComponents(parts, centerIds, minDis, minDisId, dur);
+                } else {
+                    assignNearest(dualGraph, centerIds, clusterCnt, minDis, minDisId, dur);
                 }
+                delete[] centerIds;
             }
-
-            if (minDis != DBL_MAX) {
-                minDisIds[minDisId].push_back(i);
+            // labels go straight into the face map
+            for (int i = 0; i < numberOfFaces; ++i) {
+                faceIdToClusterMap[i] = minDisId[i] != Engine::Unassigned() ? (int) minDisId[i] : -1;
+            }
+            keepCenters(clusterCenterIds);
+            delete[] minDisId;
+            MemoryTracker::Release(MEMORY_ASSIGNMENT, (long long) numberOfFaces * sizeof(Engine::Label));
+            if (exact) {
+                nearestDis = minDis;
+            } else {
+                delete[] minDis;
+                MemoryTracker::Release(MEMORY_ASSIGNMENT, (long long) numberOfFaces * sizeof(Engine::Distance));
             }
         }
-        end = clock();
-        dur[2] = (end - begin) * 1.0 / CLOCKS_PER_SEC;
+        if (regionThreshold <= 0 && !Progress::IsCancelled()) {
+            labelUnseededComponents(clusterCenterIds, faceIdToClusterMap, -1);
+        }
+        // with a budget, on several levels or in chunks this includes the folding in between
+        dijkstraCounters.Stop();
 
         cout << "Step 3.4 : Adding meshes belonging to each cluster . . ." << endl;
-        begin = clock();
+        begin = WallTimer::Now();
+        Trace::Begin("collect_clusters");
+        // the id lists are sized by a count first
+        int *clusterSizes = new int[clusterCnt];
+        memset(clusterSizes, 0, clusterCnt * sizeof(int));
+        for (int i = 0; i < numberOfFaces; ++i) {
+            if (faceIdToClusterMap[i] >= 0) {
+                ++clusterSizes[faceIdToClusterMap[i]];
+            }
+        }
+
+        vtkIdType **clusterFill = new vtkIdType*[clusterCnt];
         for (int i = 0; i < clusterCnt; ++i) {
             vtkSmartPointer<vtkIdTypeArray> clusterFaceId = vtkSmartPointer<vtkIdTypeArray>::New();
             clusterFaceId->SetNumberOfComponents(1);
+            clusterFaceId->SetNumberOfTuples(clusterSizes[i]);
             clusterFaceIds[i] = clusterFaceId;
-            for (List<vtkIdType>::iterator it = minDisIds[i].begin(); it != NULL; it = it->next) {
-                clusterFaceIds[i]->InsertNextValue(it->key);
-                faceIdToClusterMap[it->key] = i;
+            clusterFill[i] = clusterFaceId->GetPointer(0);
+        }
+        for (int i = 0; i < numberOfFaces; ++i) {
+            if (faceIdToClusterMap[i] >= 0) {
+                *clusterFill[faceIdToClusterMap[i]]++ = i;
             }
         }
-        end = clock();
-        dur[3] = (end - begin) * 1.0 / CLOCKS_PER_SEC;
+        delete[] clusterFill;
+        delete[] clusterSizes;
+        end = WallTimer::Now();
+        Trace::End();
+        dur[3] = end - begin;
 
         cout << "Step 3.5 : Re-rendering clusters . . ." << endl;
-        begin = clock();
-        // re-render clusters
-        for (int i = 0; i < clusterCnt; ++i) {
-            clusterStatuses[i] = STATUS_ACTIVE;
-            for (int j = 0; j < clusterFaceIds[i]->GetNumberOfTuples(); ++j) {
-                faceColors->SetTupleValue(clusterFaceIds[i]->GetValue(j), clusterColors[i]);
-            }
+        begin = WallTimer::Now();
+        Trace::Begin("render_clusters");
+        if (!deferRendering) {
+            renderClusters(interactor);
         }
-        Data->GetCellData()->RemoveArray("Colors");
-        Data->GetCellData()->SetScalars(faceColors);
-        interactor->GetRenderWindow()->Render();
-        end = clock();
-        dur[4] = (end - begin) * 1.0 / CLOCKS_PER_SEC;
+        end = WallTimer::Now();
+        Trace::End();
+        dur[4] = end - begin;
 
         //cout << "Deleting . . ." << endl;
         //cout << "1 . . ." << endl;
         delete[] clusterCenterIds;
-        //cout << "2 . . ." << endl;
-        delete[] minDisIds;
-        //cout << "3 . . ." << endl;
-        for (int i = 0; i < clusterCnt; ++i) {
-            if (distances[i]) {
-                delete[] distances[i];
-            }
-        }
-       // cout << "4 . . ." << endl;
-        delete[] distances;
 
         //cout << "Delete ok!" << endl;
         return dur;
     }
 
     void MergeClusters(int seedCnt, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
-        // compute merging costs between clusters
-        vtkSmartPointer<vtkDoubleArray> edgeLens = vtkDoubleArray::SafeDownCast(g->GetEdgeData()->GetArray("EdgeLens"));
-        vtkSmartPointer<vtkDoubleArray> meshDis = vtkDoubleArray::SafeDownCast(g->GetEdgeData()->GetArray("Weights"));
-        vtkSmartPointer<vtkEdgeListIterator> edgeIt = vtkSmartPointer<vtkEdgeListIterator>::New();
-        double ***utilValues = new double**[seedCnt];
-        for (int i = 0; i < seedCnt; ++i) {
-            utilValues[i] = new double*[seedCnt];
-            for (int j = 0; j < seedCnt; ++j) {
-                utilValues[i][j] = NULL;
+        computeBorderSums(seedCnt, faceIdToClusterMap);
+        rebuildMerges(seedCnt);
+    }
+
+    // Steps 3 and 4 as a series of better and better segmentations: the first from the
+    // coarsest level of a multilevel hierarchy, one more for every level the borders
+    // are refined on, and the exact one last unless the multilevel mode is on. Each is
+    // merged and passed to deliver as a snapshot right away, on this thread. The
+    // clusters of the engine are left alone; the viewer shows a snapshot through
+    // ApplySnapshot, so it can use one while the next is being computed. Meshes not
+    // above the coarse size get the final snapshot only.
+    void SegmentProgressively(SnapshotCallback deliver, void *data) {
+        TraceScope trace("progressive");
+        numberOfFaces = dualGraph->numberOfFaces;
+        double dur[5] = { 0.0 };
+
+        vtkIdType *clusterCenterIds = new vtkIdType[clusterCnt];
+        for (int i = 0; i < clusterCnt; ++i) {
+            double *centerCoordinate = computeCenterCoordinate(clusterFaceIds[i]);
+            clusterCenterIds[i] = getNearestFaceId(centerCoordinate);
+            delete[] centerCoordinate;
+        }
+        releaseNearestDistances();
+        delete[] centerFaceIds;
+        centerFaceIds = NULL;
+
+        int coarseFaces = coarseTarget();
+        bool exact = !(multilevelFaces > 0 && numberOfFaces > coarseFaces);
+        Engine::Distance *minDis = new Engine::Distance[numberOfFaces];
+        Engine::Label *minDisId = new Engine::Label[numberOfFaces];
+        MemoryTracker::Allocate(MEMORY_ASSIGNMENT, (long long) numberOfFaces * (sizeof(Engine::Distance) + sizeof(Engine::Label)));
+        if (numberOfFaces > coarseFaces) {
+            assignMultilevel(clusterCenterIds, minDis, minDisId, dur, deliver, data);
+            if (exact) {
+                deliverSnapshot(minDisId, 0, false, deliver, data);
             }
         }
+        if (exact && !Progress::IsCancelled()) {
+            Progress::BeginStage(PROGRESS_EXACT);
+            int *centerIds = new int[clusterCnt];
+            for (int i = 0; i < clusterCnt; ++i) {
+                centerIds[i] = (int) clusterCenterIds[i];
+            }
+            assignNearest(dualGraph, centerIds, clusterCnt, minDis, minDisId, dur);
+            delete[] centerIds;
+        }
+        if (!Progress::IsCancelled()) {
+            keepCenters(clusterCenterIds);
+            labelUnseededComponents(clusterCenterIds, minDisId, Engine::Unassigned());
+            deliverSnapshot(minDisId, 0, true, deliver, data);
+        }
 
-        // compute D1, i.e. D(Si interact Sj) and L1, i.e. L(Si interact Sj)
-        g->GetEdges(edgeIt);
-        unsigned char white[4] = { 255, 255, 255, 255 };
-        while (edgeIt->HasNext()) {
-            vtkEdgeType edge = edgeIt->Next();
-
-            int clusterNumA, clusterNumB;
-            clusterNumA = faceIdToClusterMap[edge.Source];
-            clusterNumB = faceIdToClusterMap[edge.Target];
+        delete[] minDisId;
+        MemoryTracker::Release(MEMORY_ASSIGNMENT, (long long) numberOfFaces * sizeof(Engine::Label));
+        if (exact && centerFaceIds) {
+            nearestDis = minDis;
+        } else {
+            delete[] minDis;
+            MemoryTracker::Release(MEMORY_ASSIGNMENT, (long long) numberOfFaces * sizeof(Engine::Distance));
+        }
+        delete[] clusterCenterIds;
+    }
 
-            if (clusterNumA == clusterNumB || clusterNumA == -1 || clusterNumB == -1) {
-                continue;
-            }
+    // Re-segments after the points of faceIds moved, the faces and their connectivity
+    // staying the same: the dual graph is patched around them, only faces whose nearest
+    // center may have changed are assigned again, the border sums of the merge take
+    // the difference and the old merge order is replayed up to the first step they
+    // change, see updateMerges. Adding or removing faces is not supported: the face
+    // count is checked and such an edit needs the full pipeline again.
+    bool UpdateFaces(const int *faceIds, int cnt, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
+        if (!dualGraph) {
+            cout << "There is no dual graph to update yet" << endl;
+            return false;
+        }
+        if (Data->GetNumberOfCells() != numberOfFaces) {
+            cout << "Faces were added or removed, the mesh has to be segmented again" << endl;
+            return false;
+        }
 
-            if (!utilValues[clusterNumA][clusterNumB]) {
-                utilValues[clusterNumA][clusterNumB] = new double[5];
-                utilValues[clusterNumB][clusterNumA] = new double[5];
+        TraceScope trace("update_faces", "pipeline", cnt);
+        double begin = WallTimer::Now();
+        if (!patcher) {
+            patcher = new DualGraphPatcher(Data, dualGraph, weightParameters);
+        }
+        vector<int> edgeIds;
+        vector<double> oldWeights, oldLens;
+        patcher->Patch(faceIds, cnt, edgeIds, oldWeights, oldLens);
+
+        // built from the old graph, and the cache is keyed by the old mesh
+        delete hierarchy;
+        hierarchy = NULL;
+        releaseVertexGraph();
+        delete cache;
+        cache = NULL;
+
+        bool confirmed = false;
+        for (int i = 0; i < clusterCnt; ++i) {
+            confirmed = confirmed || !clusterFaceIds[i];
+        }
+        if (!centerFaceIds || confirmed) {
+            cout << "dual graph updated, the clusters need a new segmentation" << endl;
+            return true;
+        }
 
-                for (int i = 0; i < 5; ++i) {
-                    utilValues[clusterNumA][clusterNumB][i] = 0.0;
-                    utilValues[clusterNumB][clusterNumA][i] = 0.0;
-                }
-            }
+        vector< pair<int, int> > relabeled;
+        if (nearestDis) {
+            RepairNearest<Engine>(dualGraph, edgeIds, oldWeights, centerFaceIds, clusterCnt, nearestDis, faceIdToClusterMap, relabeled);
+        } else {
+            // the first update after a sharded, multilevel or vertex run needs one full pass
+            computeNearestDistances(relabeled);
+        }
+        updateClusterLists(relabeled);
 
-            double D1, L1;
-            D1 = utilValues[clusterNumA][clusterNumB][0];
-            L1 = utilValues[clusterNumA][clusterNumB][1];
+        if (borderSums) {
+            vector<char> touched;
+            updateBorderSums(edgeIds, oldWeights, oldLens, relabeled, touched);
+            updateMerges(borderSeedCnt, touched);
+        }
+        if (interactor) {
+            renderClusters(interactor);
+        }
+        cout << "incremental update : " << cnt << " faces changed, " << relabeled.size() << " faces relabeled in "
+            << (WallTimer::Now() - begin) * 1000 << " ms" << endl;
+        return true;
+    }
 
-            D1 += edgeLens->GetValue(edge.Id) * meshDis->GetValue(edge.Id);
-            L1 += edgeLens->GetValue(edge.Id);
+    unordered_map< int, List<int>* >* clusterDivision(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor, const vtkSmartPointer<vtkPlane>& cutPlane, int pickId, DisjointSet* &S) {
+        TraceScope trace("divide", "ui", pickId);
+        double origin[3], normal[3];
+        cutPlane->GetOrigin(origin);
+        cutPlane->GetNormal(normal);
 
-            utilValues[clusterNumA][clusterNumB][0] = D1;
-            utilValues[clusterNumB][clusterNumA][0] = D1;
-            utilValues[clusterNumA][clusterNumB][1] = L1;
-            utilValues[clusterNumB][clusterNumA][1] = L1;
+        int targetCluster = faceIdToClusterMap[pickId];
+        vtkSmartPointer<vtkIdTypeArray>& targetArray = clusterFaceIds[targetCluster];
+        if (S) {
+            MemoryTracker::Release(MEMORY_DIVISION, S->Bytes());
+            delete S;
+        }
+        // the sets only cover the faces of the cluster, not the whole mesh
+        vector<int> targetFaces(targetArray->GetNumberOfTuples());
+        for (int i = 0; i < (int) targetFaces.size(); ++i) {
+            targetFaces[i] = targetArray->GetValue(i);
         }
+        S = new DisjointSet(targetFaces.empty() ? NULL : &targetFaces[0], (int) targetFaces.size());
+        MemoryTracker::Allocate(MEMORY_DIVISION, S->Bytes());
+
+        PerfCounters::Add(PERF_EDGES_SCANNED, dualGraph->numberOfEdges);
+        for (int edgeId = 0; edgeId < dualGraph->numberOfEdges; ++edgeId) {
+            int source = dualGraph->edges[2 * edgeId], target = dualGraph->edges[2 * edgeId + 1];
+            if (faceIdToClusterMap[source] == targetCluster && faceIdToClusterMap[target] == targetCluster) {
+                const double *p1, *p2;
+                p1 = dualGraph->Center(source);
+                bool f1 = (normal[0] * (p1[0] - origin[0]) + normal[1] * (p1[1] - origin[1]) + normal[2] * (p1[2] - origin[2])) > 0;
+                p2 = dualGraph->Center(target);
+                bool f2 = (normal[0] * (p2[0] - origin[0]) + normal[1] * (p2[1] - origin[1]) + normal[2] * (p2[2] - origin[2])) > 0;
 
-        // compute D2, i.e. D(Si union Sj), L2, i.e. L(Si union Sj) and merging cost
-        double **sumValues = new double*[seedCnt];
-        for (int i = 0; i < seedCnt; ++i) {
-            sumValues[i] = new double[2];
-            double sumD = 0.0, sumL = 0.0;
-            for (int j = 0; j < seedCnt; ++j) {
-                if (utilValues[i][j]) {
-                    sumD += utilValues[i][j][0];
-                    sumL += utilValues[i][j][1];
+                if (!(f1 ^ f2)) {
+                    S->Union(source, target);
                 }
             }
-            sumValues[i][0] = sumD;
-            sumValues[i][1] = sumL;
         }
 
-        set<heapElem, heapElemComp> minHeap;
-        for (int i = 0; i < seedCnt; ++i) {
-            for (int j = 0; j < seedCnt; ++j) {
-                if (utilValues[i][j]) {
-                    utilValues[i][j][2] = sumValues[i][0] + sumValues[j][0] - 2 * utilValues[i][j][0];
-                    utilValues[i][j][3] = sumValues[i][1] + sumValues[j][1] - 2 * utilValues[i][j][1];
-                    utilValues[i][j][4] = (utilValues[i][j][0] / utilValues[i][j][1]) / (utilValues[i][j][2] / utilValues[i][j][3]);
-                    if (i < j) {
-                        minHeap.insert(make_pair(i * seedCnt + j, utilValues[i][j][4]));
-                    }
-                }
+        unordered_map< int, List<int>* > *divMap = new unordered_map< int, List<int>* >;
+        for (int i = 0; i < (int) targetFaces.size(); ++i) {
+            int faceId = targetFaces[i];
+            int setId = S->FindSet(faceId);
+
+            if (!(*divMap)[setId]) {
+                (*divMap)[setId] = new List<int>;
             }
+            (*divMap)[setId]->push_back(faceId);
         }
 
-        // start merging
-        clusterSteps = new int*[seedCnt];
-        for (int i = 0; i < seedCnt; ++i) {
-            clusterSteps[i] = new int[seedCnt];
-            clusterSteps[0][i] = i;
-        }
+        return divMap;
+    }
 
-        int remainClusterCnt = seedCnt;
-        while (remainClusterCnt > 2) {
-            int tmp = minHeap.begin()->first;
-            int clusterNumA, clusterNumB;
+    vtkSmartPointer<vtkActor> drawContour(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor, double planePoints[3][3], vtkSmartPointer<vtkPlane>& cutPlane, vtkSmartPointer<vtkActor> lastActor) {
+        TraceScope trace("draw_contour", "ui");
+        vtkSmartPointer<vtkPlane> plane = vtkSmartPointer<vtkPlane>::New();
+        plane->SetOrigin(planePoints[0]);
+        double a[3] = { planePoints[0][0] - planePoints[1][0], planePoints[0][1] - planePoints[1][1], planePoints[0][2] - planePoints[1][2] };
+        double b[3] = { planePoints[0][0] - planePoints[2][0], planePoints[0][1] - planePoints[2][1], planePoints[0][2] - planePoints[2][2] };
+        double n[3] = { 0, 0, 0 };
+        vtkMath::Cross(a, b, n);
+        plane->SetNormal(n);
 
-            clusterNumA = tmp / seedCnt;
-            clusterNumB = tmp % seedCnt;
+        vtkSmartPointer<vtkCutter> cutter = vtkSmartPointer<vtkCutter>::New();
+        cutter->SetCutFunction(plane);
+        cutter->SetInputData(Data);
+        cutter->Update();
 
-            sumValues[clusterNumA][0] = utilValues[clusterNumA][clusterNumB][2];
-            sumValues[clusterNumA][1] = utilValues[clusterNumA][clusterNumB][3];
-            for (int i = 0; i < seedCnt; ++i) {
-                if (i == clusterNumA || i == clusterNumB) {
-                    continue;
-                }
+        vtkSmartPointer<vtkPolyDataMapper> cutterMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+        cutterMapper->SetInputConnection(cutter->GetOutputPort());
 
-                if (utilValues[clusterNumA][i] && utilValues[clusterNumB][i]) {
-                    utilValues[clusterNumA][i][0] += utilValues[clusterNumB][i][0];
-                    utilValues[clusterNumA][i][1] += utilValues[clusterNumB][i][1];
-                    utilValues[clusterNumA][i][2] = sumValues[clusterNumA][0] + sumValues[i][0] - 2 * utilValues[clusterNumA][i][0];
-                    utilValues[clusterNumA][i][3] = sumValues[clusterNumA][1] + sumValues[i][1] - 2 * utilValues[clusterNumA][i][1];
+        vtkSmartPointer<vtkActor> planeActor = vtkSmartPointer<vtkActor>::New();
+        planeActor->GetProperty()->SetColor(0, 0, 0);
+        planeActor->GetProperty()->SetLineWidth(2);
+        planeActor->SetMapper(cutterMapper);
 
-                    utilValues[i][clusterNumA][0] = utilValues[clusterNumA][i][0];
-                    utilValues[i][clusterNumA][1] = utilValues[clusterNumA][i][1];
-                    utilValues[i][clusterNumA][2] = utilValues[clusterNumA][i][2];
-                    utilValues[i][clusterNumA][3] = utilValues[clusterNumA][i][3];
+        vtkRenderer *renderer = interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer();
+        if (lastActor) {
+            renderer->RemoveActor(lastActor);
+        }
+        renderer->AddActor(planeActor);
+        interactor->GetRenderWindow()->Render();
 
-                    minHeap.erase(minHeap.find(make_pair(computeHashValue(clusterNumA, i, seedCnt), utilValues[clusterNumA][i][4])));
-                    minHeap.erase(minHeap.find(make_pair(computeHashValue(clusterNumB, i, seedCnt), utilValues[clusterNumB][i][4])));
+        cutPlane = plane;
+        return planeActor;
+    }
 
-                    delete[] utilValues[clusterNumB][i];
-                    delete[] utilValues[i][clusterNumB];
-                    utilValues[clusterNumB][i] = NULL;
-                    utilValues[i][clusterNumB] = NULL;
+    void HighlightDivision(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor, unordered_map< int, List<int>* > *divMap, int pickId, DisjointSet *S, vtkSmartPointer<vtkActor> lastActor) {
+        TraceScope trace("highlight_division", "ui", pickId);
+        int targetCluster = faceIdToClusterMap[pickId];
+        int targetSet = S->FindSet(pickId);
+
+        List<int> *setIds = (*divMap)[targetSet];
+        clusterFaceIds[clusterCnt] = vtkSmartPointer<vtkIdTypeArray>::New();
+        clusterFaceIds[clusterCnt]->SetNumberOfComponents(1);
+
+        bool *localMap = new bool[numberOfFaces];
+        memset(localMap, 0, numberOfFaces * sizeof(bool));
+        MemoryTracker::Allocate(MEMORY_DIVISION, numberOfFaces * sizeof(bool));
+        for (List<int>::iterator it = setIds->begin(); it != setIds->end(); ++it) {
+            localMap[*it] = true;
+            clusterFaceIds[clusterCnt]->InsertNextValue(*it);
+            faceIdToClusterMap[*it] = clusterCnt;
+        }
+        clusterStatuses[clusterCnt] = STATUS_ACTIVE;
+
+        vtkSmartPointer<vtkIdTypeArray> tmpFaceIds = vtkSmartPointer<vtkIdTypeArray>::New();
+        tmpFaceIds->SetNumberOfComponents(1);
+        for (int i = 0; i < clusterFaceIds[targetCluster]->GetNumberOfTuples(); ++i) {
+            int faceId = clusterFaceIds[targetCluster]->GetValue(i);
+            if (!localMap[faceId]) {
+                tmpFaceIds->InsertNextValue(faceId);
+            }
+        }
+
+        clusterFaceIds[targetCluster] = vtkSmartPointer<vtkIdTypeArray>::New();
+        clusterFaceIds[targetCluster]->DeepCopy(tmpFaceIds);
+
+        vtkRenderer *renderer = interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer();
+        if (lastActor) {
+            renderer->RemoveActor(lastActor);
+        }
+
+        unsigned char gray[4] = { 212, 212, 212, 255 };
+        highlightFace(interactor, clusterFaceIds[clusterCnt], gray);
+
+        delete[] localMap;
+        MemoryTracker::Release(MEMORY_DIVISION, numberOfFaces * sizeof(bool));
+    }
+
+    // frees what clusterDivision handed out once HighlightDivision has used it
+    void ReleaseDivision(unordered_map< int, List<int>* >* &divMap, DisjointSet* &S) {
+        if (divMap) {
+            for (unordered_map< int, List<int>* >::iterator it = divMap->begin(); it != divMap->end(); ++it) {
+                delete it->second;
+            }
+            delete divMap;
+            divMap = NULL;
+        }
+        if (S) {
+            MemoryTracker::Release(MEMORY_DIVISION, S->Bytes());
+            delete S;
+            S = NULL;
+        }
+    }
+
+    int HighlightCluster(const vtkSmartPointer<vtkCellPicker>& picker, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor, int lastClusterId, int beginClusterId) {
+        TraceScope trace("hover_highlight", "ui");
+        int pickId = picker->GetCellId();
+        if (pickId != -1) {
+            int clusterId = faceIdToClusterMap[pickId];
+
+            if (lastClusterId >= 0 && clusterStatuses[lastClusterId] == STATUS_ACTIVE) {
+                if (lastClusterId == clusterId) {
+                    return lastClusterId;
+                } else if (lastClusterId != beginClusterId) {
+                    highlightFace(interactor, clusterFaceIds[lastClusterId], clusterColors[colorHashMap[lastClusterId]]);
+                }
+            }
+
+            if (clusterId == -1 || clusterStatuses[clusterId] != STATUS_ACTIVE) {
+                return -1;
+            }
+
+            if (clusterId == beginClusterId) {
+                return clusterId;
+            }
+
+            unsigned char color[4] = { 255, 255, 255, 255 };
+            faceColors->GetTupleValue(pickId, color);
+            int _r, _g, _b;
+            _r = color[0] * 1.2;
+            _g = color[1] * 1.2;
+            _b = color[2] * 1.2;
+            _r = _r > 255 ? 255 : _r;
+            _g = _g > 255 ? 255 : _g;
+            _b = _b > 255 ? 255 : _b;
+            unsigned char highlightColor[4] = { (unsigned char) _r, (unsigned char) _g, (unsigned char) _b, 255 };
+            highlightFace(interactor, clusterFaceIds[clusterId], highlightColor);
+
+            return clusterId;
+        } else if (lastClusterId >= 0 && lastClusterId != beginClusterId && clusterStatuses[lastClusterId] == STATUS_ACTIVE) {
+            highlightFace(interactor, clusterFaceIds[lastClusterId], clusterColors[colorHashMap[lastClusterId]]);
+        }
+
+        return -1;
+    }
+
+    void HighlightFace(int clusterId, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
+        highlightFace(interactor, clusterFaceIds[clusterId], clusterColors[colorHashMap[clusterId]]);
+    }
+
+private:
+    inline int computeHashValue(int a, int b, int seedCnt) {
+        if (a < b) {
+            return a * seedCnt + b;
+        } else {
+            return b * seedCnt + a;
+        }
+    }
+
+    // how many distance fields may be alive at once: all of them without a budget,
+    // otherwise as many as fit next to what is already tracked, at least one
+    int getDistanceBatchSize(int numberOfFaces) {
+        if (memoryBudget <= 0) {
+            return clusterCnt;
+        }
+
+        // the nearest center arrays are tracked already
+        long long available = memoryBudget - MemoryTracker::CurrentTotal();
+        // a running Dijkstra plus its slot in the distance blocks
+        long long perField = DistanceFieldBytes<Engine>(numberOfFaces) + DistanceBlocks<Engine>::Bytes(numberOfFaces, 1);
+        long long fit = available > 0 ? available / perField : 0;
+        if (fit < 1) {
+            cout << "Memory budget is below one distance field, computing them one at a time" << endl;
+            return 1;
+        }
+        if (fit < clusterCnt) {
+            cout << "Memory budget allows " << fit << " concurrent distance fields" << endl;
+            return (int) fit;
+        }
+        return clusterCnt;
+    }
+
+    // D1 and L1 of every pair of clusters, see computeBorderSums
+    double* borderSum(int a, int b) { return borderSums + 3 * ((long long) a * borderSeedCnt + b); }
+
+    // false when the edge is on no border
+    bool addBorderEdge(int a, int b, double len, double dis, double sign) {
+        if (a == b || a < 0 || b < 0) {
+            return false;
+        }
+        for (int side = 0; side < 2; ++side) {
+            double *sums = borderSum(a, b);
+            sums[0] += sign * len * dis;
+            sums[1] += sign * len;
+            sums[2] += sign;
+            swap(a, b);
+        }
+        return true;
+    }
+
+    // compute D1, i.e. D(Si interact Sj) and L1, i.e. L(Si interact Sj), together with
+    // the number of dual edges on their border; kept for UpdateFaces. Threads sum
+    // contiguous edge ranges into sparse tables of their own, which are added up in
+    // thread order, so the sums do not depend on scheduling
+    void computeBorderSums(int seedCnt, const int *labels) {
+        TraceScope trace("border_sums");
+        if (borderSums && borderSeedCnt != seedCnt) {
+            releaseBorderSums();
+        }
+        if (!borderSums) {
+            borderSeedCnt = seedCnt;
+            borderSums = new double[3 * seedCnt * seedCnt];
+            MemoryTracker::Allocate(MEMORY_MERGE, 3LL * seedCnt * seedCnt * sizeof(double));
+        }
+        memset(borderSums, 0, 3 * seedCnt * seedCnt * sizeof(double));
+
+        int edgeCnt = dualGraph->numberOfEdges;
+        int threadCnt = thread::hardware_concurrency();
+        threadCnt = threadCnt > 0 ? threadCnt : 4;
+        threadCnt = threadCnt < edgeCnt / borderEdgesPerThread ? threadCnt : edgeCnt / borderEdgesPerThread;
+        threadCnt = threadCnt > 1 ? threadCnt : 1;
+
+        vector< unordered_map<int, borderTotals> > totals(threadCnt);
+        int chunk = (edgeCnt + threadCnt - 1) / threadCnt;
+        if (threadCnt == 1) {
+            sumBorders(labels, seedCnt, 0, edgeCnt, totals[0]);
+        } else {
+            vector< future<void> > tasks;
+            for (int t = 0; t < threadCnt; ++t) {
+                int begin = t * chunk, end = (t + 1) * chunk < edgeCnt ? (t + 1) * chunk : edgeCnt;
+                unordered_map<int, borderTotals> *table = &totals[t];
+                tasks.push_back(async(launch::async, [=]() {
+                    sumBorders(labels, seedCnt, begin, end, *table);
+                }));
+            }
+            for (size_t t = 0; t < tasks.size(); ++t) {
+                tasks[t].get();
+            }
+        }
+        PerfCounters::Add(PERF_EDGES_SCANNED, edgeCnt);
+
+        for (int t = 0; t < threadCnt; ++t) {
+            for (unordered_map<int, borderTotals>::iterator it = totals[t].begin(); it != totals[t].end(); ++it) {
+                int a = it->first / seedCnt, b = it->first % seedCnt;
+                for (int side = 0; side < 2; ++side) {
+                    double *sums = borderSum(a, b);
+                    sums[0] += it->second.D;
+                    sums[1] += it->second.L;
+                    sums[2] += it->second.cnt;
+                    swap(a, b);
+                }
+            }
+        }
+    }
+
+    // D1, L1 and edge count of every pair of clusters meeting on the edges from begin
+    // to end, keyed a * seedCnt + b with a < b
+    void sumBorders(const int *labels, int seedCnt, int begin, int end, unordered_map<int, borderTotals>& totals) {
+        const int *edges = dualGraph->edges;
+        const double *edgeLens = dualGraph->edgeLens;
+        const double *meshDis = dualGraph->weights;
+        for (int edgeId = begin; edgeId < end; ++edgeId) {
+            int a = labels[edges[2 * edgeId]], b = labels[edges[2 * edgeId + 1]];
+            if (a == b || a < 0 || b < 0) {
+                continue;
+            }
+            borderTotals& border = totals[a < b ? a * seedCnt + b : b * seedCnt + a];
+            border.D += edgeLens[edgeId] * meshDis[edgeId];
+            border.L += edgeLens[edgeId];
+            border.cnt += 1.0;
+        }
+    }
+
+    void releaseBorderSums() {
+        if (borderSums) {
+            delete[] borderSums;
+            borderSums = NULL;
+            MemoryTracker::Release(MEMORY_MERGE, 3LL * borderSeedCnt * borderSeedCnt * sizeof(double));
+        }
+    }
+
+    // takes the edges whose weight changed or whose faces changed cluster out of the
+    // border sums with their old values and puts them back with the new ones; touched
+    // marks every cluster with a border sum that changed
+    void updateBorderSums(const vector<int>& edgeIds, const vector<double>& oldWeights, const vector<double>& oldLens, const vector< pair<int, int> >& relabeled,
+        vector<char>& touched) {
+        touched.assign(borderSeedCnt, 0);
+        unordered_map<int, int> oldLabels(relabeled.begin(), relabeled.end());
+        unordered_map<int, int> changedEdges;
+        for (size_t i = 0; i < edgeIds.size(); ++i) {
+            changedEdges[edgeIds[i]] = (int) i;
+        }
+        for (size_t i = 0; i < relabeled.size(); ++i) {
+            int face = relabeled[i].first;
+            for (int k = dualGraph->offsets[face]; k < dualGraph->offsets[face + 1]; ++k) {
+                changedEdges.insert(make_pair(dualGraph->edgeIds[k], -1));
+            }
+        }
+
+        for (unordered_map<int, int>::iterator it = changedEdges.begin(); it != changedEdges.end(); ++it) {
+            int edgeId = it->first;
+            int u = dualGraph->edges[2 * edgeId], v = dualGraph->edges[2 * edgeId + 1];
+            unordered_map<int, int>::iterator oldU = oldLabels.find(u), oldV = oldLabels.find(v);
+            double len = it->second >= 0 ? oldLens[it->second] : dualGraph->edgeLens[edgeId];
+            double dis = it->second >= 0 ? oldWeights[it->second] : dualGraph->weights[edgeId];
+            int a = oldU != oldLabels.end() ? oldU->second : faceIdToClusterMap[u], b = oldV != oldLabels.end() ? oldV->second : faceIdToClusterMap[v];
+            if (addBorderEdge(a, b, len, dis, -1.0)) {
+                touched[a] = touched[b] = 1;
+            }
+            a = faceIdToClusterMap[u];
+            b = faceIdToClusterMap[v];
+            if (addBorderEdge(a, b, dualGraph->edgeLens[edgeId], dualGraph->weights[edgeId], 1.0)) {
+                touched[a] = touched[b] = 1;
+            }
+        }
+    }
+
+    void keepCenters(const vtkIdType *clusterCenterIds) {
+        centerFaceIds = new int[clusterCnt];
+        for (int i = 0; i < clusterCnt; ++i) {
+            centerFaceIds[i] = (int) clusterCenterIds[i];
+        }
+    }
+
+    void releaseNearestDistances() {
+        if (nearestDis) {
+            delete[] nearestDis;
+            nearestDis = NULL;
+            MemoryTracker::Release(MEMORY_ASSIGNMENT, (long long) numberOfFaces * sizeof(Engine::Distance));
+        }
+    }
+
+    // exact nearest centers on the current graph, relabeled receives the faces whose
+    // cluster changed with their old one
+    void computeNearestDistances(vector< pair<int, int> >& relabeled) {
+        double dur[5] = { 0.0 };
+        nearestDis = new Engine::Distance[numberOfFaces];
+        Engine::Label *minDisId = new Engine::Label[numberOfFaces];
+        MemoryTracker::Allocate(MEMORY_ASSIGNMENT, (long long) numberOfFaces * (sizeof(Engine::Distance) + sizeof(Engine::Label)));
+        assignNearest(dualGraph, centerFaceIds, clusterCnt, nearestDis, minDisId, dur);
+
+        relabeled.clear();
+        for (int i = 0; i < numberOfFaces; ++i) {
+            int label = minDisId[i] != Engine::Unassigned() ? (int) minDisId[i] : -1;
+            if (label != faceIdToClusterMap[i]) {
+                relabeled.push_back(make_pair(i, faceIdToClusterMap[i]));
+                faceIdToClusterMap[i] = label;
+            }
+        }
+        delete[] minDisId;
+        MemoryTracker::Release(MEMORY_ASSIGNMENT, (long long) numberOfFaces * sizeof(Engine::Label));
+    }
+
+    // moves the relabeled faces between the id lists of their old and new cluster
+    void updateClusterLists(const vector< pair<int, int> >& relabeled) {
+        unordered_set<int> moved, touched;
+        for (size_t i = 0; i < relabeled.size(); ++i) {
+            moved.insert(relabeled[i].first);
+            touched.insert(relabeled[i].second);
+            touched.insert(faceIdToClusterMap[relabeled[i].first]);
+        }
+        touched.erase(-1);
+
+        for (unordered_set<int>::iterator it = touched.begin(); it != touched.end(); ++it) {
+            vtkSmartPointer<vtkIdTypeArray> clusterFaceId = vtkSmartPointer<vtkIdTypeArray>::New();
+            clusterFaceId->SetNumberOfComponents(1);
+            vtkIdTypeArray *oldIds = clusterFaceIds[*it];
+            for (vtkIdType j = 0; j < oldIds->GetNumberOfTuples(); ++j) {
+                if (!moved.count((int) oldIds->GetValue(j))) {
+                    clusterFaceId->InsertNextValue(oldIds->GetValue(j));
+                }
+            }
+            for (size_t i = 0; i < relabeled.size(); ++i) {
+                if (faceIdToClusterMap[relabeled[i].first] == *it) {
+                    clusterFaceId->InsertNextValue(relabeled[i].first);
+                }
+            }
+            clusterFaceIds[*it] = clusterFaceId;
+        }
+    }
+
+    // Every face labeled as its node on level of the hierarchy, 0 being the mesh itself,
+    // then merged; nothing is delivered once the run is cancelled
+    void deliverSnapshot(const Engine::Label *levelIds, int level, bool isFinal, SnapshotCallback deliver, void *data) {
+        if (Progress::IsCancelled()) {
+            return;
+        }
+        TraceScope trace("snapshot", "pipeline", level);
+        SegmentationSnapshot *snapshot = new SegmentationSnapshot(numberOfFaces, clusterCnt);
+        for (int i = 0; i < numberOfFaces; ++i) {
+            Engine::Label label = levelIds[level ? hierarchy->Ancestor(i, level) : i];
+            snapshot->labels[i] = label != Engine::Unassigned() ? (int) label : -1;
+        }
+        computeBorderSums(clusterCnt, snapshot->labels);
+        if (!mergeBorders(clusterCnt, snapshot->merges, snapshot->mergeCosts, false)) {
+            delete snapshot;
+            return;
+        }
+        snapshot->isFinal = isFinal;
+        deliver(data, snapshot);
+    }
+
+    // labels become the clusters of the engine, merges and mergeCosts are taken over
+    void applySegmentation(int seedCnt, const int *labels, int *merges, double *mergeCosts) {
+        for (int i = 0; i < seedCnt; ++i) {
+            clusterFaceIds[i] = vtkSmartPointer<vtkIdTypeArray>::New();
+            clusterFaceIds[i]->SetNumberOfComponents(1);
+        }
+        for (int i = 0; i < numberOfFaces; ++i) {
+            faceIdToClusterMap[i] = labels[i] < seedCnt ? labels[i] : -1;
+            if (faceIdToClusterMap[i] >= 0) {
+                clusterFaceIds[labels[i]]->InsertNextValue(i);
+            }
+        }
+
+        delete[] clusterMerges;
+        delete[] clusterMergeCosts;
+        clusterMerges = merges;
+        clusterMergeCosts = mergeCosts;
+        buildClusterSteps(seedCnt);
+    }
+
+    // the merge hierarchy of the engine from the border sums
+    void rebuildMerges(int seedCnt) {
+        delete[] clusterMerges;
+        delete[] clusterMergeCosts;
+        clusterMerges = new int[2 * (seedCnt - 2)];
+        clusterMergeCosts = new double[seedCnt - 2];
+        if (mergeBorders(seedCnt, clusterMerges, clusterMergeCosts, true)) {
+            buildClusterSteps(seedCnt);
+        } else {
+            // a cancelled merge leaves no hierarchy to step through
+            delete[] clusterMerges;
+            delete[] clusterMergeCosts;
+            clusterMerges = NULL;
+            clusterMergeCosts = NULL;
+        }
+    }
+
+    // Brings the merge hierarchy up to date after the border sums of the clusters
+    // marked in touched changed. The recorded merges are replayed over the borders
+    // that exist, and a merge stands while no pair with a touched cluster in it costs
+    // less now; pairs of untouched clusters cost what they did, so only the others
+    // are kept in order. A replay thus costs the borders it passes instead of a heap
+    // over every pair. From the first merge that does not stand, mergeSteps finishes
+    // greedily. Costs are computed as mergeBorders computes them, so the merges are
+    // those of rebuildMerges; pairs whose cost is not a number end the replay.
+    void updateMerges(int seedCnt, vector<char> touched) {
+        if (!clusterMerges || seedCnt <= 2) {
+            rebuildMerges(seedCnt);
+            return;
+        }
+        TraceScope trace("update_merges");
+
+        // the pair table of mergeBorders by rows, queued the costs of touched pairs
+        vector< unordered_map<int, mergeValues> > pairs(seedCnt);
+        vector<double> sumD(seedCnt, 0.0), sumL(seedCnt, 0.0);
+        int pairCnt = 0;
+        long long scanned = 0;
+        for (int i = 0; i < seedCnt; ++i) {
+            for (int j = 0; j < seedCnt; ++j) {
+                if (borderSum(i, j)[2] > 0.5) {
+                    mergeValues& border = pairs[i][j];
+                    border.D = borderSum(i, j)[0];
+                    border.L = borderSum(i, j)[1];
+                    sumD[i] += border.D;
+                    sumL[i] += border.L;
+                    pairCnt += i < j;
+                }
+            }
+        }
+        set< pair<double, int> > queue;
+        unordered_map<int, double> queuedCosts;
+        int queuedNaNs = 0;
+        auto enqueue = [&](int id, double cost) {
+            queuedCosts[id] = cost;
+            if (cost == cost) {
+                queue.insert(make_pair(cost, id));
+            } else {
+                ++queuedNaNs;
+            }
+        };
+        auto dequeue = [&](int id) {
+            unordered_map<int, double>::iterator it = queuedCosts.find(id);
+            if (it != queuedCosts.end()) {
+                if (it->second == it->second) {
+                    queue.erase(make_pair(it->second, id));
+                } else {
+                    --queuedNaNs;
+                }
+                queuedCosts.erase(it);
+            }
+        };
+        for (int i = 0; i < seedCnt; ++i) {
+            for (unordered_map<int, mergeValues>::iterator it = pairs[i].begin(); it != pairs[i].end(); ++it) {
+                int j = it->first;
+                mergeValues& border = it->second;
+                border.D2 = sumD[i] + sumD[j] - 2 * border.D;
+                border.L2 = sumL[i] + sumL[j] - 2 * border.L;
+                border.cost = (border.D / border.L) / (border.D2 / border.L2);
+                if (i < j && (touched[i] || touched[j])) {
+                    enqueue(i * seedCnt + j, border.cost);
+                }
+            }
+        }
+
+        vector<char> alive(seedCnt, 1);
+        int step = 0;
+        for (; step < seedCnt - 2; ++step) {
+            int a = clusterMerges[2 * step], b = clusterMerges[2 * step + 1];
+            unordered_map<int, mergeValues>::iterator found = pairs[a].find(b);
+            if (found == pairs[a].end()) {
+                // joined for want of any border, which holds while there still is none
+                if (pairCnt > 0 || clusterMergeCosts[step] != DBL_MAX) {
+                    break;
+                }
+                alive[b] = 0;
+                continue;
+            }
+
+            // a touched merge that got dearer may have lost to an untouched pair
+            mergeValues merged = found->second;
+            int id = computeHashValue(a, b, seedCnt);
+            if (merged.cost != merged.cost || ((touched[a] || touched[b]) && merged.cost > clusterMergeCosts[step])) {
+                break;
+            }
+            dequeue(id);
+            if (queuedNaNs > 0 || (!queue.empty() && (queue.begin()->first < merged.cost || (queue.begin()->first == merged.cost && queue.begin()->second < id)))) {
+                break;
+            }
+
+            // the steps of mergeSteps on the rows of a and b only
+            clusterMergeCosts[step] = merged.cost;
+            sumD[a] = merged.D2;
+            sumL[a] = merged.L2;
+            touched[a] = touched[a] || touched[b];
+            pairs[a].erase(b);
+            pairs[b].erase(a);
+            --pairCnt;
+            for (unordered_map<int, mergeValues>::iterator it = pairs[b].begin(); it != pairs[b].end(); ++it) {
+                int i = it->first;
+                unordered_map<int, mergeValues>::iterator shared = pairs[a].find(i);
+                if (shared != pairs[a].end()) {
+                    shared->second.D += it->second.D;
+                    shared->second.L += it->second.L;
+                    --pairCnt;
+                } else {
+                    pairs[a][i] = it->second;
+                }
+                dequeue(computeHashValue(b, i, seedCnt));
+                pairs[i].erase(b);
+            }
+            scanned += pairs[b].size() + pairs[a].size();
+            pairs[b].clear();
+            alive[b] = 0;
+            for (unordered_map<int, mergeValues>::iterator it = pairs[a].begin(); it != pairs[a].end(); ++it) {
+                int i = it->first;
+                mergeValues& border = it->second;
+                border.D2 = sumD[a] + sumD[i] - 2 * border.D;
+                border.L2 = sumL[a] + sumL[i] - 2 * border.L;
+                border.cost = MergeCost(border.D, border.L, border.D2, border.L2);
+                pairs[i][a] = border;
+                int pairId = computeHashValue(a, i, seedCnt);
+                dequeue(pairId);
+                if (touched[a] || touched[i]) {
+                    enqueue(pairId, border.cost);
+                }
+            }
+        }
+        PerfCounters::Add(PERF_EDGES_SCANNED, scanned);
+
+        if (step < seedCnt - 2) {
+            cout << "merge replayed for " << step << " of " << seedCnt - 2 << " steps" << endl;
+            long long mergeBytes = mergeStateBytes(seedCnt);
+            MemoryTracker::Allocate(MEMORY_MERGE, mergeBytes);
+            double ***utilValues = new double**[seedCnt];
+            double **sumValues = new double*[seedCnt];
+            IndexedHeap<double> minHeap(seedCnt * seedCnt);
+            for (int i = 0; i < seedCnt; ++i) {
+                utilValues[i] = new double*[seedCnt];
+                for (int j = 0; j < seedCnt; ++j) {
+                    utilValues[i][j] = NULL;
+                }
+                for (unordered_map<int, mergeValues>::iterator it = pairs[i].begin(); it != pairs[i].end(); ++it) {
+                    const mergeValues& border = it->second;
+                    double *values = utilValues[i][it->first] = new double[5];
+                    values[0] = border.D;
+                    values[1] = border.L;
+                    values[2] = border.D2;
+                    values[3] = border.L2;
+                    values[4] = border.cost;
+                    if (i < it->first) {
+                        minHeap.Push(i * seedCnt + it->first, border.cost);
+                    }
+                }
+                sumValues[i] = new double[2];
+                sumValues[i][0] = sumD[i];
+                sumValues[i][1] = sumL[i];
+            }
+            int remainClusterCnt = mergeSteps(seedCnt, seedCnt - step, utilValues, sumValues, minHeap, alive, clusterMerges, clusterMergeCosts, true);
+            releaseMergeState(seedCnt, utilValues, sumValues);
+            MemoryTracker::Release(MEMORY_MERGE, mergeBytes);
+            if (remainClusterCnt > 2) {
+                // a cancelled merge leaves no hierarchy to step through
+                delete[] clusterMerges;
+                delete[] clusterMergeCosts;
+                clusterMerges = NULL;
+                clusterMergeCosts = NULL;
+                return;
+            }
+        }
+        buildClusterSteps(seedCnt);
+    }
+
+    // Merges the clusters greedily by the border sums, merges and mergeCosts receive
+    // the seedCnt - 2 steps; false when cancelled half way. Only step 4 itself
+    // reports progress, not the merges of a snapshot.
+    bool mergeBorders(int seedCnt, int *merges, double *mergeCosts, bool reportProgress) {
+        Trace::Begin("merge_costs");
+        long long mergeBytes = mergeStateBytes(seedCnt);
+        MemoryTracker::Allocate(MEMORY_MERGE, mergeBytes);
+        double ***utilValues = new double**[seedCnt];
+        for (int i = 0; i < seedCnt; ++i) {
+            utilValues[i] = new double*[seedCnt];
+            for (int j = 0; j < seedCnt; ++j) {
+                utilValues[i][j] = NULL;
+                // a pair shares a border while any dual edge is left on it
+                if (borderSum(i, j)[2] > 0.5) {
+                    utilValues[i][j] = new double[5];
+                    utilValues[i][j][0] = borderSum(i, j)[0];
+                    utilValues[i][j][1] = borderSum(i, j)[1];
+                    for (int k = 2; k < 5; ++k) {
+                        utilValues[i][j][k] = 0.0;
+                    }
+                }
+            }
+        }
+
+        // compute D2, i.e. D(Si union Sj), L2, i.e. L(Si union Sj) and merging cost
+        double **sumValues = new double*[seedCnt];
+        for (int i = 0; i < seedCnt; ++i) {
+            sumValues[i] = new double[2];
+            double sumD = 0.0, sumL = 0.0;
+            for (int j = 0; j < seedCnt; ++j) {
+                if (utilValues[i][j]) {
+                    sumD += utilValues[i][j][0];
+                    sumL += utilValues[i][j][1];
+                }
+            }
+            sumValues[i][0] = sumD;
+            sumValues[i][1] = sumL;
+        }
+
+        IndexedHeap<double> minHeap(seedCnt * seedCnt);
+        for (int i = 0; i < seedCnt; ++i) {
+            for (int j = 0; j < seedCnt; ++j) {
+                if (utilValues[i][j]) {
+                    utilValues[i][j][2] = sumValues[i][0] + sumValues[j][0] - 2 * utilValues[i][j][0];
+                    utilValues[i][j][3] = sumValues[i][1] + sumValues[j][1] - 2 * utilValues[i][j][1];
+                    utilValues[i][j][4] = (utilValues[i][j][0] / utilValues[i][j][1]) / (utilValues[i][j][2] / utilValues[i][j][3]);
+                    if (i < j) {
+                        minHeap.Push(i * seedCnt + j, utilValues[i][j][4]);
+                    }
+                }
+            }
+        }
+
+        Trace::End();
+
+        vector<char> alive(seedCnt, 1);
+        int remainClusterCnt = mergeSteps(seedCnt, seedCnt, utilValues, sumValues, minHeap, alive, merges, mergeCosts, reportProgress);
+
+        releaseMergeState(seedCnt, utilValues, sumValues);
+        MemoryTracker::Release(MEMORY_MERGE, mergeBytes);
+        return remainClusterCnt <= 2;
+    }
+
+    // The greedy merge of mergeBorders from remainClusterCnt clusters down to two over
+    // its pair table, sumValues and heap; alive marks the clusters not merged away.
+    // Returns the clusters left, more than two when cancelled.
+    int mergeSteps(int seedCnt, int remainClusterCnt, double ***utilValues, double **sumValues, IndexedHeap<double>& minHeap, vector<char>& alive,
+        int *merges, double *mergeCosts, bool reportProgress) {
+        // start merging
+
+        // every re-keyed pair is a removal followed by a push
+        long long heapPushes = minHeap.Size(), heapPops = 0, rekeyed = 0;
+        while (remainClusterCnt > 2 && !Progress::IsCancelled()) {
+            if (reportProgress) {
+                Progress::Report(seedCnt - remainClusterCnt, seedCnt - 2);
+            }
+            TraceScope trace("merge_step", "pipeline", remainClusterCnt);
+            Trace::Counter("merge_heap_size", (double) minHeap.Size());
+            if (minHeap.Empty()) {
+                // the clusters left lie on separate bodies without a border between
+                // them, the two of lowest id are joined at the highest cost
+                int a = 0;
+                while (!alive[a]) {
+                    ++a;
+                }
+                int b = a + 1;
+                while (!alive[b]) {
+                    ++b;
+                }
+                alive[b] = 0;
+                --remainClusterCnt;
+                merges[2 * (seedCnt - remainClusterCnt - 1)] = a;
+                merges[2 * (seedCnt - remainClusterCnt - 1) + 1] = b;
+                mergeCosts[seedCnt - remainClusterCnt - 1] = DBL_MAX;
+                continue;
+            }
+            int tmp = minHeap.Top();
+            double mergeCost = minHeap.TopKey();
+            int clusterNumA, clusterNumB;
+
+            clusterNumA = tmp / seedCnt;
+            clusterNumB = tmp % seedCnt;
+
+            sumValues[clusterNumA][0] = utilValues[clusterNumA][clusterNumB][2];
+            sumValues[clusterNumA][1] = utilValues[clusterNumA][clusterNumB][3];
+            for (int i = 0; i < seedCnt; ++i) {
+                if (i == clusterNumA || i == clusterNumB) {
+                    continue;
+                }
+
+                if (utilValues[clusterNumA][i] && utilValues[clusterNumB][i]) {
+                    utilValues[clusterNumA][i][0] += utilValues[clusterNumB][i][0];
+                    utilValues[clusterNumA][i][1] += utilValues[clusterNumB][i][1];
+                    utilValues[clusterNumA][i][2] = sumValues[clusterNumA][0] + sumValues[i][0] - 2 * utilValues[clusterNumA][i][0];
+                    utilValues[clusterNumA][i][3] = sumValues[clusterNumA][1] + sumValues[i][1] - 2 * utilValues[clusterNumA][i][1];
+
+                    utilValues[i][clusterNumA][0] = utilValues[clusterNumA][i][0];
+                    utilValues[i][clusterNumA][1] = utilValues[clusterNumA][i][1];
+                    utilValues[i][clusterNumA][2] = utilValues[clusterNumA][i][2];
+                    utilValues[i][clusterNumA][3] = utilValues[clusterNumA][i][3];
+
+                    minHeap.Remove(computeHashValue(clusterNumA, i, seedCnt));
+                    ++heapPops;
+                    minHeap.Remove(computeHashValue(clusterNumB, i, seedCnt));
+                    ++heapPops;
+
+                    delete[] utilValues[clusterNumB][i];
+                    delete[] utilValues[i][clusterNumB];
+                    utilValues[clusterNumB][i] = NULL;
+                    utilValues[i][clusterNumB] = NULL;
 
                 } else if (utilValues[clusterNumA][i] && !utilValues[clusterNumB][i]) {
                     utilValues[clusterNumA][i][2] = sumValues[clusterNumA][0] + sumValues[i][0] - 2 * utilValues[clusterNumA][i][0];
@@ -463,7 +1681,8 @@ public:
                     utilValues[i][clusterNumA][2] = utilValues[clusterNumA][i][2];
                     utilValues[i][clusterNumA][3] = utilValues[clusterNumA][i][3];
 
-                    minHeap.erase(minHeap.find(make_pair(computeHashValue(clusterNumA, i, seedCnt), utilValues[clusterNumA][i][4])));
+                    minHeap.Remove(computeHashValue(clusterNumA, i, seedCnt));
+                    ++heapPops;
                 } else if (!utilValues[clusterNumA][i] && utilValues[clusterNumB][i]) {
                     utilValues[clusterNumA][i] = new double[5];
                     utilValues[clusterNumA][i][0] = utilValues[clusterNumB][i][0];
@@ -477,7 +1696,8 @@ public:
                     utilValues[i][clusterNumA][2] = utilValues[clusterNumA][i][2];
                     utilValues[i][clusterNumA][3] = utilValues[clusterNumA][i][3];
 
-                    minHeap.erase(minHeap.find(make_pair(computeHashValue(clusterNumB, i, seedCnt), utilValues[clusterNumB][i][4])));
+                    minHeap.Remove(computeHashValue(clusterNumB, i, seedCnt));
+                    ++heapPops;
 
                     delete[] utilValues[clusterNumB][i];
                     delete[] utilValues[i][clusterNumB];
@@ -487,32 +1707,42 @@ public:
                     continue;
                 }
 
-                if (abs(utilValues[clusterNumA][i][1] * utilValues[clusterNumA][i][2]) < 1e-3) {
-                    utilValues[clusterNumA][i][4] = DBL_MAX;
-                } else {
-                    utilValues[clusterNumA][i][4] = (utilValues[clusterNumA][i][0] * utilValues[clusterNumA][i][3]) / (utilValues[clusterNumA][i][1] * utilValues[clusterNumA][i][2]);
-                }
+                utilValues[clusterNumA][i][4] = MergeCost(utilValues[clusterNumA][i][0], utilValues[clusterNumA][i][1], utilValues[clusterNumA][i][2], utilValues[clusterNumA][i][3]);
                 utilValues[i][clusterNumA][4] = utilValues[clusterNumA][i][4];
-                minHeap.insert(make_pair(computeHashValue(clusterNumA, i, seedCnt), utilValues[clusterNumA][i][4]));
+                ++rekeyed;
+                minHeap.Push(computeHashValue(clusterNumA, i, seedCnt), utilValues[clusterNumA][i][4]);
+                ++heapPushes;
             }
 
-            minHeap.erase(make_pair(computeHashValue(clusterNumA, clusterNumB, seedCnt), utilValues[clusterNumA][clusterNumB][4]));
+            minHeap.Remove(computeHashValue(clusterNumA, clusterNumB, seedCnt));
+            ++heapPops;
             delete[] utilValues[clusterNumA][clusterNumB];
             delete[] utilValues[clusterNumB][clusterNumA];
             utilValues[clusterNumA][clusterNumB] = NULL;
             utilValues[clusterNumB][clusterNumA] = NULL;
 
+            alive[clusterNumB] = 0;
             --remainClusterCnt;
 
-            for (int i = 0; i < seedCnt; ++i) {
-                if (clusterSteps[seedCnt - remainClusterCnt - 1][i] == clusterNumB) {
-                    clusterSteps[seedCnt - remainClusterCnt][i] = clusterNumA;
-                } else {
-                    clusterSteps[seedCnt - remainClusterCnt][i] = clusterSteps[seedCnt - remainClusterCnt - 1][i];
-                }
-            }
+            merges[2 * (seedCnt - remainClusterCnt - 1)] = clusterNumA;
+            merges[2 * (seedCnt - remainClusterCnt - 1) + 1] = clusterNumB;
+            mergeCosts[seedCnt - remainClusterCnt - 1] = mergeCost;
         }
 
+        PerfCounters::Add(PERF_HEAP_PUSHES, heapPushes);
+        PerfCounters::Add(PERF_HEAP_POPS, heapPops);
+        PerfCounters::Add(PERF_DECREASE_KEYS, rekeyed);
+        return remainClusterCnt;
+    }
+
+    // pointer table plus a cost record for every pair at worst
+    // pair costs are queued by pair id, see computeHashValue
+    static long long mergeStateBytes(int seedCnt) {
+        return (long long) seedCnt * seedCnt * (sizeof(double*) + 5 * sizeof(double)) + seedCnt * 2 * sizeof(double)
+            + IndexedHeap<double>::Bytes(seedCnt * seedCnt, false);
+    }
+
+    void releaseMergeState(int seedCnt, double ***utilValues, double **sumValues) {
         for (int i = 0; i < seedCnt; ++i) {
             for (int j = 0; j < seedCnt; ++j) {
                 if (utilValues[i][j]) {
@@ -529,244 +1759,652 @@ public:
         delete[] sumValues;
     }
 
-    unordered_map< int, List<int>* >* clusterDivision(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor, const vtkSmartPointer<vtkPlane>& cutPlane, int pickId, DisjointSet* &S) {
-        double origin[3], normal[3];
-        cutPlane->GetOrigin(origin);
-        cutPlane->GetNormal(normal);
+    // Steps 3.2 and 3.3 on one graph: distance fields are computed batchSize at a time
+    // into a face-major block layout and folded into the nearest center so far, so
+    // only one batch of F-sized tables is alive at once
+    void assignNearest(const DualGraph *graph, const int *centerIds, int centerCnt, Engine::Distance *minDis, Engine::Label *minDisId, double *dur) {
+        int faceCnt = graph->numberOfFaces;
+        double begin, end;
+        if (!Engine::Fits(centerCnt)) {
+            // labels would wrap onto other centers and Unassigned, every face stays unassigned
+            cout << centerCnt << " centers are more than the engine labels can hold" << endl;
+            for (int i = 0; i < faceCnt; ++i) {
+                minDis[i] = Engine::Infinity();
+                minDisId[i] = Engine::Unassigned();
+            }
+            return;
+        }
 
-        int targetCluster = faceIdToClusterMap[pickId];
-        vtkSmartPointer<vtkIdTypeArray>& targetArray = clusterFaceIds[targetCluster];
-        if (S) {
-            delete S;
+        int batchSize = getDistanceBatchSize(faceCnt);
+        if (batchSize > centerCnt) {
+            batchSize = centerCnt;
         }
-        S = new DisjointSet(numberOfFaces);
-        for (int i = 0; i < targetArray->GetNumberOfTuples(); ++i) {
-            S->MakeSet(targetArray->GetValue(i));
+        EdgeWeights<Engine::Distance> weights(graph);
+        DistanceBlocks<Engine> *blocks = new DistanceBlocks<Engine>(faceCnt, batchSize);
+        long long blockBytes = DistanceBlocks<Engine>::Bytes(faceCnt, batchSize);
+        MemoryTracker::Allocate(MEMORY_DISTANCES, blockBytes);
+        for (int i = 0; i < faceCnt; ++i) {
+            minDis[i] = Engine::Infinity();
+            minDisId[i] = Engine::Unassigned();
         }
 
-        vtkSmartPointer<vtkEdgeListIterator> edgeIt = vtkSmartPointer<vtkEdgeListIterator>::New();
-        g->GetEdges(edgeIt);
-        while (edgeIt->HasNext()) {
-            vtkEdgeType edge = edgeIt->Next();
-            if (faceIdToClusterMap[edge.Source] == targetCluster && faceIdToClusterMap[edge.Target] == targetCluster) {
-                double *p1, *p2;
-                p1 = centers->GetTuple(edge.Source);
-                bool f1 = (normal[0] * (p1[0] - origin[0]) + normal[1] * (p1[1] - origin[1]) + normal[2] * (p1[2] - origin[2])) > 0;
-                p2 = centers->GetTuple(edge.Target);
-                bool f2 = (normal[0] * (p2[0] - origin[0]) + normal[1] * (p2[1] - origin[1]) + normal[2] * (p2[2] - origin[2])) > 0;
-
-                if (!(f1 ^ f2) && S->FindSet(edge.Source) != S->FindSet(edge.Target)) {
-                    S->Union(edge.Source, edge.Target);
+        // one heap per slot, reused by every batch
+        IndexedHeap<Engine::Distance> *heaps = new IndexedHeap<Engine::Distance>[batchSize];
+        long long heapBytes = batchSize * IndexedHeap<Engine::Distance>::Bytes(faceCnt, true);
+        MemoryTracker::Allocate(MEMORY_DISTANCES, heapBytes);
+        future<void> *getDijkstraResult = new future<void>[batchSize];
+        for (int first = 0; first < centerCnt; first += batchSize) {
+            int cnt = centerCnt - first < batchSize ? centerCnt - first : batchSize;
+
+            begin = WallTimer::Now();
+            Trace::Begin("dijkstra_tables", "pipeline", first);
+            for (int i = 0; i < cnt; ++i) {
+                int centerId = centerIds[first + i];
+                const Engine::Distance *weightData = weights.Data();
+                IndexedHeap<Engine::Distance> *heap = &heaps[i];
+                getDijkstraResult[i] = async([=]() {
+                    getDijkstraTable(graph, centerId, weightData, blocks, i, heap);
+                });
+            }
+            for (int i = 0; i < cnt; ++i) {
+                getDijkstraResult[i].get();
+                // chunks and coarse levels report on their own
+                if (graph == dualGraph || graph == vertexGraph) {
+                    Progress::Report(first + i + 1, centerCnt);
                 }
             }
-        }
-
-        unordered_map< int, List<int>* > *divMap = new unordered_map< int, List<int>* >;
-        for (int i = 0; i < targetArray->GetNumberOfTuples(); ++i) {
-            int faceId = targetArray->GetValue(i);
-            int setId = S->FindSet(faceId);
-
-            if (!(*divMap)[setId]) {
-                (*divMap)[setId] = new List<int>;
+            end = WallTimer::Now();
+            Trace::End();
+            dur[1] += end - begin;
+            if (Progress::IsCancelled()) {
+                break;
             }
-            (*divMap)[setId]->push_back(faceId);
-        }
 
-        return divMap;
+            // Step 3.3
+            begin = WallTimer::Now();
+            Trace::Begin("nearest_cluster", "pipeline", first);
+            blocks->FoldNearest(cnt, first, minDis, minDisId);
+            end = WallTimer::Now();
+            Trace::End();
+            dur[2] += end - begin;
+        }
+        delete[] getDijkstraResult;
+        delete[] heaps;
+        MemoryTracker::Release(MEMORY_DISTANCES, heapBytes);
+        delete blocks;
+        MemoryTracker::Release(MEMORY_DISTANCES, blockBytes);
     }
 
-    vtkSmartPointer<vtkActor> drawContour(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor, double planePoints[3][3], vtkSmartPointer<vtkPlane>& cutPlane, vtkSmartPointer<vtkActor> lastActor) {
-        vtkSmartPointer<vtkPlane> plane = vtkSmartPointer<vtkPlane>::New();
-        plane->SetOrigin(planePoints[0]);
-        double a[3] = { planePoints[0][0] - planePoints[1][0], planePoints[0][1] - planePoints[1][1], planePoints[0][2] - planePoints[1][2] };
-        double b[3] = { planePoints[0][0] - planePoints[2][0], planePoints[0][1] - planePoints[2][1], planePoints[0][2] - planePoints[2][2] };
-        double n[3] = { 0, 0, 0 };
-        vtkMath::Cross(a, b, n);
-        plane->SetNormal(n);
+    // Steps 3.2 and 3.3 on a mesh of several bodies. The components with centers are
+    // taken largest first, the ones below componentBatchFaces batched together, and
+    // every task runs one multi-source Dijkstra from its centers, see
+    // ComputeNearestSources. Tasks are handed out to the hardware threads one at a
+    // time; labels and distances come out the same as from assignNearest.
+    void assignComponents(const GraphComponents *parts, const int *centerIds, Engine::Distance *minDis, Engine::Label *minDisId, double *dur) {
+        typedef pair<Engine::Distance, Engine::Label> SourceKey;
+        double begin = WallTimer::Now();
+        for (int i = 0; i < numberOfFaces; ++i) {
+            minDis[i] = Engine::Infinity();
+            minDisId[i] = Engine::Unassigned();
+        }
 
-        vtkSmartPointer<vtkCutter> cutter = vtkSmartPointer<vtkCutter>::New();
-        cutter->SetCutFunction(plane);
-        cutter->SetInputData(Data);
-        cutter->Update();
+        // the centers of every component, by counting
+        int componentCnt = parts->Count();
+        const int *componentOf = parts->ComponentOf();
+        vector<int> centerOffsets(componentCnt + 1, 0), centerOrder(clusterCnt);
+        for (int i = 0; i < clusterCnt; ++i) {
+            ++centerOffsets[componentOf[centerIds[i]] + 1];
+        }
+        for (int c = 0; c < componentCnt; ++c) {
+            centerOffsets[c + 1] += centerOffsets[c];
+        }
+        vector<int> fill(centerOffsets.begin(), centerOffsets.end() - 1);
+        for (int i = 0; i < clusterCnt; ++i) {
+            centerOrder[fill[componentOf[centerIds[i]]]++] = i;
+        }
 
-        vtkSmartPointer<vtkPolyDataMapper> cutterMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-        cutterMapper->SetInputConnection(cutter->GetOutputPort());
+        vector< pair<int, int> > bySize;
+        for (int c = 0; c < componentCnt; ++c) {
+            if (centerOffsets[c + 1] > centerOffsets[c]) {
+                bySize.push_back(make_pair(-parts->Size(c), c));
+            }
+        }
+        sort(bySize.begin(), bySize.end());
+
+        // sources and labels of every task, task t owning taskOffsets[t] onwards
+        vector<int> sources, taskOffsets(1, 0);
+        vector<Engine::Label> sourceLabels;
+        int batched = 0;
+        for (size_t i = 0; i < bySize.size(); ++i) {
+            int c = bySize[i].second;
+            for (int k = centerOffsets[c]; k < centerOffsets[c + 1]; ++k) {
+                sources.push_back(centerIds[centerOrder[k]]);
+                sourceLabels.push_back((Engine::Label) centerOrder[k]);
+            }
+            batched -= bySize[i].first;
+            if (batched >= componentBatchFaces || i + 1 == bySize.size()) {
+                taskOffsets.push_back((int) sources.size());
+                batched = 0;
+            }
+        }
+        int taskCnt = (int) taskOffsets.size() - 1;
+
+        // one heap per worker over the whole mesh, as many workers as the budget allows
+        long long heapBytes = IndexedHeap<SourceKey>::Bytes(numberOfFaces, false);
+        int threadCnt = thread::hardware_concurrency();
+        threadCnt = threadCnt > 0 ? threadCnt : 4;
+        threadCnt = threadCnt < taskCnt ? threadCnt : (taskCnt > 0 ? taskCnt : 1);
+        if (memoryBudget > 0) {
+            long long fit = (memoryBudget - MemoryTracker::CurrentTotal()) / heapBytes;
+            threadCnt = fit < threadCnt ? (fit > 1 ? (int) fit : 1) : threadCnt;
+        }
+        cout << "components : " << componentCnt << " bodies, " << bySize.size() << " seeded, in " << taskCnt << " tasks on "
+            << threadCnt << " threads" << endl;
+
+        EdgeWeights<Engine::Distance> weights(dualGraph);
+        const Engine::Distance *weightData = weights.Data();
+        const DualGraph *graph = dualGraph;
+        MemoryTracker::Allocate(MEMORY_DISTANCES, threadCnt * heapBytes);
+        atomic<int> nextTask(0), doneTasks(0);
+        vector< future<void> > workers;
+        for (int t = 0; t < threadCnt; ++t) {
+            workers.push_back(async(launch::async, [&]() {
+                IndexedHeap<SourceKey> heap;
+                int task;
+                while ((task = nextTask++) < taskCnt && !Progress::IsCancelled()) {
+                    TraceScope trace("segment_components", "pipeline", task);
+                    int first = taskOffsets[task];
+                    ComputeNearestSources<Engine>(graph, weightData, &sources[first], &sourceLabels[first], taskOffsets[task + 1] - first,
+                        minDis, minDisId, &heap);
+                    Progress::Report(++doneTasks, taskCnt);
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); ++t) {
+            workers[t].get();
+        }
+        MemoryTracker::Release(MEMORY_DISTANCES, threadCnt * heapBytes);
+        // tables and folding happen together in one search
+        dur[1] += WallTimer::Now() - begin;
+    }
 
-        vtkSmartPointer<vtkActor> planeActor = vtkSmartPointer<vtkActor>::New();
-        planeActor->GetProperty()->SetColor(0, 0, 0);
-        planeActor->GetProperty()->SetLineWidth(2);
-        planeActor->SetMapper(cutterMapper);
+    // Components no center fell into, as seeds picked by hand may leave them, go whole
+    // to the cluster whose center is closest to their area weighted centroid; labels
+    // are per face, unassigned where no center reached
+    template <class Label>
+    void labelUnseededComponents(const vtkIdType *clusterCenterIds, Label *labels, Label unassigned) {
+        GraphComponents *parts = getComponents();
+        if (parts->Count() < 2 || clusterCnt == 0) {
+            return;
+        }
+        for (int c = 0; c < parts->Count(); ++c) {
+            const int *faces = parts->Faces(c);
+            bool seeded = false;
+            for (int k = 0; k < parts->Size(c) && !seeded; ++k) {
+                seeded = labels[faces[k]] != unassigned;
+            }
+            if (seeded) {
+                continue;
+            }
 
-        vtkRenderer *renderer = interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer();
-        if (lastActor) {
-            renderer->RemoveActor(lastActor);
+            double centroid[3] = { 0, 0, 0 }, area = parts->Area(c);
+            for (int k = 0; k < parts->Size(c); ++k) {
+                const double *center = dualGraph->Center(faces[k]);
+                double weight = area > 0 ? dualGraph->areas[faces[k]] / area : 1.0 / parts->Size(c);
+                centroid[0] += weight * center[0];
+                centroid[1] += weight * center[1];
+                centroid[2] += weight * center[2];
+            }
+            int nearest = 0;
+            double nearestDis2 = -1;
+            for (int i = 0; i < clusterCnt; ++i) {
+                double dis2 = vtkMath::Distance2BetweenPoints(centroid, dualGraph->Center((int) clusterCenterIds[i]));
+                if (nearestDis2 < 0 || dis2 < nearestDis2) {
+                    nearest = i;
+                    nearestDis2 = dis2;
+                }
+            }
+            for (int k = 0; k < parts->Size(c); ++k) {
+                labels[faces[k]] = (Label) nearest;
+            }
+            cout << "components : " << parts->Size(c) << " faces without a seed joined cluster " << nearest << endl;
         }
-        renderer->AddActor(planeActor);
-        interactor->GetRenderWindow()->Render();
+    }
 
-        cutPlane = plane;
-        return planeActor;
+    // faces the multilevel hierarchy coarsens to, never fewer than multilevelClusterFaces
+    // per cluster so the centers can spread over the coarsest level
+    int coarseTarget() {
+        int coarseFaces = multilevelFaces > 0 ? multilevelFaces : progressiveFaces;
+        return max(coarseFaces, multilevelClusterFaces * clusterCnt);
     }
 
-    void HighlightDivision(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor, unordered_map< int, List<int>* > *divMap, int pickId, DisjointSet *S, vtkSmartPointer<vtkActor> lastActor) {
-        int targetCluster = faceIdToClusterMap[pickId];
-        int targetSet = S->FindSet(pickId);
+    // Multilevel Steps 3.2 and 3.3: the distance fields run on the coarsest level of
+    // the hierarchy only, then labels and distances are projected down level by level
+    // and the faces along cluster borders are re-assigned, see RefineBoundary. With
+    // deliver, a snapshot of the coarsest level and of every refined level above the
+    // finest is passed on.
+    void assignMultilevel(const vtkIdType *clusterCenterIds, Engine::Distance *minDis, Engine::Label *minDisId, double *dur,
+        SnapshotCallback deliver = NULL, void *data = NULL) {
+        double begin = WallTimer::Now();
+        if (!hierarchy) {
+            TraceScope trace("coarsen");
+            hierarchy = new MultilevelHierarchy(dualGraph, coarseTarget());
+        }
+        // two centers on one coarse node would leave a cluster without a source, the
+        // labeling starts on the coarsest level where every center has a node of its own
+        int coarsest = hierarchy->Levels() - 1;
+        int *centerIds = new int[clusterCnt];
+        unordered_set<int> centerNodes;
+        for (; coarsest > 0; --coarsest) {
+            centerNodes.clear();
+            for (int i = 0; i < clusterCnt; ++i) {
+                centerIds[i] = hierarchy->Ancestor((int) clusterCenterIds[i], coarsest);
+                centerNodes.insert(centerIds[i]);
+            }
+            if ((int) centerNodes.size() == clusterCnt) {
+                break;
+            }
+        }
+        if (coarsest == 0) {
+            for (int i = 0; i < clusterCnt; ++i) {
+                centerIds[i] = (int) clusterCenterIds[i];
+            }
+        }
+        const DualGraph *coarse = hierarchy->Graph(coarsest);
+        cout << "multilevel : " << coarsest << " coarser levels used of " << hierarchy->Levels() - 1 << ", "
+            << coarse->numberOfFaces << " faces on the coarsest" << endl;
+        dur[1] += WallTimer::Now() - begin;
+
+        // with no coarse level left the mesh is labeled straight into the output arrays
+        Engine::Distance *levelDis = coarsest ? new Engine::Distance[coarse->numberOfFaces] : minDis;
+        Engine::Label *levelIds = coarsest ? new Engine::Label[coarse->numberOfFaces] : minDisId;
+        long long levelBytes = coarsest ? (long long) coarse->numberOfFaces * (sizeof(Engine::Distance) + sizeof(Engine::Label)) : 0;
+        MemoryTracker::Allocate(MEMORY_ASSIGNMENT, levelBytes);
+        assignNearest(coarse, centerIds, clusterCnt, levelDis, levelIds, dur);
+        if (deliver && coarsest) {
+            deliverSnapshot(levelIds, coarsest, false, deliver, data);
+        }
 
-        List<int> *setIds = (*divMap)[targetSet];
-        clusterFaceIds[clusterCnt] = vtkSmartPointer<vtkIdTypeArray>::New();
-        clusterFaceIds[clusterCnt]->SetNumberOfComponents(1);
+        begin = WallTimer::Now();
+        for (int level = coarsest - 1; level >= 0; --level) {
+            TraceScope trace("refine_level", "pipeline", level);
+            const DualGraph *graph = hierarchy->Graph(level);
+            const int *parents = hierarchy->Parents(level);
+
+            // the finest level lands in the output arrays
+            Engine::Distance *fineDis = level ? new Engine::Distance[graph->numberOfFaces] : minDis;
+            Engine::Label *fineIds = level ? new Engine::Label[graph->numberOfFaces] : minDisId;
+            long long fineBytes = level ? (long long) graph->numberOfFaces * (sizeof(Engine::Distance) + sizeof(Engine::Label)) : 0;
+            MemoryTracker::Allocate(MEMORY_ASSIGNMENT, fineBytes);
+            for (int i = 0; i < graph->numberOfFaces; ++i) {
+                fineDis[i] = levelDis[parents[i]];
+                fineIds[i] = levelIds[parents[i]];
+            }
+            delete[] levelDis;
+            delete[] levelIds;
+            MemoryTracker::Release(MEMORY_ASSIGNMENT, levelBytes);
+            levelDis = fineDis;
+            levelIds = fineIds;
+            levelBytes = fineBytes;
 
-        bool *localMap = new bool[numberOfFaces];
-        memset(localMap, 0, numberOfFaces * sizeof(bool));
-        for (List<int>::iterator it = setIds->begin(); it != NULL; it = it->next) {
-            localMap[it->key] = true;
-            clusterFaceIds[clusterCnt]->InsertNextValue(it->key);
-            faceIdToClusterMap[it->key] = clusterCnt;
+            for (int i = 0; i < clusterCnt; ++i) {
+                centerIds[i] = hierarchy->Ancestor((int) clusterCenterIds[i], level);
+            }
+            // cancelled, the labels are only projected down to the finest level
+            if (!Progress::IsCancelled()) {
+                EdgeWeights<Engine::Distance> weights(graph);
+                RefineBoundary<Engine>(graph, weights.Data(), centerIds, clusterCnt, multilevelBand, levelDis, levelIds);
+            }
+            Progress::Report(coarsest - level, coarsest);
+            if (deliver && level > 0) {
+                deliverSnapshot(levelIds, level, false, deliver, data);
+            }
         }
-        clusterStatuses[clusterCnt] = STATUS_ACTIVE;
+        dur[2] += WallTimer::Now() - begin;
 
-        vtkSmartPointer<vtkIdTypeArray> tmpFaceIds = vtkSmartPointer<vtkIdTypeArray>::New();
-        tmpFaceIds->SetNumberOfComponents(1);
-        for (int i = 0; i < clusterFaceIds[targetCluster]->GetNumberOfTuples(); ++i) {
-            int faceId = clusterFaceIds[targetCluster]->GetValue(i);
-            if (!localMap[faceId]) {
-                tmpFaceIds->InsertNextValue(faceId);
+        delete[] centerIds;
+    }
+
+    // Steps 3.2 and 3.3 on the vertex graph: every center face hands its distance field
+    // to one of its corners no earlier center took, or to the free vertex fewest edges
+    // away when all three are taken, so centers only share a source on a body with
+    // fewer vertices than centers. The vertices are assigned by assignNearest and every
+    // face is voted the label of at least two of its corners, or of its nearest corner
+    // when all three differ. Its distance is that of the winning corner. Center faces
+    // keep their own cluster.
+    void assignVertices(const vtkIdType *clusterCenterIds, Engine::Distance *minDis, Engine::Label *minDisId, double *dur) {
+        int vertexCnt = vertexGraph->numberOfFaces;
+        int *centerIds = new int[clusterCnt];
+        vector<char> taken(vertexCnt, 0);
+        for (int i = 0; i < clusterCnt; ++i) {
+            const int *corners = faceVertices + 3 * clusterCenterIds[i];
+            int j = 0;
+            while (j < 2 && taken[corners[j]]) {
+                ++j;
             }
+            int source = corners[j];
+            if (taken[source]) {
+                // breadth first until a free vertex turns up, a body with every vertex
+                // taken keeps the shared one
+                vector<int> queue(corners, corners + 3);
+                unordered_set<int> seen(corners, corners + 3);
+                for (size_t q = 0; q < queue.size() && taken[source]; ++q) {
+                    int u = queue[q];
+                    for (int k = vertexGraph->offsets[u]; k < vertexGraph->offsets[u + 1]; ++k) {
+                        int v = vertexGraph->neighbors[k];
+                        if (seen.insert(v).second) {
+                            queue.push_back(v);
+                            if (!taken[v]) {
+                                source = v;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+            centerIds[i] = source;
+            taken[source] = 1;
         }
+        cout << "vertex graph : " << vertexCnt << " vertices for " << numberOfFaces << " faces" << endl;
 
-        clusterFaceIds[targetCluster] = vtkSmartPointer<vtkIdTypeArray>::New();
-        clusterFaceIds[targetCluster]->DeepCopy(tmpFaceIds);
+        Engine::Distance *vertexDis = new Engine::Distance[vertexCnt];
+        Engine::Label *vertexIds = new Engine::Label[vertexCnt];
+        long long vertexBytes = (long long) vertexCnt * (sizeof(Engine::Distance) + sizeof(Engine::Label));
+        MemoryTracker::Allocate(MEMORY_ASSIGNMENT, vertexBytes);
+        assignNearest(vertexGraph, centerIds, clusterCnt, vertexDis, vertexIds, dur);
 
-        vtkRenderer *renderer = interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer();
-        if (lastActor) {
-            renderer->RemoveActor(lastActor);
+        double begin = WallTimer::Now();
+        Trace::Begin("vote_faces");
+        for (int i = 0; i < numberOfFaces; ++i) {
+            const int *corners = faceVertices + 3 * i;
+            int best = -1, bestVotes = 0;
+            for (int j = 0; j < 3; ++j) {
+                int v = corners[j];
+                if (vertexIds[v] == Engine::Unassigned()) {
+                    continue;
+                }
+                int votes = 0;
+                for (int k = 0; k < 3; ++k) {
+                    votes += vertexIds[corners[k]] == vertexIds[v];
+                }
+                if (votes > bestVotes || (votes == bestVotes && (vertexDis[v] < vertexDis[best]
+                    || (vertexDis[v] == vertexDis[best] && vertexIds[v] < vertexIds[best])))) {
+                    best = v;
+                    bestVotes = votes;
+                }
+            }
+            minDis[i] = best >= 0 ? vertexDis[best] : Engine::Infinity();
+            minDisId[i] = best >= 0 ? vertexIds[best] : Engine::Unassigned();
         }
+        // the lowest label wins a face several centers share, as on the faces
+        for (int i = clusterCnt - 1; i >= 0; --i) {
+            minDis[clusterCenterIds[i]] = 0;
+            minDisId[clusterCenterIds[i]] = (Engine::Label) i;
+        }
+        Trace::End();
+        dur[2] += WallTimer::Now() - begin;
 
-        unsigned char gray[4] = { 212, 212, 212, 255 };
-        highlightFace(interactor, clusterFaceIds[clusterCnt], gray);
-
-        delete[] localMap;
+        delete[] vertexDis;
+        delete[] vertexIds;
+        MemoryTracker::Release(MEMORY_ASSIGNMENT, vertexBytes);
+        delete[] centerIds;
     }
 
-    int HighlightCluster(const vtkSmartPointer<vtkCellPicker>& picker, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor, int lastClusterId, int beginClusterId) {
-        int pickId = picker->GetCellId();
-        if (pickId != -1) {
-            int clusterId = faceIdToClusterMap[pickId];
+    // Out-of-core Steps 3.2 and 3.3: every chunk is cut out of the dual graph with a
+    // halo around it and assigned on its own, with the seeded centers that fall into
+    // it plus a few spread along the chunk so no chunk is left without one. Only the
+    // core faces keep their label. The clusters of all chunks are then merged back to
+    // clusterCnt by merge cost, see ReconcileChunkClusters. The face map holds the chunk
+    // marks until a chunk is labeled, so apart from it all state is sized by the chunk.
+    void assignChunks(const vtkIdType *clusterCenterIds, double *dur) {
+        double begin = WallTimer::Now();
+        GraphChunks *chunks;
+        vector<int> chunkSizes;
+        {
+            TraceScope trace("partition_chunks");
+            chunks = new GraphChunks(dualGraph, outOfCoreFaces);
+            chunks->MarkFaces(dualGraph, faceIdToClusterMap, chunkSizes);
+        }
+        cout << "out of core : " << chunks->Count() << " chunks of about " << outOfCoreFaces << " faces"
+            << (dualGraph->IsMapped() ? ", dual graph mapped from the cache" : "") << endl;
 
-            if (lastClusterId >= 0 && clusterStatuses[lastClusterId] == STATUS_ACTIVE) {
-                if (lastClusterId == clusterId) {
-                    return lastClusterId;
-                } else if (lastClusterId != beginClusterId) {
-                    highlightFace(interactor, clusterFaceIds[lastClusterId], clusterColors[colorHashMap[lastClusterId]]);
+        unordered_map<int, int> centerIndex;
+        for (int i = clusterCnt - 1; i >= 0; --i) {
+            centerIndex[(int) clusterCenterIds[i]] = i;
+        }
+        dur[1] += WallTimer::Now() - begin;
+
+        // seeded clusters keep their ids, the ones a chunk adds are numbered after them
+        int labelCnt = clusterCnt;
+        vector<int> core, globalIds, centerIds, centerLabels;
+        unordered_map<int, int> localIds;
+        for (int chunk = 0; chunk < chunks->Count() && !Progress::IsCancelled(); ++chunk) {
+            Progress::Report(chunk, chunks->Count());
+            if (chunkSizes[chunk] == 0) {
+                continue;
+            }
+            TraceScope trace("segment_chunk", "pipeline", chunk);
+            begin = WallTimer::Now();
+            chunks->Faces(dualGraph, chunk, faceIdToClusterMap, core);
+            DualGraph *local = GraphChunks::Extract(dualGraph, core, outOfCoreHalo, globalIds, localIds);
+            int localCnt = local->numberOfFaces;
+            int coreCnt = (int) core.size();
+
+            centerIds.clear();
+            centerLabels.clear();
+            int coreCenters = 0;
+            for (int i = 0; i < localCnt; ++i) {
+                unordered_map<int, int>::iterator it = centerIndex.find(globalIds[i]);
+                if (it != centerIndex.end()) {
+                    centerIds.push_back(i);
+                    centerLabels.push_back(it->second);
+                    coreCenters += i < coreCnt;
                 }
             }
-
-            if (clusterId == -1 || clusterStatuses[clusterId] != STATUS_ACTIVE) {
-                return -1;
+            // the chunk's share of clusterCnt, core faces run along the Hilbert curve
+            int quota = (int) (((long long) clusterCnt * coreCnt + numberOfFaces - 1) / numberOfFaces);
+            int extraCnt = (quota > 1 ? quota : 1) - coreCenters;
+            for (int i = 0; i < extraCnt; ++i) {
+                centerIds.push_back((int) ((2LL * i + 1) * coreCnt / (2 * extraCnt)));
+                centerLabels.push_back(labelCnt++);
+            }
+            dur[1] += WallTimer::Now() - begin;
+
+            Engine::Distance *localDis = new Engine::Distance[localCnt];
+            Engine::Label *localLabels = new Engine::Label[localCnt];
+            long long localBytes = (long long) localCnt * (sizeof(Engine::Distance) + sizeof(Engine::Label));
+            MemoryTracker::Allocate(MEMORY_ASSIGNMENT, localBytes);
+            assignNearest(local, &centerIds[0], (int) centerIds.size(), localDis, localLabels, dur);
+            for (int i = 0; i < coreCnt; ++i) {
+                faceIdToClusterMap[core[i]] = localLabels[i] != Engine::Unassigned() ? centerLabels[localLabels[i]] : -1;
             }
+            delete[] localDis;
+            delete[] localLabels;
+            MemoryTracker::Release(MEMORY_ASSIGNMENT, localBytes);
+            delete local;
+        }
+        // a cancelled run leaves no marks behind
+        for (int i = 0; i < numberOfFaces && Progress::IsCancelled(); ++i) {
+            faceIdToClusterMap[i] = faceIdToClusterMap[i] < -1 ? -1 : faceIdToClusterMap[i];
+        }
 
-            if (clusterId == beginClusterId) {
-                return clusterId;
+        begin = WallTimer::Now();
+        {
+            TraceScope trace("reconcile_chunks");
+            int remainCnt = ReconcileChunkClusters(dualGraph, faceIdToClusterMap, labelCnt, clusterCnt, chunks, clusterCnt);
+            cout << "out of core : " << labelCnt << " chunk clusters merged into " << remainCnt << endl;
+            if (remainCnt < clusterCnt) {
+                cout << "out of core : only " << remainCnt << " clusters for " << clusterCnt << " seeds" << endl;
             }
+        }
+        dur[2] += WallTimer::Now() - begin;
+        delete chunks;
+    }
 
-            unsigned char color[4] = { 255, 255, 255, 255 };
-            faceColors->GetTupleValue(pickId, color);
-            int _r, _g, _b;
-            _r = color[0] * 1.2;
-            _g = color[1] * 1.2;
-            _b = color[2] * 1.2;
-            _r = _r > 255 ? 255 : _r;
-            _g = _g > 255 ? 255 : _g;
-            _b = _b > 255 ? 255 : _b;
-            unsigned char highlightColor[4] = { (unsigned char) _r, (unsigned char) _g, (unsigned char) _b, 255 };
-            highlightFace(interactor, clusterFaceIds[clusterId], highlightColor);
+    // Steps 3.1 to 3.3 in one pass: the mesh is oversegmented by GrowRegions and the
+    // regions merged down to clusterCnt by cost as chunk clusters are, separate bodies
+    // staying apart
+    void growClusters(double *dur) {
+        double begin = WallTimer::Now();
+        double threshold = regionThreshold;
+        int regionCnt;
+        {
+            TraceScope trace("grow_regions");
+            regionCnt = GrowRegions(dualGraph, threshold, faceIdToClusterMap);
+            // the merge needs a region for every cluster
+            for (int i = 0; i < 8 && regionCnt < clusterCnt; ++i) {
+                threshold /= 4;
+                regionCnt = GrowRegions(dualGraph, threshold, faceIdToClusterMap);
+            }
+        }
+        dur[1] += WallTimer::Now() - begin;
+        cout << "region growing : " << regionCnt << " regions at " << threshold << " times the mean edge weight" << endl;
+        if (Progress::IsCancelled()) {
+            return;
+        }
 
-            return clusterId;
-        } else if (lastClusterId >= 0 && lastClusterId != beginClusterId && clusterStatuses[lastClusterId] == STATUS_ACTIVE) {
-            highlightFace(interactor, clusterFaceIds[lastClusterId], clusterColors[colorHashMap[lastClusterId]]);
+        begin = WallTimer::Now();
+        {
+            TraceScope trace("merge_regions");
+            int remainCnt = ReconcileChunkClusters(dualGraph, faceIdToClusterMap, regionCnt, 0, NULL, clusterCnt);
+            if (remainCnt < clusterCnt) {
+                cout << "region growing : only " << remainCnt << " clusters for " << clusterCnt << " seeds" << endl;
+            }
         }
+        dur[2] += WallTimer::Now() - begin;
+    }
 
-        return -1;
+    // Sharded Steps 3.2 and 3.3, the labels go straight into the face map; false when
+    // the workers could not finish and the caller assigns in process instead
+    bool assignSharded(const vtkIdType *clusterCenterIds, double *dur) {
+        double begin = WallTimer::Now();
+        int *centerIds = new int[clusterCnt];
+        for (int i = 0; i < clusterCnt; ++i) {
+            centerIds[i] = (int) clusterCenterIds[i];
+        }
+        // the workers map the graph from the cache file, a graph that is not the mapping
+        // of it, built on the heap or patched by UpdateFaces, is written there first
+        bool ok = (dualGraph->IsMapped() && !patcher) || getCache()->SaveGraph(dualGraph);
+        if (ok) {
+            TraceScope trace("sharded_assign", "pipeline", shardCnt);
+            ok = AssignSharded(dualGraph, getCache()->GraphFileName(), shardCnt, centerIds, clusterCnt, faceIdToClusterMap);
+        }
+        delete[] centerIds;
+        // tables and folding happen together in the workers
+        dur[1] += WallTimer::Now() - begin;
+        return ok;
     }
 
-    void HighlightFace(int clusterId, const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
-        highlightFace(interactor, clusterFaceIds[clusterId], clusterColors[colorHashMap[clusterId]]);
+    // the heap is tracked by its owner
+    void getDijkstraTable(const DualGraph *graph, int faceId, const Engine::Distance *weights, DistanceBlocks<Engine> *blocks, int slot,
+        IndexedHeap<Engine::Distance> *heap) {
+        TraceScope trace("dijkstra", "pipeline", faceId);
+        int numberOfFaces = graph->numberOfFaces;
+        long long fieldBytes = (long long) numberOfFaces * sizeof(Engine::Distance);
+        MemoryTracker::Allocate(MEMORY_DISTANCES, fieldBytes);
+
+        Engine::Distance *distances = new Engine::Distance[numberOfFaces];
+        ComputeDistanceField<Engine>(graph, weights, faceId, distances, heap);
+        blocks->Store(slot, distances);
+        delete[] distances;
+
+        MemoryTracker::Release(MEMORY_DISTANCES, fieldBytes);
     }
 
-private:
-    inline int computeHashValue(int a, int b, int seedCnt) {
-        if (a < b) {
-            return a * seedCnt + b;
-        } else {
-            return b * seedCnt + a;
+    // built on first use, the faces of the dual graph never change their neighbors
+    GraphComponents* getComponents() {
+        if (!components) {
+            TraceScope trace("connected_components");
+            components = new GraphComponents(dualGraph);
         }
+        return components;
     }
 
-    double* getDijkstraTable(int faceId) {
-        double *distances = new double[numberOfFaces];
-
-        // initialize distance
-        for (int j = 0; j < numberOfFaces; ++j) {
-            distances[j] = DBL_MAX;
-        }
-        vtkSmartPointer<vtkInEdgeIterator> it = vtkSmartPointer<vtkInEdgeIterator>::New();
-        g->GetInEdges(faceId, it);
-        while (it->HasNext()) {
-            vtkInEdgeType edge = it->Next();
-            distances[edge.Source] = meshDis->GetValue(edge.Id);
+    // built on first use; a mesh that is not triangles only is not tried again
+    DualGraph* getVertexGraph() {
+        if (!vertexGraph && !faceVertices) {
+            TraceScope trace("build_vertex_graph");
+            faceVertices = new int[3 * numberOfFaces];
+            MemoryTracker::Allocate(MEMORY_DUAL_GRAPH, 3LL * numberOfFaces * sizeof(int));
+            vertexGraph = DualGraph::FromVertices(Data, weightParameters, faceVertices);
+            if (!vertexGraph) {
+                cout << "The vertex graph needs a triangle mesh, the faces are used instead" << endl;
+            }
         }
-        distances[faceId] = 0.0;
-
-        bool *S = new bool[numberOfFaces];
-        memset(S, 0, numberOfFaces * sizeof(bool));
-        S[faceId] = true;
+        return vertexGraph;
+    }
 
-        heapElem *disPairs = new heapElem[numberOfFaces];
-        for (int j = 0; j < numberOfFaces; ++j) {
-            disPairs[j] = make_pair(j, distances[j]);
+    void releaseVertexGraph() {
+        if (faceVertices) {
+            delete[] faceVertices;
+            faceVertices = NULL;
+            MemoryTracker::Release(MEMORY_DUAL_GRAPH, 3LL * numberOfFaces * sizeof(int));
         }
+        delete vertexGraph;
+        vertexGraph = NULL;
+    }
 
-        MinHeap<heapElem, heapElemComp> minHeap(disPairs, numberOfFaces);
-        minHeap.ExtractMin();
-
-        while (minHeap.Size()) {
-            // u = EXTRACT_MIN(Q)
-            int u = minHeap.ExtractMin().first;
+    SegmentationCache* getCache() {
+        if (!cache) {
+            cache = new SegmentationCache(Data, weightParameters);
+        }
+        return cache;
+    }
 
-            // S <- S union {u}
-            S[u] = true;
+    // whether the graph is too large to be built on the heap first, or shard workers
+    // will map it from the file anyway
+    bool streamGraph() {
+        return (outOfCoreFaces > 0 && Data->GetNumberOfCells() > outOfCoreFaces) || shardCnt > 1;
+    }
 
-            // for each vertex v in u's neighbor, do "relax" operation
-            vtkSmartPointer<vtkInEdgeIterator> uIt = vtkSmartPointer<vtkInEdgeIterator>::New();
-            g->GetInEdges(u, uIt);
-            while (uIt->HasNext()) {
-                vtkInEdgeType uEdge = uIt->Next();
-                int v = uEdge.Source;
-                if (S[v]) {
-                    continue;
-                }
+    void buildClusterSteps(int seedCnt) {
+        if (!clusterSteps) {
+            clusterSteps = new int*[seedCnt];
+            for (int i = 0; i < seedCnt; ++i) {
+                clusterSteps[i] = new int[seedCnt];
+            }
+        }
 
-                double tmp = distances[u] + meshDis->GetValue(uEdge.Id);
-                if (distances[v] > tmp) {
-                    distances[v] = tmp;
-                    minHeap.DecreaseKey(make_pair(v, tmp));
+        for (int i = 0; i < seedCnt; ++i) {
+            clusterSteps[0][i] = i;
+        }
+        for (int step = 1; step <= seedCnt - 2; ++step) {
+            int clusterNumA = clusterMerges[2 * (step - 1)];
+            int clusterNumB = clusterMerges[2 * (step - 1) + 1];
+            for (int i = 0; i < seedCnt; ++i) {
+                if (clusterSteps[step - 1][i] == clusterNumB) {
+                    clusterSteps[step][i] = clusterNumA;
+                } else {
+                    clusterSteps[step][i] = clusterSteps[step - 1][i];
                 }
             }
         }
+    }
 
-        delete[] disPairs;
-        delete[] S;
-
-        return distances;
+    void renderClusters(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor) {
+        for (int i = 0; i < clusterCnt; ++i) {
+            clusterStatuses[i] = STATUS_ACTIVE;
+            for (int j = 0; j < clusterFaceIds[i]->GetNumberOfTuples(); ++j) {
+                faceColors->SetTupleValue(clusterFaceIds[i]->GetValue(j), clusterColors[i]);
+            }
+        }
+        Data->GetCellData()->RemoveArray("Colors");
+        Data->GetCellData()->SetScalars(faceColors);
+        if (interactor) {
+            interactor->GetRenderWindow()->Render();
+        }
     }
 
     void highlightFace(const vtkSmartPointer<vtkRenderWindowInteractor>& interactor, const vtkSmartPointer<vtkIdTypeArray>& ids, unsigned char* color) {
+        TraceScope trace("recolor_faces", "ui", (int) ids->GetNumberOfTuples());
         for (int i = 0; i < ids->GetNumberOfTuples(); ++i) {
             faceColors->SetTupleValue(ids->GetValue(i), color);
         }
         Data->GetCellData()->RemoveArray("Colors");
         Data->GetCellData()->SetScalars(faceColors);
-        interactor->GetRenderWindow()->Render();
+        if (interactor) {
+            interactor->GetRenderWindow()->Render();
+        }
     }
 
     double* computeCenterCoordinate(const vtkSmartPointer<vtkIdTypeArray>& ids) {
@@ -776,10 +2414,10 @@ private:
         center[2] = 0.0;
 
         for (int i = 0; i < ids->GetNumberOfTuples(); ++i) {
-            int faceId = ids->GetValue(i);
-            center[0] += centers->GetTuple(faceId)[0];
-            center[1] += centers->GetTuple(faceId)[1];
-            center[2] += centers->GetTuple(faceId)[2];
+            const double *faceCenter = dualGraph->Center(ids->GetValue(i));
+            center[0] += faceCenter[0];
+            center[1] += faceCenter[1];
+            center[2] += faceCenter[2];
         }
 
         center[0] /= ids->GetNumberOfTuples();
@@ -794,7 +2432,7 @@ private:
         double minDis = DBL_MAX;
 
         for (int i = 0; i < numberOfFaces; ++i) {
-            double dis = vtkMath::Distance2BetweenPoints(center, centers->GetTuple(i));
+            double dis = vtkMath::Distance2BetweenPoints(center, dualGraph->Center(i));
             if (dis < minDis) {
                 minDis = dis;
                 centerId = i;
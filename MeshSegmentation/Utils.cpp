@@ -1,6 +1,8 @@
 #include "Utils.h"
 
 #include <cmath>
+#include <float.h>
+#include <string.h>
 
 unsigned char* HSVtoRGB(double h, double s, double v) {
     h *= 360.0;
@@ -48,4 +50,31 @@ unsigned char* HSVtoRGB(double h, double s, double v) {
     delete[] tmpArray;
 
     return res;
+}
+
+unsigned long long HashBytes(const void* data, size_t len, unsigned long long h) {
+    const unsigned long long prime = 0x100000001b3ULL;
+    const unsigned char *bytes = (const unsigned char *) data;
+
+    h ^= 0xcbf29ce484222325ULL;
+    // FNV-1a over 8 byte words, bytes for the tail
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        unsigned long long word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * prime;
+        h ^= h >> 29;
+    }
+    for (; i < len; ++i) {
+        h = (h ^ bytes[i]) * prime;
+    }
+
+    return h;
+}
+
+double MergeCost(double D1, double L1, double D2, double L2) {
+    if (fabs(L1 * D2) < 1e-3) {
+        return DBL_MAX;
+    }
+    return (D1 * L2) / (L1 * D2);
 }
\ No newline at end of file
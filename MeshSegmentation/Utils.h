@@ -1,3 +1,12 @@
 #pragma once
 
-extern unsigned char* HSVtoRGB(double h, double s, double v);
\ No newline at end of file
+#include <stddef.h>
+
+extern unsigned char* HSVtoRGB(double h, double s, double v);
+
+// 64-bit content hash, chained through h so several buffers can feed one key
+extern unsigned long long HashBytes(const void* data, size_t len, unsigned long long h);
+
+// cost of merging clusters A and B from the length weighted dual edge distance D and
+// edge length L of their shared border (D1, L1) and of the border of A union B (D2, L2)
+extern double MergeCost(double D1, double L1, double D2, double L2);
\ No newline at end of file
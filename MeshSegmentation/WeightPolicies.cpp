@@ -0,0 +1,101 @@
+#include "WeightPolicies.h"
+
+#include <vtkMath.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *policyNames[WEIGHT_POLICY_COUNT] = { "mixed", "dihedral", "curvature", "user", "custom" };
+
+void ComputeEdgeTerms(double areaI, double areaJ, const double *normalI, const double *normalJ, const double *centerI, const double *centerJ,
+    double length, DualEdgeTerms& terms) {
+    terms.phy = 2.0 * areaI / (3 * length) + 2.0 * areaJ / (3 * length);
+    terms.length = length;
+
+    double w[3] = { centerJ[0] - centerI[0], centerJ[1] - centerI[1], centerJ[2] - centerI[2] };
+    double cosine = vtkMath::Dot(normalI, normalJ);
+    terms.dihedral = 1 - cosine;
+    terms.angle = vtkMath::Dot(normalI, w) >= 0 ? 1 - cosine : 0.0;
+
+    double distance = vtkMath::Norm(w);
+    cosine = cosine > 1 ? 1 : (cosine < -1 ? -1 : cosine);
+    terms.curvature = distance > 0 ? acos(cosine) / distance : 0.0;
+}
+
+DualEdgeTerms AverageTerms(const DualEdgeTerms *terms, int cnt) {
+    DualEdgeTerms sum = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    for (int i = 0; i < cnt; ++i) {
+        sum.phy += terms[i].phy;
+        sum.angle += terms[i].angle;
+        sum.dihedral += terms[i].dihedral;
+        sum.curvature += terms[i].curvature;
+        sum.length += terms[i].length;
+    }
+    sum.phy /= cnt;
+    sum.angle /= cnt;
+    sum.dihedral /= cnt;
+    sum.curvature /= cnt;
+    sum.length /= cnt;
+    return sum;
+}
+
+void ComputeWeights(const DualEdgeTerms *terms, int cnt, const DualEdgeTerms& averages, const WeightParameters& p, double *weights) {
+    switch (p.policy) {
+    case WEIGHT_DIHEDRAL:
+        ApplyWeightPolicy<DihedralWeight>(terms, cnt, averages, p, weights);
+        break;
+    case WEIGHT_CURVATURE:
+        ApplyWeightPolicy<CurvatureWeight>(terms, cnt, averages, p, weights);
+        break;
+    case WEIGHT_USER:
+        ApplyWeightPolicy<UserWeight>(terms, cnt, averages, p, weights);
+        break;
+    case WEIGHT_CUSTOM:
+        p.customWeights(terms, cnt, averages, p, weights);
+        break;
+    default:
+        ApplyWeightPolicy<MixedWeight>(terms, cnt, averages, p, weights);
+        break;
+    }
+}
+
+double EdgeWeight(const DualEdgeTerms& terms, const DualEdgeTerms& averages, const WeightParameters& p) {
+    double weight;
+    ComputeWeights(&terms, 1, averages, p, &weight);
+    return weight;
+}
+
+bool ParseWeightParameters(const char *text, WeightParameters& p) {
+    const char *colon = strchr(text, ':');
+    size_t nameLen = colon ? (size_t) (colon - text) : strlen(text);
+    int policy = 0;
+    while (policy < WEIGHT_USER && (strlen(policyNames[policy]) != nameLen || strncmp(text, policyNames[policy], nameLen) != 0)) {
+        ++policy;
+    }
+    // user and custom weights only come from code
+    if (policy == WEIGHT_USER) {
+        return false;
+    }
+
+    p.policy = (WeightPolicyId) policy;
+    if (colon) {
+        double value = atof(colon + 1);
+        switch (p.policy) {
+        case WEIGHT_DIHEDRAL:
+            p.epsilon = value;
+            break;
+        case WEIGHT_CURVATURE:
+            p.curvatureGain = value;
+            break;
+        default:
+            p.delta = value;
+            break;
+        }
+    }
+    return true;
+}
+
+const char* WeightPolicyName(WeightPolicyId policy) {
+    return policyNames[policy];
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+
+// What the weight of a dual edge is built from, all of it taken from the two faces
+struct DualEdgeTerms {
+    double phy;         // geodesic, two thirds of both face areas over the shared edge length
+    double angle;       // 1 - cos of the dihedral angle on concave edges, 0 on convex ones
+    double dihedral;    // 1 - cos of the dihedral angle either way
+    double curvature;   // dihedral angle per unit distance between the face centers
+    double length;      // length of the shared edge
+};
+
+// terms of the dual edge from face i to face j, given their areas, normals and centers
+// and the length of the edge they share
+void ComputeEdgeTerms(double areaI, double areaJ, const double *normalI, const double *normalJ, const double *centerI, const double *centerJ,
+    double length, DualEdgeTerms& terms);
+
+// the mean of every term over cnt edges
+DualEdgeTerms AverageTerms(const DualEdgeTerms *terms, int cnt);
+
+enum WeightPolicyId { WEIGHT_MIXED, WEIGHT_DIHEDRAL, WEIGHT_CURVATURE, WEIGHT_USER, WEIGHT_CUSTOM, WEIGHT_POLICY_COUNT };
+
+struct WeightParameters;
+
+typedef double (*UserWeightFunction)(const DualEdgeTerms& terms, const DualEdgeTerms& averages, void *userData);
+
+// ApplyWeightPolicy of a policy compiled in by the caller, see UseWeightPolicy
+typedef void (*CustomWeightFunction)(const DualEdgeTerms *terms, int cnt, const DualEdgeTerms& averages, const WeightParameters& p, double *weights);
+
+// The policy to build the weights with and the knobs of every policy, all settable at
+// run time. The defaults give the weights the segmentation was tuned with.
+struct WeightParameters {
+    WeightPolicyId policy;
+    double delta;           // mixed: share of the geodesic term
+    double epsilon;         // dihedral: added to every edge so flat regions keep a distance
+    double curvatureGain;   // curvature: how far curvature stretches the geodesic term
+    UserWeightFunction userWeight;
+    void *userData;
+    CustomWeightFunction customWeights;
+    unsigned int policyVersion;     // user and custom: tells the functions apart in the cache key
+
+    WeightParameters() : policy(WEIGHT_MIXED), delta(0.03), epsilon(1e-3), curvatureGain(1.0), userWeight(NULL), userData(NULL),
+        customWeights(NULL), policyVersion(0) {}
+};
+
+// Weight policies turn the terms of an edge and their means over the mesh into its
+// weight through a static Weight, so ApplyWeightPolicy compiles to one loop per policy
+// with the formula inlined. A policy of one's own plugs in the same way through
+// UseWeightPolicy; WEIGHT_USER calls a function per edge instead for policies chosen at
+// run time.
+// a term that is zero everywhere, like the concave angle of a convex or flat mesh,
+// adds nothing instead of 0 / 0
+struct MixedWeight {
+    static double Weight(const DualEdgeTerms& t, const DualEdgeTerms& avg, const WeightParameters& p) {
+        return p.delta * (avg.phy > 0 ? t.phy / avg.phy : 0.0) + (1 - p.delta) * (avg.angle > 0 ? t.angle / avg.angle : 0.0);
+    }
+};
+
+struct DihedralWeight {
+    static double Weight(const DualEdgeTerms& t, const DualEdgeTerms& avg, const WeightParameters& p) {
+        return (avg.dihedral > 0 ? t.dihedral / avg.dihedral : 0.0) + p.epsilon;
+    }
+};
+
+// geodesic distance, stretched where the surface bends
+struct CurvatureWeight {
+    static double Weight(const DualEdgeTerms& t, const DualEdgeTerms& avg, const WeightParameters& p) {
+        return (avg.phy > 0 ? t.phy / avg.phy : 0.0) * (1 + p.curvatureGain * (avg.curvature > 0 ? t.curvature / avg.curvature : 0.0));
+    }
+};
+
+struct UserWeight {
+    static double Weight(const DualEdgeTerms& t, const DualEdgeTerms& avg, const WeightParameters& p) {
+        return p.userWeight(t, avg, p.userData);
+    }
+};
+
+template <class Policy>
+void ApplyWeightPolicy(const DualEdgeTerms *terms, int cnt, const DualEdgeTerms& averages, const WeightParameters& p, double *weights) {
+    for (int i = 0; i < cnt; ++i) {
+        weights[i] = Policy::Weight(terms[i], averages, p);
+    }
+}
+
+// Selects Policy for p, compiled into its own loop like the built-in ones. The cache
+// cannot look into the policy, so version has to change whenever its Weight does.
+template <class Policy>
+void UseWeightPolicy(WeightParameters& p, unsigned int version) {
+    p.policy = WEIGHT_CUSTOM;
+    p.customWeights = &ApplyWeightPolicy<Policy>;
+    p.policyVersion = version;
+}
+
+// ApplyWeightPolicy of the policy p selects
+void ComputeWeights(const DualEdgeTerms *terms, int cnt, const DualEdgeTerms& averages, const WeightParameters& p, double *weights);
+
+// the same for a single edge
+double EdgeWeight(const DualEdgeTerms& terms, const DualEdgeTerms& averages, const WeightParameters& p);
+
+// "mixed[:delta]", "dihedral[:epsilon]" or "curvature[:gain]"; p keeps what is not given
+bool ParseWeightParameters(const char *text, WeightParameters& p);
+const char* WeightPolicyName(WeightPolicyId policy);
\ No newline at end of file
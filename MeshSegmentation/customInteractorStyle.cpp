@@ -67,6 +67,7 @@ void customInteractorStyle::OnRightButtonDown() {
             if (pickId != -1) {
                 divMap = uiManager->clusterDivision(this->Interactor, cutPlane, pickId, S);
                 uiManager->HighlightDivision(this->Interactor, divMap, pickId, S, lastActor);
+                uiManager->ReleaseDivision(divMap, S);
                 lastActor = NULL;
 
                 dStatus = DONE;
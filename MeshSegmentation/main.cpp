@@ -1,8 +1,20 @@
+#include "Benchmark.h"
+#include "ShardedSegmentation.h"
 #include "meshsegmentation.h"
 #include <QtWidgets/QApplication>
 
+#include <stdlib.h>
+#include <string.h>
+
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+        return RunBenchmarks(argc - 2, argv + 2);
+    }
+    if (argc > 2 && strcmp(argv[1], "--shard-worker") == 0) {
+        return RunShardWorker(atoi(argv[2]));
+    }
+
     QApplication a(argc, argv);
     MeshSegmentation w;
     w.show();
@@ -4,6 +4,8 @@
 #include <QFileDialog>
 #include <QScreen>
 
+#include <stdlib.h>
+
 #include <iostream>
 
 using namespace std;
@@ -23,8 +25,21 @@ MeshSegmentation::MeshSegmentation(QWidget *parent) : QMainWindow(parent) {
     segmentButton = new QPushButton(tr("Start Segmentation"));
     mergeButton = new QPushButton(tr("Open Merge Mode"));
     divideButton = new QPushButton(tr("Open Divide Mode"));
+    saveButton = new QPushButton(tr("Save Segmentation"));
+    exportButton = new QPushButton(tr("Export Clusters"));
     clusterNumSlider = new QSlider(Qt::Horizontal);
+    progressBar = new QProgressBar;
     uiManager = NULL;
+    pendingSnapshot = NULL;
+    hasSnapshot = false;
+
+    // MESHSEG_TRACE=<file.json> records a Chrome trace of the session
+    const char *traceEnv = getenv("MESHSEG_TRACE");
+    if (traceEnv) {
+        traceFile = traceEnv;
+        Trace::SetThreadName("main");
+        Trace::Enable(true);
+    }
     
     /* =============================================================================== */
 
@@ -34,8 +49,14 @@ MeshSegmentation::MeshSegmentation(QWidget *parent) : QMainWindow(parent) {
     connect(segmentButton, &QPushButton::released, this, &MeshSegmentation::StartSegmentation);
     connect(mergeButton, &QPushButton::released, this, &MeshSegmentation::SetMergeMode);
     connect(divideButton, &QPushButton::released, this, &MeshSegmentation::SetDivideMode);
+    connect(saveButton, &QPushButton::released, this, &MeshSegmentation::SaveSegmentation);
+    connect(exportButton, &QPushButton::released, this, &MeshSegmentation::ExportClusters);
     connect(clusterNumSlider, SIGNAL(valueChanged(int)), this, SLOT(SetClusterNum(int)));
     connect(clusterNumSlider, &QSlider::sliderReleased, this, &MeshSegmentation::DisplayCluster);
+    connect(this, &MeshSegmentation::SegmentationProgress, this, &MeshSegmentation::ShowProgress);
+    connect(this, &MeshSegmentation::SegmentationFinished, this, &MeshSegmentation::FinishSegmentation);
+    connect(this, &MeshSegmentation::SnapshotReady, this, &MeshSegmentation::ShowSnapshot);
+    Progress::SetCallback(reportProgress, this);
 
     /* ============================================================================= */
 
@@ -48,12 +69,20 @@ MeshSegmentation::MeshSegmentation(QWidget *parent) : QMainWindow(parent) {
     clusterNumSlider->setTickPosition(QSlider::TicksBelow);
     clusterNumSlider->setDisabled(true);
 
+    progressBar->setRange(0, 100);
+    progressBar->setValue(0);
+    progressBar->setTextVisible(true);
+    progressBar->setFormat(tr("Idle"));
+
     mainLayout->setMargin(10);
     mainLayout->addWidget(modelViewer, 0, 0, modelViewerLen, modelViewerLen);
     mainLayout->addWidget(openFileButton, 0, modelViewerLen, 1, 4);
     mainLayout->addWidget(segmentButton, 1, modelViewerLen, 1, 4);
     mainLayout->addWidget(mergeButton, 2, modelViewerLen, 1, 4);
     mainLayout->addWidget(divideButton, 3, modelViewerLen, 1, 4);
+    mainLayout->addWidget(saveButton, 4, modelViewerLen, 1, 4);
+    mainLayout->addWidget(exportButton, 5, modelViewerLen, 1, 4);
+    mainLayout->addWidget(progressBar, 6, modelViewerLen, 1, 4);
     mainLayout->addWidget(clusterNumSlider, modelViewerLen, 0, 1, modelViewerLen);
 
     widget->setLayout(mainLayout);
@@ -68,7 +97,17 @@ MeshSegmentation::MeshSegmentation(QWidget *parent) : QMainWindow(parent) {
 }
 
 MeshSegmentation::~MeshSegmentation() {
+    // a run still going is stopped before the manager goes away
+    if (pipeline.valid()) {
+        Progress::Cancel();
+        pipeline.wait();
+    }
+    Progress::SetCallback(NULL, NULL);
+    delete pendingSnapshot;
 
+    if (!traceFile.empty()) {
+        Trace::Write(traceFile);
+    }
 }
 
 void MeshSegmentation::computeWindowSize(int& width, int& height) {
@@ -89,49 +128,214 @@ void MeshSegmentation::SetModelFileName() {
         delete uiManager;
     }
     clusterNumSlider->setDisabled(true);
+    Trace::Begin("load_model", "io");
     uiManager = modelViewer->RenderModel(string((const char *) path.toLocal8Bit()));
+    Trace::End();
+
+    // MESHSEG_MEMORY_BUDGET=<MB> trades speed for a smaller footprint on large meshes
+    const char *budgetEnv = getenv("MESHSEG_MEMORY_BUDGET");
+    if (budgetEnv) {
+        uiManager->SetMemoryBudget(atoll(budgetEnv) * 1024 * 1024);
+    }
+
+    // MESHSEG_FACE_ORDER=morton|hilbert|rcm renumbers the faces for locality first
+    const char *orderEnv = getenv("MESHSEG_FACE_ORDER");
+    FaceOrder order;
+    if (orderEnv && FaceOrdering::Parse(orderEnv, order)) {
+        uiManager->ReorderFaces(order);
+    }
+
+    // MESHSEG_WEIGHTS=mixed|dihedral|curvature[:value] picks the edge weight policy
+    const char *weightsEnv = getenv("MESHSEG_WEIGHTS");
+    WeightParameters weights;
+    if (weightsEnv && ParseWeightParameters(weightsEnv, weights)) {
+        uiManager->SetWeights(weights);
+    }
+
+    // MESHSEG_SEEDS=random|poisson|farthest picks how automatic seeds are spread
+    const char *seedsEnv = getenv("MESHSEG_SEEDS");
+    SeedMode seedMode;
+    if (seedsEnv && SeedSampler::Parse(seedsEnv, seedMode)) {
+        uiManager->SetSeedMode(seedMode);
+    }
+
+    // MESHSEG_VERTEX_GRAPH=1 assigns clusters on the mesh vertices instead of the faces
+    const char *vertexGraphEnv = getenv("MESHSEG_VERTEX_GRAPH");
+    if (vertexGraphEnv) {
+        uiManager->SetVertexGraph(atoi(vertexGraphEnv) != 0);
+    }
+
+    // MESHSEG_MULTILEVEL=<faces> assigns clusters on a graph coarsened to that size
+    const char *multilevelEnv = getenv("MESHSEG_MULTILEVEL");
+    if (multilevelEnv) {
+        uiManager->SetMultilevel(atoi(multilevelEnv));
+    }
+
+    // MESHSEG_PROGRESSIVE=<faces> shows a labeling from a graph of that size first
+    const char *progressiveEnv = getenv("MESHSEG_PROGRESSIVE");
+    if (progressiveEnv) {
+        uiManager->SetProgressive(atoi(progressiveEnv));
+    }
+
+    // MESHSEG_REGION_GROWING=<threshold> grows regions instead of assigning nearest centers
+    const char *regionEnv = getenv("MESHSEG_REGION_GROWING");
+    if (regionEnv) {
+        uiManager->SetRegionGrowing(atof(regionEnv));
+    }
+
+    // MESHSEG_OUT_OF_CORE=<faces> segments in chunks of that size off the cached graph
+    const char *outOfCoreEnv = getenv("MESHSEG_OUT_OF_CORE");
+    if (outOfCoreEnv) {
+        uiManager->SetOutOfCore(atoi(outOfCoreEnv));
+    }
+
+    // MESHSEG_SHARDS=<n> assigns clusters in n local worker processes
+    const char *shardsEnv = getenv("MESHSEG_SHARDS");
+    if (shardsEnv) {
+        uiManager->SetShards(atoi(shardsEnv));
+    }
 
     mergeButton->setText(tr("Open Merge Mode"));
     divideButton->setText(tr("Open Divide Mode"));
     modelViewer->style->isMergeButtonDown = false;
     modelViewer->style->isDivideButtonDown = false;
+
+    // a mesh segmented before comes straight back from the cache
+    if (uiManager->LoadCachedSegmentation(seedCnt, modelViewer->GetInteractor())) {
+        cout << "Segmentation loaded from cache" << endl;
+        clusterNumSlider->setValue(seedCnt);
+        clusterNumSlider->setDisabled(false);
+    }
 }
 
 void MeshSegmentation::StartSegmentation() {
+    // while running the button cancels
+    if (pipeline.valid()) {
+        Trace::Instant("cancel_segmentation");
+        Progress::Cancel();
+        segmentButton->setText(tr("Cancelling . . ."));
+        segmentButton->setDisabled(true);
+        return;
+    }
+    if (!uiManager) {
+        return;
+    }
+
+    mergeButton->setText(tr("Open Merge Mode"));
+    divideButton->setText(tr("Open Divide Mode"));
+    modelViewer->style->isMergeButtonDown = false;
+    modelViewer->style->isDivideButtonDown = false;
+    setControlsEnabled(false);
+    segmentButton->setText(tr("Cancel Segmentation"));
+
+    // the labels only reach the viewer in FinishSegmentation or ShowSnapshot, on this thread
+    Progress::Reset();
+    hasSnapshot = false;
+    pipelineTimer.Start();
+    uiManager->SetDeferRendering(true);
+    pipeline = async(launch::async, [=]() {
+        Trace::SetThreadName("pipeline");
+        runPipeline();
+        emit SegmentationFinished();
+    });
+}
+
+// Steps 1 to 4 on the pipeline thread. Nothing here renders, the window picks the
+// result up in FinishSegmentation; a cancelled run stops at the next stage.
+void MeshSegmentation::runPipeline() {
     double dur[4], *dur_2;
-    clock_t begin, end;
-    clock_t totalBegin, totalEnd;
+    double begin, end;
+    double totalBegin, totalEnd;
+    PerfCounters perf[4];
+    vtkSmartPointer<vtkRenderWindowInteractor> noInteractor;
+    MemoryTracker::ResetPeaks();
 
     cout << "=============================================" << endl;
     cout << "Step 1 : Converting model to dual graph . . ." << endl;
-    begin = clock();
+    Progress::BeginStage(PROGRESS_DUAL_GRAPH);
+    begin = WallTimer::Now();
+    Trace::Begin("step1_dual_graph");
+    perf[0].Start();
     totalBegin = begin;
     uiManager->ConvertPolydataToDualGraph();
-    end = clock();
-    dur[0] = (end - begin) * 1.0 / CLOCKS_PER_SEC;
+    end = WallTimer::Now();
+    perf[0].Stop();
+    Trace::End();
+    dur[0] = end - begin;
+    if (Progress::IsCancelled()) {
+        cout << "Segmentation cancelled" << endl;
+        return;
+    }
 
     cout << "Step 2 : Automatic selecting seeds . . ." << endl;
-    begin = clock();
-    uiManager->AutomaticSelectSeeds(seedCnt, modelViewer->GetInteractor());
-    end = clock();
-    dur[1] = (end - begin) * 1.0 / CLOCKS_PER_SEC;
+    Progress::BeginStage(PROGRESS_SEEDS);
+    begin = WallTimer::Now();
+    Trace::Begin("step2_seeds");
+    perf[1].Start();
+    uiManager->AutomaticSelectSeeds(seedCnt, noInteractor);
+    end = WallTimer::Now();
+    perf[1].Stop();
+    Trace::End();
+    dur[1] = end - begin;
+    if (Progress::IsCancelled()) {
+        cout << "Segmentation cancelled" << endl;
+        return;
+    }
+
+    // steps 3 and 4 together, the snapshots go to ShowSnapshot as they come
+    if (uiManager->GetProgressive() > 0 && uiManager->GetRegionGrowing() <= 0) {
+        cout << "Step 3 : Segmenting progressively . . ." << endl;
+        Progress::BeginStage(PROGRESS_ASSIGNMENT);
+        begin = WallTimer::Now();
+        Trace::Begin("step3_progressive");
+        uiManager->SegmentProgressively(deliverSnapshot, this);
+        end = WallTimer::Now();
+        Trace::End();
+        printf("time 1 : \t%.3lf\n", dur[0]);
+        printf("time 2 : \t%.3lf\n", dur[1]);
+        printf("time 3 and 4 : \t%.3lf\n", end - begin);
+        cout << "=============================================" << endl;
+        return;
+    }
 
     cout << "Step 3 : Segmenting . . ." << endl;
-    begin = clock();
-    dur_2 = uiManager->StartSegmentation(modelViewer->GetInteractor());
-    end = clock();
-    dur[2] = (end - begin) * 1.0 / CLOCKS_PER_SEC;
+    Progress::BeginStage(PROGRESS_ASSIGNMENT);
+    begin = WallTimer::Now();
+    Trace::Begin("step3_segment");
+    perf[2].Start();
+    dur_2 = uiManager->StartSegmentation(noInteractor);
+    end = WallTimer::Now();
+    perf[2].Stop();
+    Trace::End();
+    dur[2] = end - begin;
+    if (Progress::IsCancelled()) {
+        cout << "Segmentation cancelled" << endl;
+        delete[] dur_2;
+        return;
+    }
 
     cout << "Step 4 : Merging clusters . . ." << endl;
-    begin = clock();
-    uiManager->MergeClusters(seedCnt, modelViewer->GetInteractor());
-    end = clock();
+    Progress::BeginStage(PROGRESS_MERGE);
+    begin = WallTimer::Now();
+    Trace::Begin("step4_merge");
+    perf[3].Start();
+    uiManager->MergeClusters(seedCnt, noInteractor);
+    end = WallTimer::Now();
+    perf[3].Stop();
+    Trace::End();
     totalEnd = end;
-    dur[3] = (end - begin) * 1.0 / CLOCKS_PER_SEC;
+    dur[3] = end - begin;
+    if (Progress::IsCancelled()) {
+        cout << "Segmentation cancelled" << endl;
+        delete[] dur_2;
+        return;
+    }
+    Progress::Report(1, 1);
+    uiManager->SaveSegmentationToCache(seedCnt);
     cout << "=============================================" << endl;
 
     cout << "Runtime analysis : " << endl;
-    double totalDur = (totalEnd - totalBegin) * 1.0 / CLOCKS_PER_SEC;
+    double totalDur = totalEnd - totalBegin;
     printf("time 1 : \t%.3lf\t\t%.1lf%%\n", dur[0], dur[0] * 100.0 / totalDur);
     printf("time 2 : \t%.3lf\t\t%.1lf%%\n", dur[1], dur[1] * 100.0 / totalDur);
     printf("time 3 : \t%.3lf\t\t%.1lf%%\n", dur[2], dur[2] * 100.0 / totalDur);
@@ -146,20 +350,133 @@ void MeshSegmentation::StartSegmentation() {
     printf("total : \t%.3lf\n", totalDur);
     cout << "=============================================" << endl;
 
-    clusterNumSlider->setValue(seedCnt);
-    clusterNumSlider->setTickPosition(QSlider::TicksBelow);
-    clusterNumSlider->setDisabled(false);
+    cout << "Counters : " << endl;
+    perf[0].Print("step 1");
+    perf[1].Print("step 2");
+    perf[2].Print("step 3");
+    uiManager->GetDijkstraCounters().Print("- step 3.2");
+    perf[3].Print("step 4");
+    cout << "=============================================" << endl;
+
+    cout << "Memory : " << endl;
+    MemoryTracker::Print();
+    cout << "=============================================" << endl;
 
     delete[] dur_2;
 }
 
+// Back on the window thread: the pipeline has finished with the manager, so its labels
+// are shown and the controls come back, or a cancelled run is cleared away
+void MeshSegmentation::FinishSegmentation() {
+    pipeline.get();
+    ShowSnapshot();
+    uiManager->SetDeferRendering(false);
+    setControlsEnabled(true);
+    segmentButton->setText(tr("Start Segmentation"));
+
+    // a progressive run stopped early keeps the last snapshot it showed
+    if (Progress::IsCancelled() && !hasSnapshot) {
+        uiManager->ResetSegmentation();
+        progressBar->setValue(0);
+        progressBar->setFormat(tr("Cancelled"));
+    } else if (hasSnapshot) {
+        progressBar->setFormat(Progress::IsCancelled() ? tr("Stopped") : tr("Done"));
+    } else {
+        uiManager->RenderClusters(modelViewer->GetInteractor());
+        clusterNumSlider->setValue(seedCnt);
+        clusterNumSlider->setTickPosition(QSlider::TicksBelow);
+        clusterNumSlider->setDisabled(false);
+        progressBar->setFormat(tr("Done"));
+    }
+
+    if (!traceFile.empty()) {
+        Trace::Write(traceFile);
+    }
+}
+
+// The latest snapshot of a progressive run replaces what is shown, at the level the
+// slider is on; the controls work on it right away
+void MeshSegmentation::ShowSnapshot() {
+    SegmentationSnapshot *snapshot;
+    {
+        lock_guard<mutex> lock(snapshotLock);
+        snapshot = pendingSnapshot;
+        pendingSnapshot = NULL;
+    }
+    if (!snapshot) {
+        return;
+    }
+    // stopped for merge or divide mode, what is shown stays
+    if (Progress::IsCancelled()) {
+        delete snapshot;
+        return;
+    }
+
+    bool isFinal = snapshot->isFinal;
+    uiManager->ApplySnapshot(snapshot, modelViewer->GetInteractor());
+    if (!hasSnapshot) {
+        hasSnapshot = true;
+        currentClusterNum = seedCnt;
+        clusterNumSlider->setValue(seedCnt);
+        clusterNumSlider->setDisabled(false);
+        mergeButton->setEnabled(true);
+        divideButton->setEnabled(true);
+        saveButton->setEnabled(true);
+        exportButton->setEnabled(true);
+    } else if (currentClusterNum != seedCnt && clusterNumSlider->isEnabled()) {
+        uiManager->SetClusterStep(seedCnt, currentClusterNum, modelViewer->GetInteractor());
+    }
+    if (isFinal) {
+        uiManager->SaveSegmentationToCache(seedCnt);
+    }
+    printf("%s segmentation shown after %.3lf s\n", isFinal ? "final" : "progressive", pipelineTimer.Elapsed());
+}
+
+void MeshSegmentation::deliverSnapshot(void *data, SegmentationSnapshot *snapshot) {
+    MeshSegmentation *window = (MeshSegmentation *) data;
+    {
+        // one the window has not picked up yet is already out of date
+        lock_guard<mutex> lock(window->snapshotLock);
+        delete window->pendingSnapshot;
+        window->pendingSnapshot = snapshot;
+    }
+    emit window->SnapshotReady();
+}
+
+void MeshSegmentation::ShowProgress(int stage, int percent) {
+    progressBar->setValue(percent);
+    progressBar->setFormat(QString("%1 %p%").arg(Progress::Name((ProgressStage) stage)));
+}
+
+void MeshSegmentation::reportProgress(void *data, ProgressStage stage, int percent) {
+    MeshSegmentation *window = (MeshSegmentation *) data;
+    emit window->SegmentationProgress((int) stage, percent);
+}
+
+void MeshSegmentation::setControlsEnabled(bool enabled) {
+    openFileButton->setEnabled(enabled);
+    segmentButton->setEnabled(true);
+    mergeButton->setEnabled(enabled);
+    divideButton->setEnabled(enabled);
+    saveButton->setEnabled(enabled);
+    exportButton->setEnabled(enabled);
+    if (!enabled) {
+        clusterNumSlider->setDisabled(true);
+    }
+}
+
 void MeshSegmentation::SetMergeMode() {
     bool& tmp = modelViewer->style->isMergeButtonDown;
 
+    Trace::Instant(tmp ? "merge_mode_off" : "merge_mode_on");
     if (tmp) {
         mergeButton->setText(tr("Open Merge Mode"));
         tmp = false;
     } else {
+        // editing ends a progressive run at the snapshot shown
+        if (pipeline.valid()) {
+            Progress::Cancel();
+        }
         if (clusterNumSlider->isEnabled()) {
             clusterNumSlider->setDisabled(true);
             uiManager->ConfirmClusterSegmentation(seedCnt, currentClusterNum);
@@ -173,10 +490,15 @@ void MeshSegmentation::SetDivideMode() {
     bool& tmp = modelViewer->style->isDivideButtonDown;
     modelViewer->style->dStatus = ONE;
 
+    Trace::Instant(tmp ? "divide_mode_off" : "divide_mode_on");
     if (tmp) {
         divideButton->setText(tr("Open Divide Mode"));
         tmp = false;
     } else {
+        // editing ends a progressive run at the snapshot shown
+        if (pipeline.valid()) {
+            Progress::Cancel();
+        }
         if (clusterNumSlider->isEnabled()) {
             clusterNumSlider->setDisabled(true);
             uiManager->ConfirmClusterSegmentation(seedCnt, currentClusterNum);
@@ -186,6 +508,58 @@ void MeshSegmentation::SetDivideMode() {
     }
 }
 
+void MeshSegmentation::SaveSegmentation() {
+    // the hierarchy only describes the result until merge or divide mode edits it
+    if (!uiManager || !clusterNumSlider->isEnabled()) {
+        cout << "No segmentation hierarchy to save" << endl;
+        return;
+    }
+
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save segmentation"), tr("../../objects/"), tr("Segmentation Files(*.seg)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    if (uiManager->SaveSegmentation(string((const char *) fileName.toLocal8Bit()), seedCnt)) {
+        cout << "Segmentation saved to " << (const char *) fileName.toLocal8Bit() << endl;
+    } else {
+        cout << "Failed to save segmentation" << endl;
+    }
+}
+
+void MeshSegmentation::ExportClusters() {
+    if (!uiManager) {
+        return;
+    }
+
+    QString selectedFilter;
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export clusters"), tr("../../objects/"),
+        tr("STL Files(*.stl);;PLY Files(*.ply);;Multi-part STL File(*.stl)"), &selectedFilter);
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    ExportFormat format = EXPORT_STL;
+    if (selectedFilter.startsWith(tr("PLY"))) {
+        format = EXPORT_PLY;
+    } else if (selectedFilter.startsWith(tr("Multi-part"))) {
+        format = EXPORT_MULTI_STL;
+    }
+    if (fileName.endsWith(".stl", Qt::CaseInsensitive) || fileName.endsWith(".ply", Qt::CaseInsensitive)) {
+        fileName.chop(4);
+    }
+
+    // while the slider is live the parts come from the displayed level of the hierarchy
+    int k = clusterNumSlider->isEnabled() ? currentClusterNum : 0;
+    WallTimer timer;
+    int partCnt = uiManager->ExportClusters(string((const char *) fileName.toLocal8Bit()), seedCnt, k, format);
+    if (partCnt < 0) {
+        cout << "Failed to export clusters" << endl;
+    } else {
+        printf("Exported %d parts in %.3lf s\n", partCnt, timer.Elapsed());
+    }
+}
+
 void MeshSegmentation::SetClusterNum(int k) {
     currentClusterNum = k;
 }
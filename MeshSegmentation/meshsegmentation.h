@@ -6,12 +6,19 @@
 
 #include <QGridLayout>
 #include <QLabel>
+#include <QProgressBar>
 #include <QPushButton>
 #include <QString>
 #include <QVTKWidget.h>
 #include <QWidget>
 
+#include <future>
+#include <mutex>
+
+#include "Progress.h"
 #include "QVTKModelViewer.h"
+#include "SegmentationSnapshot.h"
+#include "Timer.h"
 
 class MeshSegmentation : public QMainWindow
 {
@@ -28,6 +35,7 @@ private:
     int colorNum;
     int modelViewerLen;
     QString path;
+    std::string traceFile;
 
     QWidget *widget;
     QVTKModelViewer *modelViewer;
@@ -36,19 +44,46 @@ private:
     QPushButton *segmentButton;
     QPushButton *mergeButton;
     QPushButton *divideButton;
+    QPushButton *saveButton;
+    QPushButton *exportButton;
     QSlider *clusterNumSlider;
+    QProgressBar *progressBar;
     UserInteractionManager* uiManager;
 
+    // the pipeline runs here while the window stays responsive
+    std::future<void> pipeline;
+    WallTimer pipelineTimer;
+
+    // progressive runs leave their latest snapshot here for the window to pick up
+    std::mutex snapshotLock;
+    SegmentationSnapshot *pendingSnapshot;
+    bool hasSnapshot;
+
 private:
     void computeWindowSize(int& width, int& height);
+    void runPipeline();
+    void setControlsEnabled(bool enabled);
+    static void reportProgress(void *data, ProgressStage stage, int percent);
+    static void deliverSnapshot(void *data, SegmentationSnapshot *snapshot);
+
+signals:
+    // both come from the pipeline thread and are queued to the window
+    void SegmentationProgress(int stage, int percent);
+    void SegmentationFinished();
+    void SnapshotReady();
 
 private slots:
     void SetModelFileName();
     void StartSegmentation();
     void SetMergeMode();
     void SetDivideMode();
+    void SaveSegmentation();
+    void ExportClusters();
     void SetClusterNum(int k);
     void DisplayCluster();
+    void ShowProgress(int stage, int percent);
+    void FinishSegmentation();
+    void ShowSnapshot();
 };
 
 #endif // MESHSEGMENTATION_H
@@ -16,7 +16,10 @@
 #include <vtkUndirectedGraph.h>
 #include <vtkTriangle.h>
 
-#include "List.h"
+#include <vector>
+
+#include "PerfCounters.h"
+#include "WeightPolicies.h"
 
 vtkStandardNewMacro(vtkConvertToDualGraph);
 
@@ -29,10 +32,7 @@ int vtkConvertToDualGraph::RequestData(vtkInformation *vtkNotUsed(request), vtkI
 
     vtkSmartPointer<vtkMutableUndirectedGraph> g = vtkSmartPointer<vtkMutableUndirectedGraph>::New();
 
-    vtkSmartPointer<vtkPoints> points = mesh->GetPoints();
-    vtkSmartPointer<vtkDataArray> dataArray = points->GetData();
     int numberOfFaces = mesh->GetNumberOfCells();
-    vtkSmartPointer<vtkIdList> faceIndex = vtkSmartPointer<vtkIdList>::New();
 
     vtkSmartPointer<vtkDoubleArray> centers = vtkSmartPointer<vtkDoubleArray>::New();
     centers->SetName("Centers");
@@ -49,132 +49,67 @@ int vtkConvertToDualGraph::RequestData(vtkInformation *vtkNotUsed(request), vtkI
         g->AddVertex();
     }
 
+    // get center & area of each cell
+    DualFaceWalker walker(mesh);
+    double lateral[3];
     for (int i = 0; i < numberOfFaces; ++i) {
-        mesh->GetCellPoints(i, faceIndex);
-        int vertexIndex[3] = { faceIndex->GetId(0), faceIndex->GetId(1), faceIndex->GetId(2) };
-        double p0[3], p1[3], p2[3];
-
-        // convert into points
-        dataArray->GetTuple(vertexIndex[0], p0);
-        dataArray->GetTuple(vertexIndex[1], p1);
-        dataArray->GetTuple(vertexIndex[2], p2);
-
-        // get center & area of each cell
-        double area = vtkTriangle::TriangleArea(p0, p1, p2);
-        areas->InsertValue(i, area);
-
-        double center[3];
-        center[0] = (p0[0] + p1[0] + p2[0]) / 3;
-        center[1] = (p0[1] + p1[1] + p2[1]) / 3;
-        center[2] = (p0[2] + p1[2] + p2[2]) / 3;
-        centers->InsertTuple(i, center);
+        walker.Geometry(i, centers->GetPointer(3 * i), *areas->GetPointer(i), lateral);
     }
 
     // get normals
-    vtkSmartPointer<vtkPolyDataNormals> normalGenerator = vtkSmartPointer<vtkPolyDataNormals>::New();
-    normalGenerator->SetInputData(mesh);
-    normalGenerator->ComputePointNormalsOff();
-    normalGenerator->ComputeCellNormalsOn();
-    normalGenerator->Update();
+    std::vector<double> normals(3 * (size_t) numberOfFaces);
+    if (numberOfFaces > 0) {
+        ComputeFaceNormals(mesh, &normals[0]);
+    }
+
+    // get neighbors and the terms of every dual edge, a closed mesh has 3F/2 of them
+    std::vector<DualEdgeTerms> terms;
+    terms.reserve(3 * (size_t) numberOfFaces / 2);
+    long long scanned = 0;
 
-    vtkSmartPointer<vtkPolyData> Data = normalGenerator->GetOutput();
-    vtkDataArray* normals = Data->GetCellData()->GetNormals();
+    std::vector< std::pair<int, int> > across;
+    for (int i = 0; i < numberOfFaces; ++i) {
+        double center[3], area;
+        walker.Geometry(i, center, area, lateral);
+        scanned += walker.Neighbors(i, across);
+        for (size_t k = 0; k < across.size(); ++k) {
+            int neighborCellId = across[k].first;
+            if (i >= neighborCellId) {
+                continue;
+            }
 
-    // get neighbors and mesh distance
+            DualEdgeTerms t;
+            ComputeEdgeTerms(areas->GetValue(i), areas->GetValue(neighborCellId), &normals[3 * i], &normals[3 * neighborCellId],
+                centers->GetPointer(3 * i), centers->GetPointer(3 * neighborCellId), lateral[across[k].second], t);
+            terms.push_back(t);
+            g->AddEdge(i, neighborCellId);
+        }
+    }
+
+    PerfCounters::Add(PERF_EDGES_SCANNED, scanned);
+
+    // weights and lengths go straight into arrays of their final size
+    int edgeNumber = (int) terms.size();
     vtkSmartPointer<vtkDoubleArray> meshDis = vtkSmartPointer<vtkDoubleArray>::New();
     meshDis->SetName("Weights");
     meshDis->SetNumberOfComponents(1);
-
-    vtkSmartPointer<vtkDoubleArray> phyDis = vtkSmartPointer<vtkDoubleArray>::New();
-    phyDis->SetNumberOfComponents(1);
-
-    vtkSmartPointer<vtkDoubleArray> angleDis = vtkSmartPointer<vtkDoubleArray>::New();
-    angleDis->SetNumberOfComponents(1);
+    meshDis->SetNumberOfTuples(edgeNumber);
 
     vtkSmartPointer<vtkDoubleArray> edgeDis = vtkSmartPointer<vtkDoubleArray>::New();
     edgeDis->SetName("EdgeLens");
     edgeDis->SetNumberOfComponents(1);
+    edgeDis->SetNumberOfTuples(edgeNumber);
 
-    double phyDisAvg = 0.0, angleDisAvg = 0.0;
-
-    for (int i = 0; i < numberOfFaces; ++i) {
-        mesh->GetCellPoints(i, faceIndex);
-        int vertexIndex[3] = { faceIndex->GetId(0), faceIndex->GetId(1), faceIndex->GetId(2) };
-        List<vtkIdType> neighbors;
-        double p0[3], p1[3], p2[3];
-
-        // convert into points
-        dataArray->GetTuple(vertexIndex[0], p0);
-        dataArray->GetTuple(vertexIndex[1], p1);
-        dataArray->GetTuple(vertexIndex[2], p2);
-
-        // get side length of a face
-        double lateral[3];
-        lateral[0] = sqrt(vtkMath::Distance2BetweenPoints(p0, p1));
-        lateral[1] = sqrt(vtkMath::Distance2BetweenPoints(p1, p2));
-        lateral[2] = sqrt(vtkMath::Distance2BetweenPoints(p2, p0));
-
-        for (int j = 0; j < 3; ++j) {
-            vtkSmartPointer<vtkIdList> idList = vtkSmartPointer<vtkIdList>::New();
-            idList->InsertNextId(vertexIndex[j]);
-            idList->InsertNextId(vertexIndex[(j + 1) % 3]);
-
-            vtkSmartPointer<vtkIdList> neighborCellIds = vtkSmartPointer<vtkIdList>::New();
-            mesh->GetCellNeighbors(i, idList, neighborCellIds);
-            for (int k = 0; k < neighborCellIds->GetNumberOfIds(); ++k) {
-                int neighborCellId = neighborCellIds->GetId(k);
-
-                if (i >= neighborCellId) {
-                    continue;
-                }
-
-                neighbors.push_back(neighborCellId);
-
-                double a, b;
-                a = 2.0 * areas->GetValue(i) / (3 * lateral[j]);
-                b = 2.0 * areas->GetValue(neighborCellId) / (3 * lateral[j]);
-
-                double n0[3], n1[3];
-                normals->GetTuple(i, n0);
-                normals->GetTuple(neighborCellId, n1);
-                double c0[3], c1[3];
-                centers->GetTuple(i, c0);
-                centers->GetTuple(neighborCellId, c1);
-                double w[3] = { c1[0] - c0[0], c1[1] - c0[1], c1[2] - c0[2] };
-
-                double phy, angle;
-                phy = a + b;
-                angle = 0.0;
-                if (vtkMath::Dot(n0, w) >= 0) {
-                    angle = 1 - vtkMath::Dot(n0, n1);
-                }
-
-                phyDis->InsertNextValue(phy);
-                angleDis->InsertNextValue(angle);
-                edgeDis->InsertNextValue(lateral[j]);
-
-                phyDisAvg += phy;
-                angleDisAvg += angle;
-            }
-        }
-
-        for (List<vtkIdType>::iterator it = neighbors.begin(); it != NULL; it = it->next) {
-        //for (auto neighbor : neighbors) {
-            g->AddEdge(i, it->key);
+    if (edgeNumber > 0) {
+        ComputeWeights(&terms[0], edgeNumber, AverageTerms(&terms[0], edgeNumber), Weights, meshDis->GetPointer(0));
+        for (int i = 0; i < edgeNumber; ++i) {
+            edgeDis->SetValue(i, terms[i].length);
         }
     }
 
-    double delta = 0.03;
-    int edgeNumber = phyDis->GetNumberOfTuples();
-    phyDisAvg /= edgeNumber;
-    angleDisAvg /= edgeNumber;
-    for (int i = 0; i < edgeNumber; ++i) {
-        double w = delta * phyDis->GetValue(i) / phyDisAvg + (1 - delta) * angleDis->GetValue(i) / angleDisAvg;
-        meshDis->InsertNextValue(w);
-    }
-
     g->GetEdgeData()->AddArray(meshDis);
     g->GetVertexData()->AddArray(centers);
+    g->GetVertexData()->AddArray(areas);
     g->GetEdgeData()->AddArray(edgeDis);
 
     output->ShallowCopy(g);
@@ -182,6 +117,65 @@ int vtkConvertToDualGraph::RequestData(vtkInformation *vtkNotUsed(request), vtkI
     return 1;
 }
 
+DualFaceWalker::DualFaceWalker(vtkPolyData *mesh) : mesh(mesh) {
+    points = mesh->GetPoints()->GetData();
+    corners = vtkSmartPointer<vtkIdList>::New();
+    side = vtkSmartPointer<vtkIdList>::New();
+    faces = vtkSmartPointer<vtkIdList>::New();
+}
+
+void DualFaceWalker::Geometry(int faceId, double *center, double& area, double *lateral) {
+    mesh->GetCellPoints(faceId, corners);
+    double p0[3], p1[3], p2[3];
+
+    // convert into points
+    points->GetTuple(corners->GetId(0), p0);
+    points->GetTuple(corners->GetId(1), p1);
+    points->GetTuple(corners->GetId(2), p2);
+
+    area = vtkTriangle::TriangleArea(p0, p1, p2);
+    center[0] = (p0[0] + p1[0] + p2[0]) / 3;
+    center[1] = (p0[1] + p1[1] + p2[1]) / 3;
+    center[2] = (p0[2] + p1[2] + p2[2]) / 3;
+
+    // get side length of a face
+    lateral[0] = sqrt(vtkMath::Distance2BetweenPoints(p0, p1));
+    lateral[1] = sqrt(vtkMath::Distance2BetweenPoints(p1, p2));
+    lateral[2] = sqrt(vtkMath::Distance2BetweenPoints(p2, p0));
+}
+
+int DualFaceWalker::Neighbors(int faceId, std::vector< std::pair<int, int> >& res) {
+    mesh->GetCellPoints(faceId, corners);
+    vtkIdType vertexIndex[3] = { corners->GetId(0), corners->GetId(1), corners->GetId(2) };
+    res.clear();
+    int scanned = 0;
+    for (int j = 0; j < 3; ++j) {
+        side->Reset();
+        side->InsertNextId(vertexIndex[j]);
+        side->InsertNextId(vertexIndex[(j + 1) % 3]);
+        mesh->GetCellNeighbors(faceId, side, faces);
+        scanned += faces->GetNumberOfIds();
+        for (vtkIdType k = 0; k < faces->GetNumberOfIds(); ++k) {
+            res.push_back(std::make_pair((int) faces->GetId(k), j));
+        }
+    }
+    return scanned;
+}
+
+void ComputeFaceNormals(vtkPolyData *mesh, double *normals) {
+    vtkSmartPointer<vtkPolyDataNormals> normalGenerator = vtkSmartPointer<vtkPolyDataNormals>::New();
+    normalGenerator->SetInputData(mesh);
+    normalGenerator->ComputePointNormalsOff();
+    normalGenerator->ComputeCellNormalsOn();
+    normalGenerator->Update();
+
+    vtkDataArray *cellNormals = normalGenerator->GetOutput()->GetCellData()->GetNormals();
+    int numberOfFaces = mesh->GetNumberOfCells();
+    for (int i = 0; i < numberOfFaces; ++i) {
+        cellNormals->GetTuple(i, normals + 3 * i);
+    }
+}
+
 int vtkConvertToDualGraph::RequestDataObject(vtkInformation *, vtkInformationVector **, vtkInformationVector *) {
     vtkMutableUndirectedGraph *output = 0;
     output = vtkMutableUndirectedGraph::New();
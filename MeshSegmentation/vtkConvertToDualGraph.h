@@ -3,6 +3,14 @@
 #include <vtkGraphAlgorithm.h>
 #include <vtkInformation.h>
 #include <vtkInformationVector.h>
+#include <vtkIdList.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include <utility>
+#include <vector>
+
+#include "WeightPolicies.h"
 
 class vtkConvertToDualGraph : public vtkGraphAlgorithm {
 public:
@@ -10,7 +18,21 @@ public:
 
     static vtkConvertToDualGraph *New();
 
+    // blend between geodesic (Delta) and angular (1 - Delta) distance in the mixed weights
+    void SetDelta(double delta) { Weights.delta = delta; this->Modified(); }
+    double GetDelta() { return Weights.delta; }
+
+    // policy turning the terms of every dual edge into its weight, see WeightPolicies.h
+    void SetWeightParameters(const WeightParameters& weights) { Weights = weights; this->Modified(); }
+    const WeightParameters& GetWeightParameters() { return Weights; }
+
+    // a policy of one's own with the knobs of the current parameters, see UseWeightPolicy
+    template <class Policy>
+    void SetWeightPolicy(unsigned int version) { UseWeightPolicy<Policy>(Weights, version); this->Modified(); }
+
 protected:
+    WeightParameters Weights;
+
     vtkConvertToDualGraph() {}
     ~vtkConvertToDualGraph() {}
 
@@ -22,4 +44,28 @@ protected:
 private:
     vtkConvertToDualGraph(const vtkConvertToDualGraph&);
     void operator = (const vtkConvertToDualGraph&);
+};
+
+// Unit normals of the faces as the dual edge terms take them, from vtkPolyDataNormals
+// with consistent ordering, so a face wound against its neighbors is flipped to agree
+// with them. normals[3 * numberOfFaces]
+void ComputeFaceNormals(vtkPolyData *mesh, double *normals);
+
+// Walks the triangles of a mesh the way vtkConvertToDualGraph builds the dual graph of
+// them, so graphs built elsewhere from the same walk come out the same
+class DualFaceWalker {
+private:
+    vtkPolyData *mesh;
+    vtkDataArray *points;
+    vtkSmartPointer<vtkIdList> corners, side, faces;
+
+public:
+    DualFaceWalker(vtkPolyData *mesh);
+
+    // center, area and side lengths, side j running from corner j to corner j + 1
+    void Geometry(int faceId, double *center, double& area, double *lateral);
+
+    // res receives the faces across every side in turn as (face, side); the dual edges
+    // are those to faces with a higher id. Returns how many faces there are.
+    int Neighbors(int faceId, std::vector< std::pair<int, int> >& res);
 };
\ No newline at end of file